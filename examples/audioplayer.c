@@ -25,51 +25,8 @@
 
 #include <string.h>
 
-#define BUF_SIZE 10
-
-/* prepare to buffer 10 frames */
-SDL_ffmpegAudioFrame *frame[BUF_SIZE];
-
-/* use a mutex to prevent errors due to multithreading */
-SDL_mutex *mutex = 0;
-
-/* use this value to check if we reached the end of our file */
-int done = 0;
-
-void audioCallback( void *udata, Uint8 *stream, int len )
-{
-
-    /* lock mutex, so frame[0] will not be changed from another thread */
-    SDL_LockMutex( mutex );
-
-    if ( frame[0]->size == len )
-    {
-
-        /* copy the data to the output */
-        memcpy( stream, frame[0]->buffer, frame[0]->size );
-
-        /* mark data as used */
-        frame[0]->size = 0;
-
-        /* move frames in buffer */
-        SDL_ffmpegAudioFrame *f = frame[0];
-        int i;
-        for ( i = 1; i < BUF_SIZE; i++ ) frame[i-1] = frame[i];
-        frame[BUF_SIZE-1] = f;
-
-        if ( frame[0]->last ) done = 1;
-    }
-    else
-    {
-        /* no data available, just set output to zero */
-        memset( stream, 0, len );
-    }
-
-    /* were done with frame[0], release lock */
-    SDL_UnlockMutex( mutex );
-
-    return;
-}
+/* amount of audio which is decoded ahead, in bytes */
+#define BUF_SIZE 65536
 
 int main( int argc, char** argv )
 {
@@ -104,9 +61,9 @@ int main( int argc, char** argv )
         goto CLEANUP_DATA;
     }
 
-    /* get the audiospec which fits the selected audiostream, if no audiostream
-       is selected, default values are used (2 channel, 48Khz) */
-    SDL_AudioSpec specs = SDL_ffmpegGetAudioSpec( audioFile, 512, audioCallback );
+    /* get the audiospec which fits the selected audiostream, SDL_ffmpeg
+       provides a callback which plays the audio it decoded ahead */
+    SDL_AudioSpec specs = SDL_ffmpegGetAudioSpec( audioFile, 512, SDL_ffmpegAudioCallback );
 
     /* Open the Audio device */
     if ( SDL_OpenAudio( &specs, 0 ) < 0 )
@@ -115,30 +72,20 @@ int main( int argc, char** argv )
         goto CLEANUP_DATA;
     }
 
-    /* calculate the amount of bytes required for every callback */
-    int bytes = specs.samples * specs.channels * 2;
-
-    /* create audio frames to store data received from SDL_ffmpegGetAudioFrame */
-    int i;
-    for ( i = 0; i < BUF_SIZE; i++ )
+    /* let SDL_ffmpeg decode audio in a separate thread */
+    if ( SDL_ffmpegSetAudioDecodeAhead( audioFile, BUF_SIZE ) )
     {
-        frame[i] = SDL_ffmpegCreateAudioFrame( audioFile, bytes );
-        if ( !frame[i] )
-        {
-            printf( "couldn't prepare frame buffer\n" );
-            return -1;
-        }
-        /* fill the frames */
-        SDL_ffmpegGetAudioFrame( audioFile, frame[i] );
-    }
+        fprintf( stderr, "could not decode audio ahead: %s\n", SDL_ffmpegGetError() );
 
-    /* initialize mutex */
-    mutex = SDL_CreateMutex();
+        SDL_CloseAudio();
+
+        goto CLEANUP_DATA;
+    }
 
     /* we unpause the audio so our audiobuffer gets read */
     SDL_PauseAudio( 0 );
 
-    done = 0;
+    int done = 0;
 
     while ( !done )
     {
@@ -154,42 +101,21 @@ int main( int argc, char** argv )
             }
         }
 
-        /* lock mutex before working on buffer */
-        SDL_LockMutex( mutex );
-
-        /* check for empty places in buffer */
-        int i;
-        for ( i = 0; i < BUF_SIZE; i++ )
-        {
-
-            /* if an empty space is found, fill it again */
-            if ( !frame[i]->size )
-            {
-                SDL_ffmpegGetAudioFrame( audioFile, frame[i] );
-            }
-        }
-
-        /* done with buffer, release lock */
-        SDL_UnlockMutex( mutex );
+        /* check if all audio was played */
+        if ( SDL_ffmpegAudioEnded( audioFile ) ) done = 1;
 
         /* we wish not to kill our poor cpu, so we give it some timeoff */
-        SDL_Delay( 5 );
+        SDL_Delay( 10 );
     }
 
-CLEANUP_DATA:
+    /* the callback should not be called anymore when the file is released */
+    SDL_CloseAudio();
 
-    /* cleanup our buffer */
-    for ( i = 0; i < BUF_SIZE; i++ )
-    {
-        SDL_ffmpegFreeAudioFrame( frame[i] );
-    }
+CLEANUP_DATA:
 
     /* when we are done with the file, we free it */
     SDL_ffmpegFree( audioFile );
 
-    /* cleanup mutex */
-    SDL_DestroyMutex( mutex );
-
     /* the SDL_Quit function offcourse... */
     SDL_Quit();
 
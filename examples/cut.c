@@ -0,0 +1,82 @@
+/*******************************************************************************
+*                                                                              *
+*   SDL_ffmpeg is a library for basic multimedia functionality.                *
+*   SDL_ffmpeg is based on ffmpeg.                                             *
+*                                                                              *
+*   Copyright (C) 2007  Arjan Houben                                           *
+*                                                                              *
+*   SDL_ffmpeg is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU Lesser General Public License as published   *
+*	by the Free Software Foundation, either version 3 of the License, or any   *
+*   later version.                                                             *
+*                                                                              *
+*   This program is distributed in the hope that it will be useful,            *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the               *
+*   GNU Lesser General Public License for more details.                        *
+*                                                                              *
+*   You should have received a copy of the GNU Lesser General Public License   *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+*                                                                              *
+*******************************************************************************/
+
+
+#include "SDL_ffmpeg.h"
+
+#include <stdlib.h>
+
+int main( int argc, char** argv )
+{
+    /* check if we got enough arguments */
+    if ( argc < 4 )
+    {
+        printf( "usage: \"%s\" \"input\" \"output\" start [end]\n", argv[0] );
+        printf( "       start and end are given in milliseconds\n" );
+        return -1;
+    }
+
+    SDL_ffmpegFile *input = SDL_ffmpegOpen( argv[1] );
+    if ( !input )
+    {
+        printf( "error opening file\n" );
+        return -1;
+    }
+
+    SDL_ffmpegFile *output = SDL_ffmpegCreate( argv[2] );
+    if ( !output )
+    {
+        printf( "error creating file\n" );
+        SDL_ffmpegFree( input );
+        return -1;
+    }
+
+    /* copy the first video and audio stream, without decoding them */
+    if ( input->videoStreams && !SDL_ffmpegAddCopyStream( output, SDL_ffmpegGetVideoStream( input, 0 ) ) )
+    {
+        printf( "couldn't copy video stream: %s\n", SDL_ffmpegGetError() );
+    }
+
+    if ( input->audioStreams && !SDL_ffmpegAddCopyStream( output, SDL_ffmpegGetAudioStream( input, 0 ) ) )
+    {
+        printf( "couldn't copy audio stream: %s\n", SDL_ffmpegGetError() );
+    }
+
+    uint64_t start = strtoull( argv[3], 0, 10 );
+    uint64_t end = argc > 4 ? strtoull( argv[4], 0, 10 ) : 0;
+
+    /* the cut snaps to the keyframes around start and end */
+    if ( SDL_ffmpegRemux( output, input, start, end ) )
+    {
+        printf( "error cutting file: %s\n", SDL_ffmpegGetError() );
+    }
+
+    /* freeing the output writes its trailer */
+    SDL_ffmpegFree( output );
+
+    SDL_ffmpegFree( input );
+
+    /* the SDL_Quit function offcourse... */
+    SDL_Quit();
+
+    return 0;
+}
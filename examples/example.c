@@ -25,18 +25,14 @@
 
 #include <string.h>
 
-/* as an example we create an audio buffer consisting of BUF_SIZE frames */
-#define BUF_SIZE 10
+/* amount of audio which is decoded ahead, in bytes */
+#define BUF_SIZE 65536
 
 /* pointer to file we will be opening */
 SDL_ffmpegFile *file = 0;
 
-/* create a buffer for audio frames */
-SDL_ffmpegAudioFrame *audioFrame[BUF_SIZE];
-
 /* simple way of syncing, just for example purposes */
-uint64_t sync = 0,
-         offset = 0;
+uint64_t offset = 0;
 
 /* returns the current position the file should be at */
 uint64_t getSync()
@@ -45,7 +41,10 @@ uint64_t getSync()
     {
         if ( SDL_ffmpegValidAudio( file ) )
         {
-            return sync;
+            /* position of the audio which is played right now */
+            int64_t pos = SDL_ffmpegGetAudioPosition( file );
+
+            return pos > 0 ? pos : 0;
         }
         if ( SDL_ffmpegValidVideo( file ) )
         {
@@ -55,43 +54,6 @@ uint64_t getSync()
     return 0;
 }
 
-/* use a mutex to prevent errors due to multithreading */
-SDL_mutex *mutex = 0;
-
-void audioCallback( void *data, Uint8 *stream, int length )
-{
-    /* lock mutex, so audioFrame[0] will not be changed from another thread */
-    SDL_LockMutex( mutex );
-
-    if ( audioFrame[0]->size == length )
-    {
-        /* update sync */
-        sync = audioFrame[0]->pts;
-
-        /* copy the data to the output */
-        memcpy( stream, audioFrame[0]->buffer, audioFrame[0]->size );
-
-        /* mark data as used */
-        audioFrame[0]->size = 0;
-
-        /* move frames in buffer */
-        SDL_ffmpegAudioFrame *f = audioFrame[0];
-        int i;
-        for ( i = 1; i < BUF_SIZE; i++ ) audioFrame[i-1] = audioFrame[i];
-        audioFrame[BUF_SIZE-1] = f;
-    }
-    else
-    {
-        /* no data available, just set output to zero */
-        memset( stream, 0, length );
-    }
-
-    /* were done with the audio frame, release lock */
-    SDL_UnlockMutex( mutex );
-
-    return;
-}
-
 int main( int argc, char** argv )
 {
     /* check if we got an argument */
@@ -119,9 +81,6 @@ int main( int argc, char** argv )
         return -1;
     }
 
-    /* initialize the mutex */
-    mutex = SDL_CreateMutex();
-
     /* select the stream you want to decode (example just uses 0 as a default) */
     SDL_ffmpegSelectVideoStream( file, 0 );
 
@@ -142,9 +101,9 @@ int main( int argc, char** argv )
         printf( "Selected audio stream 0, frame rate: %.2f\n", SDL_ffmpegGetFrameRate( stream, 0, 0 ) );
     }
 
-    /* get the audiospec which fits the selected audiostream, if no audiostream
-       is selected, default values are used (2 channel, 48Khz) */
-    SDL_AudioSpec specs = SDL_ffmpegGetAudioSpec( file, 512, audioCallback );
+    /* get the audiospec which fits the selected audiostream, SDL_ffmpeg
+       provides a callback which plays the audio it decoded ahead */
+    SDL_AudioSpec specs = SDL_ffmpegGetAudioSpec( file, 512, SDL_ffmpegAudioCallback );
 
     /* we get the size from our active video stream, if no active video stream
        exists, width and height are set to zero */
@@ -192,25 +151,12 @@ int main( int argc, char** argv )
             return -1;
         }
 
-        /* calculate frame size ( 2 bytes per sample ) */
-        int frameSize = specs.channels * specs.samples * 2;
-
-        /* prepare audio buffer */
-        int i;
-        for ( i = 0; i < BUF_SIZE; i++ )
+        /* let SDL_ffmpeg decode audio in a separate thread */
+        if ( SDL_ffmpegSetAudioDecodeAhead( file, BUF_SIZE ) )
         {
-            /* create frame */
-            audioFrame[i] = SDL_ffmpegCreateAudioFrame( file, frameSize );
-
-            /* check if we got a frame */
-            if ( !audioFrame[i] )
-            {
-                /* no frame could be created, this is fatal */
-                goto CLEANUP_DATA;
-            }
-
-            /* fill frame with data */
-            SDL_ffmpegGetAudioFrame( file, audioFrame[i] );
+            /* no audio will be decoded, this is fatal */
+            fprintf( stderr, "could not decode audio ahead: %s\n", SDL_ffmpegGetError() );
+            goto CLEANUP_DATA;
         }
 
         /* we unpause the audio so our audiobuffer gets read */
@@ -317,51 +263,15 @@ int main( int argc, char** argv )
                in time, based on the x-position you clicked on */
             uint64_t time = ( uint64_t )((( double )x / ( double )w ) * SDL_ffmpegDuration( file ) );
 
-            /* lock mutex when working on data which is shared with the audiocallback */
-            SDL_LockMutex( mutex );
-
             /* invalidate current video frame */
             if ( videoFrame ) videoFrame->ready = 0;
 
-            /* invalidate buffered audio frames */
-            if ( SDL_ffmpegValidAudio( file ) )
-            {
-                int i;
-                for ( i = 0; i < BUF_SIZE; i++ )
-                {
-                    audioFrame[i]->size = 0;
-                }
-            }
-
-            /* we seek to time (milliseconds) */
+            /* we seek to time (milliseconds), this also discards the
+               audio which was decoded ahead */
             SDL_ffmpegSeek( file, time );
 
             /* store new offset */
             offset = time - ( getSync() - offset );
-
-            /* we release the mutex so the new data can be handled */
-            SDL_UnlockMutex( mutex );
-        }
-
-        /* check if we need to decode audio data */
-        if ( SDL_ffmpegValidAudio( file ) )
-        {
-            /* lock mutex when working on data which is shared with the audiocallback */
-            SDL_LockMutex( mutex );
-
-            /* fill empty spaces in audio buffer */
-            int i;
-            for ( i = 0; i < BUF_SIZE; i++ )
-            {
-                /* check if frame is empty */
-                if ( !audioFrame[i]->size )
-                {
-                    /* fill frame with new data */
-                    SDL_ffmpegGetAudioFrame( file, audioFrame[i] );
-                }
-            }
-
-            SDL_UnlockMutex( mutex );
         }
 
         if ( videoFrame )
@@ -401,15 +311,8 @@ CLEANUP_DATA:
     if ( SDL_ffmpegValidAudio( file ) )
     {
 
-        /* stop audio callback */
-        SDL_PauseAudio( 1 );
-
-        /* clean up frames */
-        int i;
-        for ( i = 0; i < BUF_SIZE; i++ )
-        {
-            SDL_ffmpegFreeAudioFrame( audioFrame[i] );
-        }
+        /* stop audio callback, it should not be called when the file is released */
+        SDL_CloseAudio();
     }
 
     /* cleanup video data */
@@ -421,6 +324,9 @@ CLEANUP_DATA:
     /* after all is said and done, we should call this */
     SDL_ffmpegFree( file );
 
+    /* stop the threads which converted pictures */
+    SDL_ffmpegQuit();
+
     /* the SDL_Quit function offcourse... */
     SDL_Quit();
 
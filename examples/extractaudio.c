@@ -47,29 +47,22 @@ int main( int argc, char** argv )
         return -1;
     }
 
-    /* create an audio frame to store data received from SDL_ffmpegGetAudioFrame */
-    SDL_ffmpegAudioFrame *frame = SDL_ffmpegCreateAudioFrame( audioFile, 32 );
-    if ( !frame )
+    FILE *f = fopen( "test.raw", "wb" );
+    if ( !f )
     {
         SDL_ffmpegFree( audioFile );
-        printf( "couldn't prepare frame buffer\n" );
+        printf( "couldn't open output file\n" );
         return -1;
     }
 
-    SDL_ffmpegGetAudioFrame( audioFile, frame );
-
-    FILE *f = fopen( "test.raw", "wb" );
-
-    while ( !frame->last )
+    /* decode all audio in large blocks, straight into the output file */
+    if ( SDL_ffmpegDrainAudioToFile( audioFile, f ) < 0 )
     {
-        fwrite( frame->buffer, 1, frame->size, f );
-        SDL_ffmpegGetAudioFrame( audioFile, frame );
+        printf( "error extracting audio: %s\n", SDL_ffmpegGetError() );
     }
 
     fclose( f );
 
-    SDL_ffmpegFreeAudioFrame( frame );
-
     /* when we are done with the file, we free it */
     SDL_ffmpegFree( audioFile );
 
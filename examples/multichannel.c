@@ -23,67 +23,18 @@
 #include "SDL.h"
 #include "SDL_ffmpeg.h"
 
+#include <stdlib.h>
 #include <string.h>
 
-/* as an example we create an audio buffer consisting of BUF_SIZE frames */
-#define BUF_SIZE 10
+/* amount of audio which is decoded ahead for every file, in bytes */
+#define BUF_SIZE 65536
 
 SDL_ffmpegFile *audioFile[10];
 
-SDL_ffmpegAudioFrame *audioFrame[10][BUF_SIZE];
-
-int playing[10];
-
-int16_t clamp( int a, int b )
-{
-    int c = a + b;
-    if ( c > 0x7FFF ) return 0x7FFF;
-    if ( c < -0x7FFF ) return -0x7FFF;
-    return c;
-}
-
-void audioCallback( void *udata, Uint8 *stream, int len )
-{
-
-    /* zero output data */
-    memset( stream, 0, len );
-
-    int f;
-    for ( f = 0; f < 10 && audioFile[f]; f++ )
-    {
-        if ( playing[f] )
-        {
-            if ( audioFrame[f][0]->size == len )
-            {
-                /* add audio data to output */
-                int16_t *dest = ( int16_t* )stream;
-                int16_t *src = ( int16_t* )audioFrame[f][0]->buffer;
-
-                int i = len / 2;
-                while ( i-- )
-                {
-                    *dest = clamp( *dest, *src );
-                    dest++;
-                    src++;
-                }
-
-                /* mark data as used */
-                audioFrame[f][0]->size = 0;
-
-                /* move frames in buffer */
-                SDL_ffmpegAudioFrame *frame = audioFrame[f][0];
-                for ( i = 1; i < BUF_SIZE; i++ ) audioFrame[f][i-1] = audioFrame[f][i];
-                audioFrame[f][BUF_SIZE-1] = frame;
-            }
-        }
-    }
-
-    return;
-}
+SDL_ffmpegMixerSource *source[10];
 
 int main( int argc, char** argv )
 {
-    SDL_AudioSpec specs;
     int i, f, done;
 
     /* check if we got an argument */
@@ -105,10 +56,17 @@ int main( int argc, char** argv )
 
     /* reset audiofile pointers */
     memset( audioFile, 0, sizeof( SDL_ffmpegFile* )*10 );
-    memset( audioFrame, 0, sizeof( SDL_ffmpegAudioFrame* )*10 );
-    memset( playing, 0, sizeof( int )*10 );
+    memset( source, 0, sizeof( SDL_ffmpegMixerSource* )*10 );
 
-    int getSpecs = 1;
+    /* all files are mixed to 48KHz stereo, whatever rate and amount of
+       channels they have */
+    SDL_ffmpegMixer *mixer = SDL_ffmpegCreateMixer( 48000, 2 );
+    if ( !mixer )
+    {
+        fprintf( stderr, "could not create mixer: %s\n", SDL_ffmpegGetError() );
+        SDL_Quit();
+        return -1;
+    }
 
     f = 0;
     for ( i = 1; i < argc && i < 10; i++ )
@@ -126,39 +84,25 @@ int main( int argc, char** argv )
         if ( SDL_ffmpegSelectAudioStream( audioFile[f], 0 ) )
         {
             SDL_ffmpegFree( audioFile[f] );
+            audioFile[f] = 0;
             printf( "error opening audiostream\n" );
             continue;
         }
 
-        if ( getSpecs )
+        /* the mixer lets SDL_ffmpeg decode audio of this file in a separate thread */
+        source[f] = SDL_ffmpegAddMixerSource( mixer, audioFile[f], BUF_SIZE );
+        if ( !source[f] )
         {
-            /* get the audiospec which fits the selected audiostream */
-            specs = SDL_ffmpegGetAudioSpec( audioFile[f], 512, audioCallback );
-            getSpecs = 0;
+            printf( "error adding file to mixer: %s\n", SDL_ffmpegGetError() );
+            SDL_ffmpegFree( audioFile[f] );
+            audioFile[f] = 0;
+            continue;
         }
 
-        /* calculate frame size ( 2 bytes per sample ) */
-        int frameSize = specs.channels * specs.samples * 2;
+        /* while its key is held, a file starts over without a gap */
+        SDL_ffmpegSetAudioLoop( audioFile[f], 1 );
 
-        /* prepare audio buffer */
-        int i;
-        for ( i = 0; i < BUF_SIZE; i++ )
-        {
-            /* create frame */
-            audioFrame[f][i] = SDL_ffmpegCreateAudioFrame( audioFile[f], frameSize );
-
-            /* check if we got a frame */
-            if ( !audioFrame[f][i] )
-            {
-                /* no frame could be created, this is fatal */
-                goto CLEANUP_DATA;
-            }
-
-            /* fill frame with data */
-            SDL_ffmpegGetAudioFrame( audioFile[f], audioFrame[f][i] );
-        }
-
-        printf( "added \"%s\" at key %i\n", argv[i], i );
+        printf( "added \"%s\" at key %i\n", argv[i], f + 1 );
 
         f++;
     }
@@ -166,6 +110,15 @@ int main( int argc, char** argv )
     /* check if at least one file could be opened */
     if ( !audioFile[0] ) goto CLEANUP_DATA;
 
+    /* spread the files from left to right */
+    for ( i = 0; i < f; i++ )
+    {
+        SDL_ffmpegSetMixerSourceGain( source[i], 1.0f, f > 1 ? -1.0f + 2.0f * i / ( f - 1 ) : 0.0f );
+    }
+
+    /* the mixer provides an audiospec with its own callback */
+    SDL_AudioSpec specs = SDL_ffmpegGetMixerAudioSpec( mixer, 512 );
+
     /* Open the Audio device */
     if ( SDL_OpenAudio( &specs, 0 ) < 0 )
     {
@@ -193,50 +146,24 @@ int main( int argc, char** argv )
             {
                 /* check al files, and play if needed */
                 int f;
-                for ( f = 0; audioFile[f]; f++ )
+                for ( f = 0; f < 10 && audioFile[f]; f++ )
                 {
                     if ( event.key.keysym.sym == SDLK_1 + f )
                     {
-                        playing[f] = 1;
+                        SDL_ffmpegPlayMixerSource( source[f] );
                     }
                 }
             }
             else if ( event.type == SDL_KEYUP )
             {
-                /* check al files, and play if needed */
+                /* check al files, and stop if needed */
                 int f;
-                for ( f = 0; audioFile[f]; f++ )
+                for ( f = 0; f < 10 && audioFile[f]; f++ )
                 {
                     if ( event.key.keysym.sym == SDLK_1 + f )
                     {
-                        playing[f] = 0;
-                        /* invalidate buffer */
-                        int i;
-                        for ( i = 0; i < BUF_SIZE; i++ )
-                        {
-                            audioFrame[f][i]->size = 0;
-                        }
-                        SDL_ffmpegSeek( audioFile[f], 0 );
-                    }
-                }
-            }
-        }
-
-        int f;
-        for ( f = 0; f < 10 && audioFile[f]; f++ )
-        {
-            /* update audio buffer */
-            int i;
-            for ( i = 0; i < BUF_SIZE; i++ )
-            {
-                /* check if frame is empty */
-                if ( !audioFrame[f][i]->size )
-                {
-                    /* fill frame with data */
-                    SDL_ffmpegGetAudioFrame( audioFile[f], audioFrame[f][i] );
-                    if ( audioFrame[f][i]->last )
-                    {
-                        SDL_ffmpegSeek( audioFile[f], 0 );
+                        /* stopping also returns to the start of the file */
+                        SDL_ffmpegStopMixerSource( source[f] );
                     }
                 }
             }
@@ -248,18 +175,15 @@ int main( int argc, char** argv )
 
 CLEANUP_DATA:
 
-    /* stop audio callback */
-    SDL_PauseAudio( 1 );
+    /* stop audio callback, it should not be called when the mixer is released */
+    SDL_CloseAudio();
 
-    /* free all frames / files */
-    for ( f = 0; audioFile[f]; f++ )
-    {
-        int i;
-        for ( i = 0; i < BUF_SIZE; i++ )
-        {
-            SDL_ffmpegFreeAudioFrame( audioFrame[f][i] );
-        }
+    /* releasing the mixer removes all sources */
+    SDL_ffmpegFreeMixer( mixer );
 
+    /* free all files */
+    for ( f = 0; f < 10 && audioFile[f]; f++ )
+    {
         SDL_ffmpegFree( audioFile[f] );
     }
 
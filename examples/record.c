@@ -51,6 +51,9 @@ int main( int argc, char** argv )
     /* select videostream we just created */
     SDL_ffmpegSelectVideoStream( file, 0 );
 
+    /* encode in a separate thread, so adding a frame only copies it */
+    SDL_ffmpegSetVideoEncodeAhead( file, 8 );
+
     /* standard SDL initialization stuff */
     if ( SDL_Init( SDL_INIT_AUDIO | SDL_INIT_VIDEO | SDL_INIT_TIMER ) < 0 )
     {
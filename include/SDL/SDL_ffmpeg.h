@@ -49,16 +49,67 @@ enum SDL_ffmpegStreamType
 
 typedef void (*SDL_ffmpegCallback)(void *userdata, Uint8 *stream, int len);
 
+/** Receives decoded audio from SDL_ffmpegDrainAudio, returns 0 to continue */
+typedef int (*SDL_ffmpegAudioSink)(void *userdata, const uint8_t *data, uint32_t size, int64_t pts);
+
+/** Use as thread count to run as many codec threads as there are cores */
+#define SDL_FFMPEG_AUTO_THREADS -1
+
+/** Ways in which a codec can divide its work between threads */
+enum SDL_ffmpegThreadType
+{
+    /** let the codec decide */
+    SDL_ffmpegThreadDefault = 0,
+    /** decode multiple frames at once, adds a frame of delay per thread */
+    SDL_ffmpegThreadFrame = 1,
+    /** decode multiple parts of a single frame at once */
+    SDL_ffmpegThreadSlice = 2
+};
+
 typedef struct SDL_ffmpegConversionContext
 {
     int inWidth, inHeight, inFormat,
     outWidth, outHeight, outFormat;
 
+    /** band of the picture converted by this context, 0 when converting whole pictures */
+    int slice;
+
     struct SwsContext *context;
 
+    /** hash of the sizes, formats and band above */
+    uint32_t hash;
+
+    /** next context in the same hash bucket */
     struct SDL_ffmpegConversionContext *next;
+
+    /** neighbours in order of use, newer is used more recently */
+    struct SDL_ffmpegConversionContext *newer, *older;
 } SDL_ffmpegConversionContext;
 
+/** amount of hash buckets in a SDL_ffmpegConversionCache */
+#define SDL_FFMPEG_CONVERSION_BUCKETS 16
+
+/** Keeps the most recently used conversion contexts of a stream */
+typedef struct
+{
+    /** contexts, hashed by size and format */
+    SDL_ffmpegConversionContext *buckets[ SDL_FFMPEG_CONVERSION_BUCKETS ];
+    /** most recently used context */
+    SDL_ffmpegConversionContext *newest,
+    /** least recently used context, evicted first */
+                                *oldest;
+    /** amount of contexts in cache */
+    uint32_t count;
+    /** maximum amount of contexts in cache, for every band */
+    uint32_t limit;
+    /** amount of bands pictures are currently converted in */
+    uint32_t slices;
+    /** amount of lookups which found a context */
+    uint64_t hits;
+    /** amount of lookups which had to create a context */
+    uint64_t misses;
+} SDL_ffmpegConversionCache;
+
 /** Struct to hold codec values */
 typedef struct
 {
@@ -90,6 +141,10 @@ typedef struct
     int32_t audioMinRate;
     /** when variable bitrate is desired, this holds the maximal audio bitrate */
     int32_t audiooMaxRate;
+    /** amount of encoder threads, SDL_FFMPEG_AUTO_THREADS uses all cores */
+    int32_t threadCount;
+    /** SDL_ffmpegThreadType used by the encoder */
+    int32_t threadType;
 } SDL_ffmpegCodec;
 
 /** predefined codec for PAL DVD */
@@ -104,9 +159,144 @@ EXPORT extern const SDL_ffmpegCodec SDL_ffmpegCodecAUTO;
 /** Struct to hold packet buffers */
 typedef struct SDL_ffmpegPacket {
     struct AVPacket *data;
+    /** size of the payload buffer of data owned by the pool, excluding padding,
+        0 when the payload came from the demuxer and is released with data */
+    int capacity;
+    /** pool to which this packet is returned when it is no longer used */
+    struct SDL_ffmpegPacketPool *pool;
+    /** decoding time in AV_TIME_BASE units, orders packets waiting to be muxed */
+    int64_t time;
+    /** next packet in the free list of pool */
     struct SDL_ffmpegPacket *next;
 } SDL_ffmpegPacket;
 
+/** Free list of packets, so packets and their payload can be recycled,
+    payloads of the demuxer are not recycled, only the packet holding them */
+typedef struct SDL_ffmpegPacketPool
+{
+    /** packets ready to be reused */
+    SDL_ffmpegPacket *free;
+    /** amount of packets in the free list */
+    uint32_t count;
+    /** running average of the payload size of packets queued for muxing,
+        demuxed payloads are not pooled and do not count */
+    uint32_t averageSize;
+    /** mutex for multi threaded acces to the pool */
+    SDL_mutex *mutex;
+} SDL_ffmpegPacketPool;
+
+/** Behaviour of a packet queue which reached one of its limits */
+enum SDL_ffmpegQueuePolicy
+{
+    /** stop reading until packets are taken from the queue */
+    SDL_ffmpegQueueBlock = 0,
+    /** drop the oldest packets to make room for new ones */
+    SDL_ffmpegQueueDrop
+};
+
+/** Quality of audio resampling, higher quality takes more time */
+enum SDL_ffmpegResampleQuality
+{
+    /** short filter with interpolated phases */
+    SDL_ffmpegResampleFast = 0,
+    /** the default filter of ffmpeg */
+    SDL_ffmpegResampleNormal,
+    /** long filter with a high cutoff frequency */
+    SDL_ffmpegResampleHigh
+};
+
+/** Maximum amount of channels audio can be remixed from or to */
+#define SDL_FFMPEG_MAX_CHANNELS 8
+
+/** SDL 1.2 has no float samples, this format hands out 32 bit floats in the
+    range -1 to 1, in system byte order. The value matches AUDIO_F32SYS of
+    later SDL versions, it can not be played by an SDL 1.2 audio device */
+#ifdef AUDIO_F32SYS
+#define SDL_FFMPEG_AUDIO_F32SYS AUDIO_F32SYS
+#elif SDL_BYTEORDER == SDL_LIL_ENDIAN
+#define SDL_FFMPEG_AUDIO_F32SYS 0x8120
+#else
+#define SDL_FFMPEG_AUDIO_F32SYS 0x9120
+#endif
+
+/** Order of the samples in a SDL_ffmpegAudioFrame */
+enum SDL_ffmpegAudioLayout
+{
+    /** samples of all channels alternate, as SDL expects them */
+    SDL_ffmpegAudioInterleaved = 0,
+    /** all samples of the first channel, followed by all samples of the next channel */
+    SDL_ffmpegAudioPlanar
+};
+
+/** Format in which decoded audio is handed to the user, a value of 0 keeps
+    the property of the audio stream */
+typedef struct
+{
+    /** Samples per second */
+    int rate;
+    /** Amount of channels */
+    int channels;
+    /** SDL audio format of the samples */
+    uint16_t format;
+    /** Quality used when the rate differs from the audio stream */
+    enum SDL_ffmpegResampleQuality quality;
+    /** Order of the samples in frames returned by SDL_ffmpegGetAudioFrame */
+    enum SDL_ffmpegAudioLayout layout;
+} SDL_ffmpegAudioOutput;
+
+/** State of the conversion from decoded audio to SDL_ffmpegAudioOutput */
+typedef struct
+{
+    /** Properties of the decoded audio for which this state was set up */
+    int inRate, inChannels;
+    /** Properties of the converted audio */
+    int outRate, outChannels;
+    enum SDL_ffmpegResampleQuality quality;
+    /** Weight of every input channel in every output channel, 1 << 14 is unity */
+    int matrix[ SDL_FFMPEG_MAX_CHANNELS ][ SDL_FFMPEG_MAX_CHANNELS ];
+    /** Receives audio from the decoder before it is converted */
+    int16_t *decoded;
+    /** Remixed audio per channel, waiting to be resampled */
+    int16_t *planes[ SDL_FFMPEG_MAX_CHANNELS ];
+    /** Resampled audio per channel */
+    int16_t *resampled[ SDL_FFMPEG_MAX_CHANNELS ];
+    /** Size of every plane and every resampled buffer, in samples */
+    int planeSize, resampledSize;
+    /** Amount of samples in planes which were not consumed by the resampler */
+    int history;
+    /** Resampler, only used when the rates differ */
+    struct AVResampleContext *resampler;
+    /** Receives a frame while it is reordered to SDL_ffmpegAudioPlanar */
+    uint8_t *layoutBuffer;
+    /** Size of layoutBuffer in bytes */
+    int layoutBufferSize;
+} SDL_ffmpegAudioConverter;
+
+/** Ring buffer holding packets which are waiting to be decoded */
+typedef struct SDL_ffmpegPacketQueue
+{
+    /** ring of packets, size is always a power of two */
+    SDL_ffmpegPacket **packets;
+    /** size of the ring */
+    uint32_t size;
+    /** index of the first packet, wraps around size */
+    uint32_t head;
+    /** index at which the next packet will be stored, wraps around size */
+    uint32_t tail;
+    /** total size of the queued packets in bytes */
+    uint64_t bytes;
+    /** total duration of the queued packets in milliseconds */
+    int64_t duration;
+    /** maximum amount of packets, 0 means no limit */
+    uint32_t maxPackets;
+    /** maximum size of the queued packets in bytes, 0 means no limit */
+    uint64_t maxBytes;
+    /** maximum duration of the queued packets in milliseconds, 0 means no limit */
+    int64_t maxDuration;
+    /** what to do when one of the limits is reached */
+    enum SDL_ffmpegQueuePolicy policy;
+} SDL_ffmpegPacketQueue;
+
 /** Struct to hold audio data */
 typedef struct
 {
@@ -136,8 +326,115 @@ typedef struct
     int ready;
 	/** Value indicating wheter or not this is the last frame before EOF */
 	int last;
+    /** Planes of the decoded picture, only set when neither surface nor overlay
+        is set. These point to memory owned by SDL_ffmpeg and stay valid until
+        the next call to SDL_ffmpegGetVideoFrame or SDL_ffmpegReleaseVideoFrame. */
+    uint8_t *data[ 4 ];
+    /** Size in bytes of a line of every plane in data */
+    int linesize[ 4 ];
+    /** Size of the picture in data */
+    int width, height;
+    /** PixelFormat of the picture in data */
+    int format;
 } SDL_ffmpegVideoFrame;
 
+/** Growable FIFO holding decoded audio, data is kept contiguous so the
+    decoder can append to it and the user can be served with a single copy */
+typedef struct
+{
+    /** Storage for audio data */
+    uint8_t *buffer;
+    /** Size of buffer in bytes */
+    int capacity;
+    /** Position of the first byte of valid data in buffer */
+    int offset;
+    /** Amount of valid data in buffer */
+    int size;
+    /** Timestamp in milliseconds of the first sample after a flush */
+    int64_t pts;
+    /** Amount of bytes which was read from the FIFO since pts was set */
+    uint64_t consumed;
+    /** Amount of bytes which is dropped before data is read, so data starts at pts */
+    uint64_t skip;
+    /** Amount of bytes used for a second of audio in buffer */
+    int bytesPerSecond;
+} SDL_ffmpegAudioFifo;
+
+/** Struct to hold a decoded video frame which is waiting to be used */
+typedef struct
+{
+    /** Decoded picture, in the pixel format of the codec */
+    struct AVPicture *picture;
+    /** Size and pixel format for which picture was allocated */
+    int width, height, format;
+    /** Presentation timestamp of this frame */
+    int64_t pts;
+    /** Value indicating wheter or not this is the last frame before EOF */
+    int last;
+} SDL_ffmpegDecodedFrame;
+
+/** Video frame waiting to be encoded by the encode thread of a file */
+typedef struct
+{
+    /** Copy of the pixels of the frame */
+    uint8_t *pixels;
+    /** Size of pixels in bytes */
+    int capacity;
+    /** Surface handed over by SDL_ffmpegAddVideoSurface, used instead of pixels */
+    SDL_Surface *surface;
+    /** Size and pixel format of the frame */
+    int width, height, format;
+    /** Size of a line of every plane in bytes, 0 for planes which are not used,
+        conversion reads four planes */
+    int pitch[ 4 ];
+    /** Position of every plane in pixels, or in the pixels of surface */
+    int offset[ 4 ];
+} SDL_ffmpegEncodeSlot;
+
+/** Amount of timestamps an SDL_ffmpegAudioRing remembers */
+#define SDL_FFMPEG_AUDIO_TIMES 8
+
+/** Timestamp of the audio in an SDL_ffmpegAudioRing from a byte position on */
+typedef struct
+{
+    /** Byte position at which the audio with timestamp pts starts */
+    uint32_t position;
+    /** Timestamp in milliseconds of the data at position */
+    int64_t pts;
+    /** Amount of bytes used for a second of audio */
+    uint32_t bytesPerSecond;
+    /** File from which the audio was decoded */
+    struct SDL_ffmpegFile *file;
+} SDL_ffmpegAudioTime;
+
+/** Ring buffer holding decoded audio, written by a single decode thread and
+    read by a single audio callback without locking */
+typedef struct
+{
+    /** Storage for audio data, size is a power of two */
+    uint8_t *buffer;
+    /** Size of buffer in bytes */
+    uint32_t size;
+    /** Total amount of bytes written, only changed by the decode thread */
+    volatile uint32_t head;
+    /** Total amount of bytes read, only changed by the audio callback */
+    volatile uint32_t tail;
+    /** Value of head at the last flush, data before it is skipped */
+    volatile uint32_t flushPosition;
+    /** Incremented on every flush */
+    volatile uint32_t flushRequest;
+    /** Last value of flushRequest handled by the audio callback */
+    uint32_t flushSeen;
+    /** Odd while the timing below is being changed */
+    volatile uint32_t timeSequence;
+    /** Timestamps at every discontinuity, stored at timeCount modulo SDL_FFMPEG_AUDIO_TIMES */
+    SDL_ffmpegAudioTime times[ SDL_FFMPEG_AUDIO_TIMES ];
+    /** Total amount of timestamps which were stored */
+    volatile uint32_t timeCount;
+    /** Set when the last data of the stream was written */
+    volatile int last;
+} SDL_ffmpegAudioRing;
+
 /** This is the basic stream for SDL_ffmpeg */
 typedef struct SDL_ffmpegStream
 {
@@ -148,8 +445,8 @@ typedef struct SDL_ffmpegStream
     struct AVFrame *decodeFrame;
     /** Intermediate frame which will be used when encoding */
     struct AVFrame *encodeFrame;
-    /** Store conversion context for this stream */
-    struct SDL_ffmpegConversionContext *conversionContext;
+    /** Store conversion contexts for this stream */
+    SDL_ffmpegConversionCache conversionCache;
 
     int encodeFrameBufferSize;
     uint8_t *encodeFrameBuffer;
@@ -157,19 +454,42 @@ typedef struct SDL_ffmpegStream
     int encodeAudioInputSize;
     uint64_t frameCount;
 
-    /** buffer for decoded audio data */
-    int8_t *sampleBuffer;
-    /** amount of data in samplebuffer */
-    int sampleBufferSize;
-    /** position of data in samplebuffer */
-    int sampleBufferOffset;
-    /** timestamp which fits the data in samplebuffer */
-    int64_t sampleBufferTime;
+    /** samples per channel which were handed to the audio encoder */
+    uint64_t encodeAudioSamples;
+
+    /** input stream of which the packets are copied into this output stream */
+    struct SDL_ffmpegStream *copySource;
+
+    /** amount of encoded packets of this stream waiting to be muxed */
+    uint32_t muxCount;
+    /** latest time of the packets which were queued for muxing, later packets
+        of this stream are never ordered before it, AV_NOPTS_VALUE initially */
+    int64_t muxTime;
+
+    /** buffer receiving encoded audio data */
+    uint8_t *encodeAudioBuffer;
+    /** size of encodeAudioBuffer in bytes */
+    int encodeAudioBufferSize;
+
+    /** decoded audio which was not yet handed to the user, or for output
+        streams, audio which does not yet fill a complete encoder frame */
+    SDL_ffmpegAudioFifo audioFifo;
+    /** converts decoded audio to the output format of the file */
+    SDL_ffmpegAudioConverter audioConverter;
 
     /** packet buffer */
-    SDL_ffmpegPacket *buffer;
+    SDL_ffmpegPacketQueue buffer;
     /** mutex for multi threaded acces to buffer */
     SDL_mutex *mutex;
+    /** signaled when the reader thread added packets to buffer */
+    SDL_cond *bufferCond;
+
+    /** amount of codec threads, SDL_FFMPEG_AUTO_THREADS uses all cores */
+    int threadCount;
+    /** SDL_ffmpegThreadType used by the codec */
+    int threadType;
+    /** amount of bands converted in parallel, SDL_FFMPEG_AUTO_THREADS uses all cores */
+    int conversionThreads;
 
     /** Id of the stream */
     int id;
@@ -182,7 +502,7 @@ typedef struct SDL_ffmpegStream
 } SDL_ffmpegStream;
 
 /** Struct to hold information about file */
-typedef struct
+typedef struct SDL_ffmpegFile
 {
     /** type of file */
     enum SDL_ffmpegStreamType type;
@@ -210,8 +530,172 @@ typedef struct
 
     /** Holds the lowest timestamp which will be decoded */
     int64_t             minimalTimestamp;
+
+    /** Format to which decoded audio is converted */
+    SDL_ffmpegAudioOutput audioOutput;
+
+    /** Thread reading packets from file, NULL if packets are read on demand */
+    SDL_Thread          *readThread;
+    /** mutex which keeps seeking and reading apart while readThread is active */
+    SDL_mutex           *readMutex;
+    /** signaled when packets were taken from a stream buffer */
+    SDL_cond            *readCond;
+    /** set to signal readThread it should stop */
+    int                 stopReading;
+    /** set by readThread when the end of file was reached */
+    int                 endOfFile;
+    /** incremented when streams are flushed or changed, tells a thread which
+        waited for packets that its decoding state is no longer valid */
+    uint32_t            streamGeneration;
+
+    /** recycles packets read from file */
+    SDL_ffmpegPacketPool packetPool;
+
+    /** Thread decoding video frames ahead, NULL if frames are decoded on request */
+    SDL_Thread          *decodeThread;
+    /** Video frames decoded ahead, sorted by pts */
+    SDL_ffmpegDecodedFrame *frames;
+    /** Amount of frames which can be decoded ahead */
+    uint32_t            frameCapacity,
+    /** Amount of frames ready to be used */
+                        frameCount;
+    /** mutex for multi threaded acces to frames */
+    SDL_mutex           *frameMutex;
+    /** signaled when a frame was used, or a new frame was decoded */
+    SDL_cond            *frameCond;
+    /** set to signal decodeThread it should stop */
+    int                 stopDecoding;
+    /** set by decodeThread when the last frame of the video stream was decoded */
+    int                 decodeEnd;
+
+    /** Thread decoding audio into audioRing, NULL if audio is decoded on request */
+    SDL_Thread          *audioThread;
+    /** Decoded audio of the selected audio stream, read by SDL_ffmpegAudioCallback */
+    SDL_ffmpegAudioRing audioRing;
+    /** signaled when decoded audio was invalidated, or audioThread should stop */
+    SDL_cond            *audioCond;
+    /** incremented when decoded audio was invalidated */
+    uint32_t            audioGeneration;
+    /** set to signal audioThread it should stop */
+    int                 stopAudio;
+    /** File from which audioThread decodes, this file or a file queued after it */
+    struct SDL_ffmpegFile *audioSource;
+    /** File of which the audio follows the audio of this file */
+    struct SDL_ffmpegFile *nextAudioFile;
+    /** set when audioSource starts over at its end, unless a file is queued */
+    int                 audioLoop;
+
+    /** Thread encoding added video frames, NULL if frames are encoded when added */
+    SDL_Thread          *encodeThread;
+    /** Ring of video frames waiting to be encoded */
+    SDL_ffmpegEncodeSlot *encodeSlots;
+    /** Size of encodeSlots */
+    uint32_t            encodeCapacity,
+    /** Index of the frame which is encoded next */
+                        encodeHead,
+    /** Amount of frames which are queued or being encoded */
+                        encodeCount;
+    /** mutex for multi threaded acces to encodeSlots */
+    SDL_mutex           *encodeMutex;
+    /** signaled when a frame was queued, or a frame was encoded */
+    SDL_cond            *encodeCond;
+    /** set to signal encodeThread it should stop once the queue is empty */
+    int                 stopEncoding;
+    /** set when a frame which was encoded ahead could not be encoded,
+        until this is reported by the next call adding or flushing frames */
+    int                 encodeFailed;
+    /** error of the first frame which could not be encoded ahead */
+    char                encodeError[ 512 ];
+
+    /** Encoded packets of all streams waiting to be written, in decoding order */
+    SDL_ffmpegPacket    *muxQueue,
+    /** Last packet of muxQueue */
+                        *muxTail;
+    /** total size of the packets in muxQueue in bytes */
+    uint64_t            muxBytes;
+    /** muxQueue is written out beyond this size in bytes, zero for no limit */
+    uint64_t            muxByteLimit;
+    /** muxQueue is written out beyond this span in milliseconds, zero for no limit */
+    uint32_t            muxDurationLimit;
 } SDL_ffmpegFile;
 
+/** Audio source of an SDL_ffmpegMixer */
+typedef struct SDL_ffmpegMixerSource
+{
+    /** File from which audio is played, not owned by the mixer */
+    SDL_ffmpegFile *file;
+    /** Gain of the left and right channel, 1 << 14 is unity */
+    volatile int gainLeft, gainRight;
+    /** Set while the source is audible, cleared when all audio was played */
+    volatile int playing;
+    /** Next source of the mixer */
+    struct SDL_ffmpegMixerSource *next;
+} SDL_ffmpegMixerSource;
+
+/** Mixes the audio of any amount of files into a single output */
+typedef struct
+{
+    /** Format of the mixed audio, samples are AUDIO_S16SYS */
+    int rate, channels;
+    /** Sources which are mixed, only changed while mutex is locked */
+    SDL_ffmpegMixerSource *sources;
+    /** Zero terminated copy of sources used by the callback, replaced as a
+        whole when sources change, so the callback needs no lock */
+    SDL_ffmpegMixerSource **volatile active;
+    /** Incremented when the callback starts and when it ends, odd while it mixes */
+    volatile uint32_t mixCount;
+    /** Serializes changes to sources */
+    SDL_mutex *mutex;
+    /** Receives the audio of a single source before it is mixed */
+    int16_t *buffer;
+    /** Size of buffer in bytes */
+    int bufferSize;
+} SDL_ffmpegMixer;
+
+/** Struct to hold information about a stream, filled without opening its codec */
+typedef struct
+{
+    /** Id of the stream */
+    int id;
+    /** ffmpeg codec id of the stream */
+    int codecID;
+    /** name of the decoder for this stream */
+    char codecName[ 32 ];
+    /** bitrate of the stream in bits per second, 0 if unknown */
+    int bitRate;
+    /** duration of the stream in milliseconds, 0 if unknown */
+    uint64_t duration;
+    /** size of the frames in a video stream */
+    int width, height;
+    /** numinator part of the framerate of a video stream */
+    int frameRateNum;
+    /** denominator part of the framerate of a video stream */
+    int frameRateDen;
+    /** samplerate of an audio stream */
+    int sampleRate;
+    /** number of channels in an audio stream */
+    int channels;
+} SDL_ffmpegStreamInfo;
+
+/** Struct to hold information about a file, see SDL_ffmpegGetFileInfo */
+typedef struct
+{
+    /** short name of the container format */
+    char format[ 32 ];
+    /** duration of the file in milliseconds, 0 if unknown */
+    uint64_t duration;
+    /** total bitrate of the file in bits per second, 0 if unknown */
+    int bitRate;
+    /** Amount of video streams in file */
+    uint32_t videoStreams,
+    /** Amount of audio streams in file */
+             audioStreams;
+    /** Information about the video streams */
+    SDL_ffmpegStreamInfo *video,
+    /** Information about the audio streams */
+                         *audio;
+} SDL_ffmpegFileInfo;
+
 /* error handling */
 EXPORT const char* SDL_ffmpegGetError();
 
@@ -220,10 +704,18 @@ EXPORT void SDL_ffmpegClearError();
 /* SDL_ffmpegFile create / destroy */
 EXPORT SDL_ffmpegFile* SDL_ffmpegOpen( const char* filename );
 
+EXPORT SDL_ffmpegFile* SDL_ffmpegOpenThreaded( const char* filename );
+
+EXPORT SDL_ffmpegFileInfo* SDL_ffmpegGetFileInfo( const char *filename, uint32_t probeSize, uint32_t analyzeDuration );
+
+EXPORT void SDL_ffmpegFreeFileInfo( SDL_ffmpegFileInfo *info );
+
 EXPORT SDL_ffmpegFile* SDL_ffmpegCreate( const char* filename );
 
 EXPORT void SDL_ffmpegFree( SDL_ffmpegFile* file );
 
+EXPORT void SDL_ffmpegQuit();
+
 /* general */
 EXPORT int SDL_ffmpegSeek( SDL_ffmpegFile* file, uint64_t timestamp );
 
@@ -235,6 +727,16 @@ EXPORT int64_t SDL_ffmpegGetPosition( SDL_ffmpegFile *file );
 
 EXPORT float SDL_ffmpegGetFrameRate( SDL_ffmpegStream *stream, int *numerator, int *denominator );
 
+EXPORT int SDL_ffmpegSetCodecThreads( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, int threads, enum SDL_ffmpegThreadType type );
+
+EXPORT int SDL_ffmpegSetConversionThreads( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, int threads );
+
+EXPORT int SDL_ffmpegSetConversionCacheSize( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, uint32_t size );
+
+EXPORT int SDL_ffmpegGetConversionCacheStats( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, uint64_t *hits, uint64_t *misses );
+
+EXPORT int SDL_ffmpegSetPacketQueueLimits( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, uint32_t packets, uint64_t bytes, int64_t milliseconds, enum SDL_ffmpegQueuePolicy policy );
+
 /* video stream */
 EXPORT SDL_ffmpegStream* SDL_ffmpegAddVideoStream( SDL_ffmpegFile *file, SDL_ffmpegCodec );
 
@@ -242,13 +744,29 @@ EXPORT SDL_ffmpegStream* SDL_ffmpegGetVideoStream( SDL_ffmpegFile *file, uint32_
 
 EXPORT int SDL_ffmpegSelectVideoStream( SDL_ffmpegFile* file, int videoID);
 
+EXPORT int SDL_ffmpegSetVideoDecodeAhead( SDL_ffmpegFile *file, uint32_t frames );
+
 /* video frame */
 EXPORT SDL_ffmpegVideoFrame* SDL_ffmpegCreateVideoFrame();
 
 EXPORT int SDL_ffmpegAddVideoFrame( SDL_ffmpegFile *file, SDL_Surface *frame );
 
+EXPORT int SDL_ffmpegAddVideoSurface( SDL_ffmpegFile *file, SDL_Surface *frame );
+
+EXPORT int SDL_ffmpegAddVideoPlanes( SDL_ffmpegFile *file, const uint8_t *const planes[ 3 ], const int pitches[ 3 ], int width, int height );
+
+EXPORT int SDL_ffmpegAddVideoOverlay( SDL_ffmpegFile *file, SDL_Overlay *overlay );
+
+EXPORT int SDL_ffmpegSetVideoEncodeAhead( SDL_ffmpegFile *file, uint32_t frames );
+
+EXPORT int SDL_ffmpegFlushVideoEncoder( SDL_ffmpegFile *file );
+
+EXPORT int SDL_ffmpegSetInterleaveLimits( SDL_ffmpegFile *file, uint64_t bytes, uint32_t milliseconds );
+
 EXPORT int SDL_ffmpegGetVideoFrame( SDL_ffmpegFile *file, SDL_ffmpegVideoFrame *frame );
 
+EXPORT void SDL_ffmpegReleaseVideoFrame( SDL_ffmpegFile *file, SDL_ffmpegVideoFrame *frame );
+
 EXPORT void SDL_ffmpegFreeVideoFrame( SDL_ffmpegVideoFrame* frame );
 
 /* video specs */
@@ -267,6 +785,10 @@ EXPORT SDL_ffmpegStream* SDL_ffmpegGetAudioStream( SDL_ffmpegFile *file, uint32_
 
 EXPORT int SDL_ffmpegSelectAudioStream( SDL_ffmpegFile* file, int audioID);
 
+EXPORT SDL_ffmpegStream* SDL_ffmpegAddCopyStream( SDL_ffmpegFile *file, SDL_ffmpegStream *source );
+
+EXPORT int SDL_ffmpegRemux( SDL_ffmpegFile *file, SDL_ffmpegFile *input, uint64_t start, uint64_t end );
+
 /* audio frame */
 EXPORT SDL_ffmpegAudioFrame* SDL_ffmpegCreateAudioFrame( SDL_ffmpegFile *file, uint32_t bytes );
 
@@ -276,9 +798,52 @@ EXPORT int SDL_ffmpegGetAudioFrame( SDL_ffmpegFile *file, SDL_ffmpegAudioFrame *
 
 EXPORT void SDL_ffmpegFreeAudioFrame( SDL_ffmpegAudioFrame* frame );
 
+/* audio decoded ahead */
+EXPORT int SDL_ffmpegSetAudioDecodeAhead( SDL_ffmpegFile *file, uint32_t bytes );
+
+EXPORT void SDL_ffmpegAudioCallback( void *userdata, Uint8 *stream, int length );
+
+EXPORT int64_t SDL_ffmpegGetAudioPosition( SDL_ffmpegFile *file );
+
+EXPORT int SDL_ffmpegAudioEnded( SDL_ffmpegFile *file );
+
+EXPORT int SDL_ffmpegSetAudioLoop( SDL_ffmpegFile *file, int loop );
+
+EXPORT int SDL_ffmpegQueueAudioFile( SDL_ffmpegFile *file, SDL_ffmpegFile *next );
+
+EXPORT SDL_ffmpegFile* SDL_ffmpegGetPlayingFile( SDL_ffmpegFile *file );
+
+/* audio extraction */
+EXPORT int64_t SDL_ffmpegDrainAudio( SDL_ffmpegFile *file, SDL_ffmpegAudioSink sink, void *userdata );
+
+EXPORT int64_t SDL_ffmpegDrainAudioToFile( SDL_ffmpegFile *file, FILE *output );
+
 /* audio specs */
 EXPORT SDL_AudioSpec SDL_ffmpegGetAudioSpec( SDL_ffmpegFile *file, uint16_t samples, SDL_ffmpegCallback callback );
 
+EXPORT int SDL_ffmpegSetAudioOutput( SDL_ffmpegFile *file, int rate, int channels, uint16_t format, enum SDL_ffmpegResampleQuality quality );
+
+EXPORT int SDL_ffmpegSetAudioLayout( SDL_ffmpegFile *file, enum SDL_ffmpegAudioLayout layout );
+
+/* audio mixer */
+EXPORT SDL_ffmpegMixer* SDL_ffmpegCreateMixer( int rate, int channels );
+
+EXPORT void SDL_ffmpegFreeMixer( SDL_ffmpegMixer *mixer );
+
+EXPORT SDL_ffmpegMixerSource* SDL_ffmpegAddMixerSource( SDL_ffmpegMixer *mixer, SDL_ffmpegFile *file, uint32_t bytes );
+
+EXPORT int SDL_ffmpegRemoveMixerSource( SDL_ffmpegMixer *mixer, SDL_ffmpegMixerSource *source );
+
+EXPORT int SDL_ffmpegSetMixerSourceGain( SDL_ffmpegMixerSource *source, float gain, float pan );
+
+EXPORT int SDL_ffmpegPlayMixerSource( SDL_ffmpegMixerSource *source );
+
+EXPORT int SDL_ffmpegStopMixerSource( SDL_ffmpegMixerSource *source );
+
+EXPORT SDL_AudioSpec SDL_ffmpegGetMixerAudioSpec( SDL_ffmpegMixer *mixer, uint16_t samples );
+
+EXPORT void SDL_ffmpegMixerCallback( void *userdata, Uint8 *stream, int length );
+
 /* general audio */
 EXPORT int SDL_ffmpegValidAudio( SDL_ffmpegFile *file );
 
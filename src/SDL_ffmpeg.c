@@ -33,10 +33,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #include <SDL.h>
 #include <SDL_thread.h>
 
+#if defined( __x86_64__ ) || defined( __i386__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+#define SDL_FFMPEG_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -56,48 +71,190 @@ extern "C"
 #endif
 #endif
 
+/** amount of packets the reader thread buffers for every selected stream */
+#define SDL_FFMPEG_READ_AHEAD 64
+
+/** maximum amount of unused packets kept for recycling by every file */
+#define SDL_FFMPEG_POOL_SIZE 256
+
+/** amount of conversion contexts kept for every stream, unless set otherwise */
+#define SDL_FFMPEG_CONVERSION_CACHE_SIZE 4
+
+/** maximum amount of bands a picture is split in for parallel conversion */
+#define SDL_FFMPEG_MAX_SCALE_THREADS 16
+
+/** bands start at multiples of this amount of lines, so subsampled chroma lines are not split */
+#define SDL_FFMPEG_SCALE_ALIGN 16
+
+/** allows a function to use instructions of a CPU extension, which is checked at runtime */
+#if defined( __GNUC__ )
+#define SDL_FFMPEG_TARGET( t ) __attribute__(( target( t ) ))
+#else
+#define SDL_FFMPEG_TARGET( t )
+#endif
+
+/** atomically replace the pointer at p with n when it still holds o */
+#ifdef WIN32
+#define SDL_ffmpegCompareAndSwap( p, o, n ) ( InterlockedCompareExchangePointer(( PVOID volatile* )( p ), ( n ), ( o ) ) == ( o ) )
+#else
+#define SDL_ffmpegCompareAndSwap( p, o, n ) __sync_bool_compare_and_swap( p, o, n )
+#endif
+
+/** full memory barrier, orders the data of a ring buffer against its positions */
+#ifdef WIN32
+#define SDL_ffmpegMemoryBarrier() MemoryBarrier()
+#else
+#define SDL_ffmpegMemoryBarrier() __sync_synchronize()
+#endif
+
+/** maximum amount of bytes decoded at once by the audio thread */
+#define SDL_FFMPEG_AUDIO_CHUNK 4096
+
+/** gives every thread its own copy of a global variable */
+#ifdef _MSC_VER
+#define SDL_FFMPEG_THREAD_LOCAL __declspec( thread )
+#else
+#define SDL_FFMPEG_THREAD_LOCAL __thread
+#endif
+
+/** minimal amount of bytes handed to an audio sink at once */
+#define SDL_FFMPEG_AUDIO_DRAIN_BLOCK 262144
+
+/** samples per channel encoded at once by codecs without a frame size */
+#define SDL_FFMPEG_PCM_FRAME_SAMPLES 4096
+
+/** default amount of bytes held back to interleave the streams of an output file */
+#define SDL_FFMPEG_MUX_BYTES 4194304
+
+/** default span in milliseconds held back to interleave the streams of an output file */
+#define SDL_FFMPEG_MUX_DURATION 1000
+
+/** size in bytes of the buffer in which a mixer receives the audio of a source */
+#define SDL_FFMPEG_MIX_BUFFER 16384
+
 /**
 \cond
 */
 
+/* conversion context cache */
+uint32_t SDL_ffmpegConversionHash( int, int, int, int, int, int, int );
+
+void SDL_ffmpegConversionLink( SDL_ffmpegConversionCache*, SDL_ffmpegConversionContext* );
+
+void SDL_ffmpegConversionUnlink( SDL_ffmpegConversionCache*, SDL_ffmpegConversionContext* );
+
+void SDL_ffmpegConversionEvict( SDL_ffmpegConversionCache*, SDL_ffmpegConversionContext* );
+
+void SDL_ffmpegConversionFlush( SDL_ffmpegConversionCache* );
+
+/* parallel conversion */
+typedef struct
+{
+    /* NULL when the band is converted by a colour conversion kernel */
+    struct SwsContext *context;
+    const uint8_t *src[ 4 ];
+    int srcStride[ 4 ];
+    enum PixelFormat inFormat;
+    int width, height;
+    uint8_t *dst[ 4 ];
+    int dstStride[ 4 ];
+    enum PixelFormat outFormat;
+} SDL_ffmpegScaleJob;
+
+/* the bands of one picture, lives on the stack of the thread requesting the conversion */
+typedef struct SDL_ffmpegScaleBatch
+{
+    SDL_ffmpegScaleJob *jobs;
+    int jobCount, nextJob, doneJobs;
+    struct SDL_ffmpegScaleBatch *next;
+} SDL_ffmpegScaleBatch;
+
+typedef struct
+{
+    /* workers, these keep running until SDL_ffmpegQuit is called */
+    SDL_Thread *threads[ SDL_FFMPEG_MAX_SCALE_THREADS ];
+    int threadCount;
+    /* protects the fields below */
+    SDL_mutex *mutex;
+    SDL_cond *workCond, *doneCond;
+    /* batches of which not all bands were taken yet, oldest first */
+    SDL_ffmpegScaleBatch *batches;
+    int quit;
+} SDL_ffmpegScalePool;
+
+SDL_ffmpegScalePool SDL_ffmpegScaleWorkers;
+
+int SDL_ffmpegScale( SDL_ffmpegStream*, const uint8_t* const*, const int*, int, int, enum PixelFormat, uint8_t* const*, const int*, int, int, enum PixelFormat );
+
+int SDL_ffmpegScalePoolStart();
+
+void SDL_ffmpegScalePoolStop();
+
+void SDL_ffmpegScaleRun( SDL_ffmpegScaleJob*, int );
+
+SDL_ffmpegScaleJob* SDL_ffmpegScaleTake( SDL_ffmpegScalePool*, SDL_ffmpegScaleBatch* );
+
+int SDL_ffmpegScaleThread( void* );
+
+void SDL_ffmpegScaleJobRun( SDL_ffmpegScaleJob* );
+
+/* colour conversion kernels */
+int ( *SDL_ffmpegYUVToRGBKernel )( const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, int, enum PixelFormat ) = 0;
+
+int ( *SDL_ffmpegRGBToYUVKernel )( const uint8_t*, const uint8_t*, uint8_t*, uint8_t*, uint8_t*, uint8_t*, int, enum PixelFormat ) = 0;
+
+void SDL_ffmpegSelectKernels();
+
+int SDL_ffmpegKernelSupported( enum PixelFormat, enum PixelFormat );
+
+void SDL_ffmpegKernelConvert( const uint8_t* const*, const int*, enum PixelFormat, uint8_t* const*, const int*, enum PixelFormat, int, int );
+
+/* audio mix kernels */
+int ( *SDL_ffmpegMixKernel )( int16_t*, const int16_t*, int, int, int ) = 0;
+
+void SDL_ffmpegMix( int16_t*, const int16_t*, int, int, int );
+
+int SDL_ffmpegPublishMixerSources( SDL_ffmpegMixer* );
+
 /**
  *  Provide a fast way to get the correct context.
  *  \returns The context matching the input values.
  */
-struct SwsContext* getContext( SDL_ffmpegConversionContext **context, int inWidth, int inHeight, enum PixelFormat inFormat, int outWidth, int outHeight, enum PixelFormat outFormat )
+struct SwsContext* getContext( SDL_ffmpegConversionCache *cache, int slice, int inWidth, int inHeight, enum PixelFormat inFormat, int outWidth, int outHeight, enum PixelFormat outFormat )
 {
-    SDL_ffmpegConversionContext *ctx = *context;
+    uint32_t hash = SDL_ffmpegConversionHash( slice, inWidth, inHeight, inFormat, outWidth, outHeight, outFormat );
+
+    SDL_ffmpegConversionContext *ctx = cache->buckets[ hash % SDL_FFMPEG_CONVERSION_BUCKETS ];
 
-    if ( ctx )
+    /* check for a matching context */
+    while ( ctx )
     {
-        /* check for a matching context */
-        while ( ctx )
+        if ( ctx->hash == hash &&
+                ctx->slice == slice &&
+                ctx->inWidth == inWidth &&
+                ctx->inHeight == inHeight &&
+                ctx->inFormat == inFormat &&
+                ctx->outWidth == outWidth &&
+                ctx->outHeight == outHeight &&
+                ctx->outFormat == outFormat )
         {
-            if ( ctx->inWidth == inWidth &&
-                    ctx->inHeight == inHeight &&
-                    ctx->inFormat == inFormat &&
-                    ctx->outWidth == outWidth &&
-                    ctx->outHeight == outHeight &&
-                    ctx->outFormat == outFormat )
-            {
-                return ctx->context;
-            }
+            cache->hits++;
 
-            ctx = ctx->next;
+            /* move context to the front of the list of used contexts */
+            SDL_ffmpegConversionUnlink( cache, ctx );
+            SDL_ffmpegConversionLink( cache, ctx );
+
+            return ctx->context;
         }
 
-        ctx = *context;
+        ctx = ctx->next;
+    }
 
-        /* find the last context */
-        while ( ctx ) ctx = ctx->next;
+    cache->misses++;
 
-        /* allocate a new context */
-        ctx = ( struct SDL_ffmpegConversionContext* ) malloc( sizeof( SDL_ffmpegConversionContext ) );
-    }
-    else
-    {
-        ctx = *context = ( struct SDL_ffmpegConversionContext* ) malloc( sizeof( SDL_ffmpegConversionContext ) );
-    }
+    /* allocate a new context */
+    ctx = ( SDL_ffmpegConversionContext* )malloc( sizeof( SDL_ffmpegConversionContext ) );
+    if ( !ctx ) return 0;
 
     /* fill context with correct information */
     ctx->context = sws_getContext( inWidth, inHeight, inFormat,
@@ -107,36 +264,284 @@ struct SwsContext* getContext( SDL_ffmpegConversionContext **context, int inWidt
                                    0,
                                    0 );
 
+    if ( !ctx->context )
+    {
+        free( ctx );
+        return 0;
+    }
+
     ctx->inWidth = inWidth;
     ctx->inHeight = inHeight;
     ctx->inFormat = inFormat;
     ctx->outWidth = outWidth;
     ctx->outHeight = outHeight;
     ctx->outFormat = outFormat;
-    ctx->next = 0;
+    ctx->slice = slice;
+    ctx->hash = hash;
+
+    /* make room for the new context, every band has its own contexts */
+    uint32_t limit = ( cache->limit ? cache->limit : SDL_FFMPEG_CONVERSION_CACHE_SIZE ) * ( cache->slices ? cache->slices : 1 );
+
+    while ( cache->oldest && cache->count >= limit ) SDL_ffmpegConversionEvict( cache, cache->oldest );
+
+    SDL_ffmpegConversionLink( cache, ctx );
 
     return ctx->context;
 }
 
+uint32_t SDL_ffmpegConversionHash( int slice, int inWidth, int inHeight, int inFormat, int outWidth, int outHeight, int outFormat )
+{
+    uint32_t hash = 2166136261u;
+
+    int values[] = { slice, inWidth, inHeight, inFormat, outWidth, outHeight, outFormat };
+
+    for ( uint32_t i = 0; i < sizeof( values ) / sizeof( int ); i++ )
+    {
+        hash = ( hash ^ ( uint32_t )values[ i ] ) * 16777619u;
+    }
+
+    return hash;
+}
+
+void SDL_ffmpegConversionLink( SDL_ffmpegConversionCache *cache, SDL_ffmpegConversionContext *ctx )
+{
+    /* add to hash bucket */
+    SDL_ffmpegConversionContext **bucket = &cache->buckets[ ctx->hash % SDL_FFMPEG_CONVERSION_BUCKETS ];
+
+    ctx->next = *bucket;
+    *bucket = ctx;
+
+    /* add as most recently used */
+    ctx->newer = 0;
+    ctx->older = cache->newest;
+
+    if ( cache->newest ) cache->newest->newer = ctx;
+
+    cache->newest = ctx;
+
+    if ( !cache->oldest ) cache->oldest = ctx;
+
+    cache->count++;
+}
+
+void SDL_ffmpegConversionUnlink( SDL_ffmpegConversionCache *cache, SDL_ffmpegConversionContext *ctx )
+{
+    /* remove from hash bucket */
+    SDL_ffmpegConversionContext **bucket = &cache->buckets[ ctx->hash % SDL_FFMPEG_CONVERSION_BUCKETS ];
+
+    while ( *bucket && *bucket != ctx ) bucket = &( *bucket )->next;
+
+    if ( *bucket ) *bucket = ctx->next;
+
+    /* remove from list of used contexts */
+    if ( ctx->newer ) ctx->newer->older = ctx->older;
+    else cache->newest = ctx->older;
+
+    if ( ctx->older ) ctx->older->newer = ctx->newer;
+    else cache->oldest = ctx->newer;
+
+    ctx->next = ctx->newer = ctx->older = 0;
+
+    cache->count--;
+}
+
+void SDL_ffmpegConversionEvict( SDL_ffmpegConversionCache *cache, SDL_ffmpegConversionContext *ctx )
+{
+    SDL_ffmpegConversionUnlink( cache, ctx );
+
+    sws_freeContext( ctx->context );
+
+    free( ctx );
+}
+
+void SDL_ffmpegConversionFlush( SDL_ffmpegConversionCache *cache )
+{
+    while ( cache->oldest ) SDL_ffmpegConversionEvict( cache, cache->oldest );
+}
+
 uint32_t SDL_ffmpegInitWasCalled = 0;
 
-/* error handling */
-char SDL_ffmpegErrorMessage[ 512 ];
+/* serializes library initialization */
+SDL_mutex *volatile SDL_ffmpegInitMutex = 0;
+
+int SDL_ffmpegLockManager( void**, enum AVLockOp );
+
+AVFormatContext* SDL_ffmpegOpenFormat( const char*, uint32_t, uint32_t );
+
+/* error handling, every thread keeps its own last error */
+SDL_FFMPEG_THREAD_LOCAL char SDL_ffmpegErrorMessage[ 512 ];
 
 void SDL_ffmpegSetError( const char *error );
 
+/* seeking and flushing */
+void SDL_ffmpegSeekStreams( SDL_ffmpegFile*, uint64_t );
+
+void SDL_ffmpegFlushStreams( SDL_ffmpegFile* );
+
 /* packet handling */
 int SDL_ffmpegGetPacket( SDL_ffmpegFile* );
 
+int SDL_ffmpegFetchPacket( SDL_ffmpegFile*, SDL_ffmpegStream* );
+
+void SDL_ffmpegStreamsChanged( SDL_ffmpegFile* );
+
+int SDL_ffmpegReadThread( void* );
+
+int SDL_ffmpegBuffersFull( SDL_ffmpegFile* );
+
+void SDL_ffmpegBufferPacket( SDL_ffmpegStream*, SDL_ffmpegPacket* );
+
+/* packet pool handling */
+SDL_ffmpegPacket* SDL_ffmpegAcquirePacket( SDL_ffmpegPacketPool*, int );
+
+SDL_ffmpegPacket* SDL_ffmpegAdoptPacket( SDL_ffmpegPacketPool*, AVPacket* );
+
+SDL_ffmpegPacket* SDL_ffmpegTakePacket( SDL_ffmpegPacketPool* );
+
+void SDL_ffmpegReleasePacket( SDL_ffmpegPacket* );
+
+void SDL_ffmpegDestroyPacket( SDL_ffmpegPacket* );
+
+/* packet queue handling */
+int64_t SDL_ffmpegPacketDuration( SDL_ffmpegStream*, SDL_ffmpegPacket* );
+
+int SDL_ffmpegQueueGrow( SDL_ffmpegPacketQueue* );
+
+int SDL_ffmpegQueuePush( SDL_ffmpegStream*, SDL_ffmpegPacket* );
+
+int SDL_ffmpegQueueUnget( SDL_ffmpegStream*, SDL_ffmpegPacket* );
+
+SDL_ffmpegPacket* SDL_ffmpegQueuePop( SDL_ffmpegStream* );
+
+int SDL_ffmpegQueueFull( SDL_ffmpegPacketQueue* );
+
+void SDL_ffmpegQueueFlush( SDL_ffmpegStream* );
+
 SDL_ffmpegPacket* SDL_ffmpegGetAudioPacket( SDL_ffmpegFile* );
 
 SDL_ffmpegPacket* SDL_ffmpegGetVideoPacket( SDL_ffmpegFile* );
 
+/* codec handling */
+int SDL_ffmpegCPUCount();
+
+void SDL_ffmpegApplyThreads( AVCodecContext*, int, int );
+
+int SDL_ffmpegOpenDecoder( SDL_ffmpegStream* );
+
+int SDL_ffmpegActivateStream( SDL_ffmpegStream* );
+
+void SDL_ffmpegDeactivateStream( SDL_ffmpegStream* );
+
 /* frame handling */
+int SDL_ffmpegReadAudioFrame( SDL_ffmpegFile*, SDL_ffmpegAudioFrame* );
+
 int SDL_ffmpegDecodeAudioFrame( SDL_ffmpegFile*, AVPacket*, SDL_ffmpegAudioFrame* );
 
+int SDL_ffmpegDecodeAudioPacket( SDL_ffmpegFile*, AVPacket* );
+
+int SDL_ffmpegFileSink( void*, const uint8_t*, uint32_t, int64_t );
+
+int SDL_ffmpegAudioFifoReserve( SDL_ffmpegAudioFifo*, int );
+
+void SDL_ffmpegAudioFifoRead( SDL_ffmpegStream*, SDL_ffmpegAudioFrame* );
+
+void SDL_ffmpegAudioFifoSkip( SDL_ffmpegAudioFifo* );
+
+/* audio conversion */
+void SDL_ffmpegAudioOutputSpec( SDL_ffmpegFile*, int*, int*, uint16_t* );
+
+int SDL_ffmpegAudioBytesPerSample( uint16_t );
+
+int SDL_ffmpegAudioConverterPrepare( SDL_ffmpegFile*, SDL_ffmpegStream* );
+
+void SDL_ffmpegAudioConverterMatrix( SDL_ffmpegAudioConverter* );
+
+int SDL_ffmpegAudioConvert( SDL_ffmpegFile*, SDL_ffmpegStream*, const int16_t*, int );
+
+int SDL_ffmpegAudioInterleave( uint8_t*, int16_t* const*, int, int, uint16_t );
+
+int SDL_ffmpegAudioDeinterleave( SDL_ffmpegAudioConverter*, SDL_ffmpegAudioFrame*, int, int );
+
+void SDL_ffmpegAudioConverterReset( SDL_ffmpegAudioConverter* );
+
+void SDL_ffmpegAudioConverterFree( SDL_ffmpegAudioConverter* );
+
 int SDL_ffmpegDecodeVideoFrame( SDL_ffmpegFile*, AVPacket*, SDL_ffmpegVideoFrame* );
 
+int SDL_ffmpegDecodeNextVideoFrame( SDL_ffmpegFile*, SDL_ffmpegVideoFrame* );
+
+void SDL_ffmpegConvertVideoFrame( SDL_ffmpegStream*, const uint8_t* const*, const int*, int, int, enum PixelFormat, SDL_ffmpegVideoFrame* );
+
+void SDL_ffmpegExposeVideoFrame( uint8_t* const*, const int*, int, int, enum PixelFormat, SDL_ffmpegVideoFrame* );
+
+void SDL_ffmpegCopyPlane( uint8_t*, int, const uint8_t*, int, int, int );
+
+/* decoding ahead */
+int SDL_ffmpegDecodeThread( void* );
+
+void SDL_ffmpegStopDecodeThread( SDL_ffmpegFile* );
+
+int SDL_ffmpegStoreDecodedFrame( SDL_ffmpegFile*, SDL_ffmpegVideoFrame* );
+
+int SDL_ffmpegPopDecodedFrame( SDL_ffmpegFile*, SDL_ffmpegVideoFrame* );
+
+/* encoding ahead */
+enum PixelFormat SDL_ffmpegSurfaceFormat( SDL_Surface* );
+
+int SDL_ffmpegPictureLayout( enum PixelFormat, const int*, int, int* );
+
+int SDL_ffmpegAddVideoPicture( SDL_ffmpegFile*, const uint8_t* const*, const int*, int, int, enum PixelFormat, SDL_Surface* );
+
+int SDL_ffmpegEncodeVideoFrame( SDL_ffmpegFile*, SDL_ffmpegStream*, const uint8_t* const*, const int*, int, int, enum PixelFormat );
+
+int SDL_ffmpegQueueVideoPicture( SDL_ffmpegFile*, const uint8_t* const*, const int*, int, int, enum PixelFormat, SDL_Surface* );
+
+int SDL_ffmpegEncodeThread( void* );
+
+void SDL_ffmpegStopEncodeThread( SDL_ffmpegFile* );
+
+int SDL_ffmpegEncodeFailed( SDL_ffmpegFile* );
+
+/* encoding audio */
+int SDL_ffmpegEncodeAudio( SDL_ffmpegFile*, SDL_ffmpegStream*, const int16_t*, int );
+
+int SDL_ffmpegFlushAudioEncoder( SDL_ffmpegFile*, SDL_ffmpegStream* );
+
+/* interleaving */
+int SDL_ffmpegMuxPacket( SDL_ffmpegFile*, SDL_ffmpegStream*, AVPacket* );
+
+int SDL_ffmpegMuxReady( SDL_ffmpegFile* );
+
+int SDL_ffmpegWriteMuxQueue( SDL_ffmpegFile*, int );
+
+/* stream copy */
+int SDL_ffmpegCopiesFrom( SDL_ffmpegStream*, SDL_ffmpegFile* );
+
+SDL_ffmpegStream* SDL_ffmpegCopyTarget( SDL_ffmpegFile*, SDL_ffmpegFile*, int );
+
+void SDL_ffmpegCopyDiscard( SDL_ffmpegFile*, SDL_ffmpegFile*, int );
+
+int SDL_ffmpegCopyPacket( SDL_ffmpegFile*, SDL_ffmpegStream*, AVStream*, AVPacket*, int64_t );
+
+/* decoding audio ahead */
+int SDL_ffmpegAudioThread( void* );
+
+void SDL_ffmpegStopAudioThread( SDL_ffmpegFile* );
+
+void SDL_ffmpegFlushAudioRing( SDL_ffmpegFile* );
+
+uint32_t SDL_ffmpegRingWrite( SDL_ffmpegAudioRing*, const uint8_t*, uint32_t );
+
+uint32_t SDL_ffmpegRingRead( SDL_ffmpegAudioRing*, uint8_t*, uint32_t );
+
+void SDL_ffmpegRingSetTime( SDL_ffmpegAudioRing*, uint32_t, int64_t, uint32_t, SDL_ffmpegFile* );
+
+int SDL_ffmpegRingGetTime( SDL_ffmpegAudioRing*, SDL_ffmpegAudioTime* );
+
+int SDL_ffmpegSpliceAudio( SDL_ffmpegFile* );
+
+void SDL_ffmpegRestoreAudioSource( SDL_ffmpegFile* );
+
 const SDL_ffmpegCodec SDL_ffmpegCodecAUTO =
 {
     -1,
@@ -147,7 +552,8 @@ const SDL_ffmpegCodec SDL_ffmpegCodecAUTO =
     -1,
     2, 48000,
     192000,
-    -1, -1
+    -1, -1,
+    1, SDL_ffmpegThreadDefault
 };
 
 const SDL_ffmpegCodec SDL_ffmpegCodecPALDVD =
@@ -160,7 +566,8 @@ const SDL_ffmpegCodec SDL_ffmpegCodecPALDVD =
     CODEC_ID_MP2,
     2, 48000,
     192000,
-    -1, -1
+    -1, -1,
+    1, SDL_ffmpegThreadDefault
 };
 
 const SDL_ffmpegCodec SDL_ffmpegCodecPALDV =
@@ -173,7 +580,8 @@ const SDL_ffmpegCodec SDL_ffmpegCodecPALDV =
     CODEC_ID_DVAUDIO,
     2, 48000,
     256000,
-    -1, -1
+    -1, -1,
+    1, SDL_ffmpegThreadDefault
 };
 
 SDL_ffmpegFile* SDL_ffmpegCreateFile()
@@ -190,6 +598,22 @@ SDL_ffmpegFile* SDL_ffmpegCreateFile()
 
     file->streamMutex = SDL_CreateMutex();
 
+    file->readMutex = SDL_CreateMutex();
+
+    file->readCond = SDL_CreateCond();
+
+    file->packetPool.mutex = SDL_CreateMutex();
+
+    file->frameMutex = SDL_CreateMutex();
+
+    file->frameCond = SDL_CreateCond();
+
+    file->audioCond = SDL_CreateCond();
+
+    file->encodeMutex = SDL_CreateMutex();
+
+    file->encodeCond = SDL_CreateCond();
+
     return file;
 }
 
@@ -206,14 +630,44 @@ SDL_ffmpegFile* SDL_ffmpegCreateFile()
 */
 void SDL_ffmpegInit()
 {
+    /* the first thread to get here creates the lock used for initialization */
+    if ( !SDL_ffmpegInitMutex )
+    {
+        SDL_mutex *mutex = SDL_CreateMutex();
+
+        if ( !SDL_ffmpegCompareAndSwap( &SDL_ffmpegInitMutex, ( SDL_mutex* )0, mutex ) ) SDL_DestroyMutex( mutex );
+    }
+
+    SDL_LockMutex( SDL_ffmpegInitMutex );
+
     /* register all codecs */
     if ( !SDL_ffmpegInitWasCalled )
     {
-        SDL_ffmpegInitWasCalled = 1;
-
         avcodec_register_all();
         av_register_all();
+
+        /* let ffmpeg guard opening and closing of codecs, so files
+           can be opened from multiple threads at once */
+        av_lockmgr_register( SDL_ffmpegLockManager );
+
+        /* pick the fastest colour conversion kernels this CPU supports */
+        SDL_ffmpegSelectKernels();
+
+        SDL_ffmpegInitWasCalled = 1;
     }
+
+    SDL_UnlockMutex( SDL_ffmpegInitMutex );
+}
+
+/** \brief  Stops the threads SDL_ffmpeg started for parallel conversion.
+
+            Call this before the program exits, after all files were freed.
+            No conversion may be running while this function is called. When
+            pictures are converted afterwards, the threads are started again.
+*/
+void SDL_ffmpegQuit()
+{
+    SDL_ffmpegScalePoolStop();
 }
 
 /** \brief  Use this to free an SDL_ffmpegFile.
@@ -226,6 +680,42 @@ void SDL_ffmpegFree( SDL_ffmpegFile *file )
 {
     if ( !file ) return;
 
+    /* write queued frames and stop encoding before the streams are released */
+    SDL_ffmpegStopEncodeThread( file );
+
+    /* encode the audio which did not fill a complete frame yet */
+    if ( file->type == SDL_ffmpegOutputStream )
+    {
+        for ( SDL_ffmpegStream *s = file->as; s; s = s->next )
+        {
+            SDL_ffmpegFlushAudioEncoder( file, s );
+        }
+
+        /* write the packets which were held back for interleaving */
+        SDL_LockMutex( file->streamMutex );
+
+        SDL_ffmpegWriteMuxQueue( file, 1 );
+
+        SDL_UnlockMutex( file->streamMutex );
+    }
+
+    /* stop decoding frames before the streams are released */
+    SDL_ffmpegStopAudioThread( file );
+
+    SDL_ffmpegStopDecodeThread( file );
+
+    /* stop reading packets before releasing the buffers */
+    if ( file->readThread )
+    {
+        file->stopReading = 1;
+
+        SDL_CondSignal( file->readCond );
+
+        SDL_WaitThread( file->readThread, 0 );
+
+        file->readThread = 0;
+    }
+
     SDL_ffmpegFlush( file );
 
     /* only write trailer when handling output streams */
@@ -243,33 +733,17 @@ void SDL_ffmpegFree( SDL_ffmpegFile *file )
 
         SDL_DestroyMutex( old->mutex );
 
-        while ( old->buffer )
-        {
-            SDL_ffmpegPacket *pack = old->buffer;
-
-            old->buffer = old->buffer->next;
-
-            av_free_packet( pack->data );
-
-            av_free( pack->data );
+        SDL_DestroyCond( old->bufferCond );
 
-            free( pack );
-        }
-
-        while ( old->conversionContext )
-        {
-            SDL_ffmpegConversionContext *ctx = old->conversionContext;
-
-            old->conversionContext = old->conversionContext->next;
+        SDL_ffmpegQueueFlush( old );
 
-            sws_freeContext( ctx->context );
+        free( old->buffer.packets );
 
-            free( ctx );
-        }
+        SDL_ffmpegConversionFlush( &old->conversionCache );
 
         av_free( old->decodeFrame );
 
-        if ( old->_ffmpeg ) avcodec_close( old->_ffmpeg->codec );
+        if ( old->_ffmpeg && old->_ffmpeg->codec->codec ) avcodec_close( old->_ffmpeg->codec );
 
         free( old );
     }
@@ -283,22 +757,19 @@ void SDL_ffmpegFree( SDL_ffmpegFile *file )
 
         SDL_DestroyMutex( old->mutex );
 
-        while ( old->buffer )
-        {
-            SDL_ffmpegPacket *pack = old->buffer;
+        SDL_DestroyCond( old->bufferCond );
 
-            old->buffer = old->buffer->next;
+        SDL_ffmpegQueueFlush( old );
 
-            av_free_packet( pack->data );
+        free( old->buffer.packets );
 
-            av_free( pack->data );
+        av_free( old->encodeAudioBuffer );
 
-            free( pack );
-        }
+        av_free( old->audioFifo.buffer );
 
-        av_free( old->sampleBuffer );
+        SDL_ffmpegAudioConverterFree( &old->audioConverter );
 
-        if ( old->_ffmpeg ) avcodec_close( old->_ffmpeg->codec );
+        if ( old->_ffmpeg && old->_ffmpeg->codec->codec ) avcodec_close( old->_ffmpeg->codec );
 
         free( old );
     }
@@ -319,6 +790,32 @@ void SDL_ffmpegFree( SDL_ffmpegFile *file )
 
     SDL_DestroyMutex( file->streamMutex );
 
+    SDL_DestroyMutex( file->readMutex );
+
+    SDL_DestroyCond( file->readCond );
+
+    /* all packets are back in the pool by now */
+    while ( file->packetPool.free )
+    {
+        SDL_ffmpegPacket *pack = file->packetPool.free;
+
+        file->packetPool.free = pack->next;
+
+        SDL_ffmpegDestroyPacket( pack );
+    }
+
+    SDL_DestroyMutex( file->packetPool.mutex );
+
+    SDL_DestroyMutex( file->frameMutex );
+
+    SDL_DestroyCond( file->frameCond );
+
+    SDL_DestroyCond( file->audioCond );
+
+    SDL_DestroyMutex( file->encodeMutex );
+
+    SDL_DestroyCond( file->encodeCond );
+
     free( file );
 }
 
@@ -353,11 +850,123 @@ void SDL_ffmpegFreeVideoFrame( SDL_ffmpegVideoFrame* frame )
 }
 
 
-/** \brief  Use this to open the multimedia file of your choice.
+/** \brief  Retrieve information about a multimedia file.
 
-            This function is used to open a multimedia file.
-            When the file could be opened, but no decodable streams where detected
-            this function still returns a pointer to a valid SDL_ffmpegFile.
+            This function is meant for quickly scanning many files. It reads
+            the format and stream parameters of a file, without opening any
+            codecs or allocating decode buffers, and closes the file again.
+            The streams in the result match the streams SDL_ffmpegOpen would
+            provide. This function can be called from multiple threads at once,
+            errors are reported to the calling thread only.
+\param      filename string containing the location of the file
+\param      probeSize maximum amount of bytes read to find the stream parameters, 0 uses the ffmpeg default
+\param      analyzeDuration maximum duration in milliseconds analyzed to find the stream parameters, 0 uses the ffmpeg default
+\returns    a pointer to a SDL_ffmpegFileInfo structure which should be released using SDL_ffmpegFreeFileInfo, or NULL on error
+*/
+SDL_ffmpegFileInfo* SDL_ffmpegGetFileInfo( const char *filename, uint32_t probeSize, uint32_t analyzeDuration )
+{
+    SDL_ffmpegInit();
+
+    AVFormatContext *format = SDL_ffmpegOpenFormat( filename, probeSize, analyzeDuration );
+    if ( !format ) return 0;
+
+    /* info and the stream information are stored in a single block */
+    SDL_ffmpegFileInfo *info = ( SDL_ffmpegFileInfo* )malloc( sizeof( SDL_ffmpegFileInfo ) + format->nb_streams * sizeof( SDL_ffmpegStreamInfo ) );
+    if ( !info )
+    {
+        av_close_input_file( format );
+        SDL_ffmpegSetError( "could not allocate SDL_ffmpegFileInfo" );
+        return 0;
+    }
+
+    memset( info, 0, sizeof( SDL_ffmpegFileInfo ) + format->nb_streams * sizeof( SDL_ffmpegStreamInfo ) );
+
+    if ( format->iformat && format->iformat->name )
+    {
+        strncpy( info->format, format->iformat->name, sizeof( info->format ) - 1 );
+    }
+
+    if ( format->duration != AV_NOPTS_VALUE ) info->duration = format->duration / ( AV_TIME_BASE / 1000 );
+
+    info->bitRate = format->bit_rate;
+
+    /* count decodable streams, so audio information can be placed after the video information */
+    for ( uint32_t i = 0; i < format->nb_streams; i++ )
+    {
+        AVCodecContext *codec = format->streams[i]->codec;
+
+        if ( codec->codec_type == CODEC_TYPE_VIDEO && avcodec_find_decoder( codec->codec_id ) ) info->videoStreams++;
+    }
+
+    info->video = ( SDL_ffmpegStreamInfo* )( info + 1 );
+    info->audio = info->video + info->videoStreams;
+
+    uint32_t videoStreams = 0, audioStreams = 0;
+
+    for ( uint32_t i = 0; i < format->nb_streams; i++ )
+    {
+        AVStream *st = format->streams[i];
+
+        AVCodec *decoder = avcodec_find_decoder( st->codec->codec_id );
+
+        SDL_ffmpegStreamInfo *stream;
+
+        if ( st->codec->codec_type == CODEC_TYPE_VIDEO && decoder )
+        {
+            stream = &info->video[ videoStreams++ ];
+
+            stream->width = st->codec->width;
+            stream->height = st->codec->height;
+            stream->frameRateNum = st->r_frame_rate.num;
+            stream->frameRateDen = st->r_frame_rate.den;
+        }
+        else if ( st->codec->codec_type == CODEC_TYPE_AUDIO && decoder )
+        {
+            stream = &info->audio[ audioStreams++ ];
+
+            stream->sampleRate = st->codec->sample_rate;
+            stream->channels = st->codec->channels;
+        }
+        else
+        {
+            continue;
+        }
+
+        stream->id = i;
+        stream->codecID = st->codec->codec_id;
+        stream->bitRate = st->codec->bit_rate;
+
+        if ( decoder->name ) strncpy( stream->codecName, decoder->name, sizeof( stream->codecName ) - 1 );
+
+        if ( st->duration != AV_NOPTS_VALUE )
+        {
+            stream->duration = av_rescale( st->duration, 1000 * st->time_base.num, st->time_base.den );
+        }
+    }
+
+    info->audioStreams = audioStreams;
+
+    av_close_input_file( format );
+
+    return info;
+}
+
+
+/** \brief  Use this to free a SDL_ffmpegFileInfo.
+
+\param      info SDL_ffmpegFileInfo which was returned by SDL_ffmpegGetFileInfo
+*/
+void SDL_ffmpegFreeFileInfo( SDL_ffmpegFileInfo *info )
+{
+    free( info );
+}
+
+
+/** \brief  Use this to open the multimedia file of your choice.
+
+            This function is used to open a multimedia file.
+            When the file could be opened, but no decodable streams where detected
+            this function still returns a pointer to a valid SDL_ffmpegFile.
 \param      filename string containing the location of the file
 \returns    a pointer to a SDL_ffmpegFile structure, or NULL if a file could not be opened
 */
@@ -372,23 +981,11 @@ SDL_ffmpegFile* SDL_ffmpegOpen( const char* filename )
     /* information about format is stored in file->_ffmpeg */
     file->type = SDL_ffmpegInputStream;
 
-    /* open the file */
-    if ( av_open_input_file(( AVFormatContext** )( &file->_ffmpeg ), filename, 0, 0, 0 ) != 0 )
-    {
-        char c[512];
-        snprintf( c, 512, "could not open \"%s\"", filename );
-        SDL_ffmpegSetError( c );
-        free( file );
-        return 0;
-    }
-
-    /* retrieve format information */
-    if ( av_find_stream_info( file->_ffmpeg ) < 0 )
+    /* open the file and retrieve format information */
+    file->_ffmpeg = SDL_ffmpegOpenFormat( filename, 0, 0 );
+    if ( !file->_ffmpeg )
     {
-        char c[512];
-        snprintf( c, 512, "could not retrieve file info for \"%s\"", filename );
-        SDL_ffmpegSetError( c );
-        free( file );
+        SDL_ffmpegFree( file );
         return 0;
     }
 
@@ -414,29 +1011,27 @@ SDL_ffmpegFile* SDL_ffmpegOpen( const char* filename )
                 /* _ffmpeg holds data about streamcodec */
                 stream->_ffmpeg = file->_ffmpeg->streams[i];
 
-                /* get the correct decoder for this stream */
-                AVCodec *codec = avcodec_find_decoder( stream->_ffmpeg->codec->codec_id );
+                /* decode using a single thread by default */
+                stream->threadCount = 1;
 
-                if ( !codec )
+                /* check if we can decode this stream, the decoder itself
+                   is opened when the stream gets selected */
+                if ( !avcodec_find_decoder( stream->_ffmpeg->codec->codec_id ) )
                 {
                     free( stream );
                     SDL_ffmpegSetError( "could not find video codec" );
                 }
-                else if ( avcodec_open( file->_ffmpeg->streams[i]->codec, codec ) < 0 )
-                {
-                    free( stream );
-                    SDL_ffmpegSetError( "could not open video codec" );
-                }
                 else
                 {
                     stream->mutex = SDL_CreateMutex();
 
-                    stream->decodeFrame = avcodec_alloc_frame();
+                    stream->bufferCond = SDL_CreateCond();
 
+                    /* find the end of the list of streams */
                     SDL_ffmpegStream **s = &file->vs;
                     while ( *s )
                     {
-                        *s = ( *s )->next;
+                        s = &( *s )->next;
                     }
 
                     *s = stream;
@@ -461,32 +1056,27 @@ SDL_ffmpegFile* SDL_ffmpegOpen( const char* filename )
                 /* _ffmpeg holds data about streamcodec */
                 stream->_ffmpeg = file->_ffmpeg->streams[i];
 
-                /* get the correct decoder for this stream */
-                AVCodec *codec = avcodec_find_decoder( file->_ffmpeg->streams[i]->codec->codec_id );
+                /* decode using a single thread by default */
+                stream->threadCount = 1;
 
-                if ( !codec )
+                /* check if we can decode this stream, the decoder itself
+                   is opened when the stream gets selected */
+                if ( !avcodec_find_decoder( stream->_ffmpeg->codec->codec_id ) )
                 {
                     free( stream );
                     SDL_ffmpegSetError( "could not find audio codec" );
                 }
-                else if ( avcodec_open( file->_ffmpeg->streams[i]->codec, codec ) < 0 )
-                {
-                    free( stream );
-                    SDL_ffmpegSetError( "could not open audio codec" );
-                }
                 else
                 {
                     stream->mutex = SDL_CreateMutex();
 
-                    stream->sampleBuffer = ( int8_t* )av_malloc( AVCODEC_MAX_AUDIO_FRAME_SIZE * sizeof( int16_t ) );
-                    stream->sampleBufferSize = 0;
-                    stream->sampleBufferOffset = 0;
-                    stream->sampleBufferTime = AV_NOPTS_VALUE;
+                    stream->bufferCond = SDL_CreateCond();
 
+                    /* find the end of the list of streams */
                     SDL_ffmpegStream **s = &file->as;
                     while ( *s )
                     {
-                        *s = ( *s )->next;
+                        s = &( *s )->next;
                     }
 
                     *s = stream;
@@ -501,6 +1091,34 @@ SDL_ffmpegFile* SDL_ffmpegOpen( const char* filename )
 }
 
 
+/** \brief  Use this to open the multimedia file of your choice, reading packets
+            in a separate thread.
+
+            This function behaves like SDL_ffmpegOpen, but starts a thread which
+            reads packets from file and stores them in the buffers of the selected
+            streams. SDL_ffmpegGetVideoFrame and SDL_ffmpegGetAudioFrame will only
+            take packets from these buffers, so slow disk access does not stall
+            the thread which requests the frames.
+\param      filename string containing the location of the file
+\returns    a pointer to a SDL_ffmpegFile structure, or NULL if a file could not be opened
+*/
+SDL_ffmpegFile* SDL_ffmpegOpenThreaded( const char* filename )
+{
+    SDL_ffmpegFile *file = SDL_ffmpegOpen( filename );
+    if ( !file ) return 0;
+
+    file->readThread = SDL_CreateThread( SDL_ffmpegReadThread, file );
+    if ( !file->readThread )
+    {
+        SDL_ffmpegSetError( "could not start reader thread" );
+        SDL_ffmpegFree( file );
+        return 0;
+    }
+
+    return file;
+}
+
+
 /** \brief  Use this to create the multimedia file of your choice.
 
             This function is used to create a multimedia file.
@@ -550,6 +1168,9 @@ SDL_ffmpegFile* SDL_ffmpegCreate( const char* filename )
 
     file->type = SDL_ffmpegOutputStream;
 
+    file->muxByteLimit = SDL_FFMPEG_MUX_BYTES;
+    file->muxDurationLimit = SDL_FFMPEG_MUX_DURATION;
+
     return file;
 }
 
@@ -557,160 +1178,334 @@ SDL_ffmpegFile* SDL_ffmpegCreate( const char* filename )
 /** \brief  Use this to add a SDL_ffmpegVideoFrame to file
 
             By adding frames to file, a video stream is build. If an audio stream
-            is present, syncing of both streams needs to be done by user.
+            is present, the encoded packets of both streams are interleaved by
+            timestamp before they are written, up to the limits set with
+            SDL_ffmpegSetInterleaveLimits.
+            When video is encoded ahead, the frame is copied to the encode queue
+            and this function returns without waiting for the encoder, unless
+            the queue is full. When a queued frame could not be encoded, its
+            error is returned by the next call, which does not add its frame.
 \param      file SDL_ffmpegFile to which a frame needs to be added.
 \param      frame SDL_ffmpegVideoFrame which will be added to the stream.
 \returns    0 if frame was added, non-zero if an error occured.
 */
 int SDL_ffmpegAddVideoFrame( SDL_ffmpegFile *file, SDL_Surface *frame )
 {
-    /* when accesing audio/video stream, streamMutex should be locked */
-    SDL_LockMutex( file->streamMutex );
+    if ( !file || !frame || !frame->format ) return -1;
 
-    if ( !file->videoStream || !frame || !frame->format )
+    const uint8_t *planes[] = { ( const uint8_t* )frame->pixels, 0, 0, 0 };
+    const int pitches[] = { frame->pitch, 0, 0, 0 };
+
+    return SDL_ffmpegAddVideoPicture( file, planes, pitches, frame->w, frame->h, SDL_ffmpegSurfaceFormat( frame ), 0 );
+}
+
+
+/** \brief  Add a surface to file, which is released by SDL_ffmpeg.
+
+            Works like SDL_ffmpegAddVideoFrame, but instead of copying the
+            surface to the encode queue, the surface itself is queued. It is
+            released using SDL_FreeSurface once it was encoded, so the user
+            should not use it after this call, not even when an error is
+            returned. This saves a copy of every frame when video is encoded
+            ahead.
+\param      file SDL_ffmpegFile to which a frame needs to be added.
+\param      frame SDL_Surface which will be added to the stream.
+\returns    0 if frame was added, non-zero if an error occured.
+*/
+int SDL_ffmpegAddVideoSurface( SDL_ffmpegFile *file, SDL_Surface *frame )
+{
+    if ( !file || !frame || !frame->format )
     {
-        SDL_UnlockMutex( file->streamMutex );
+        if ( frame ) SDL_FreeSurface( frame );
         return -1;
     }
 
-    int pitch [] =
-    {
-        frame->pitch,
-        0
-    };
+    const uint8_t *planes[] = { ( const uint8_t* )frame->pixels, 0, 0, 0 };
+    const int pitches[] = { frame->pitch, 0, 0, 0 };
 
-    const uint8_t *const data [] =
-    {
-        frame->pixels,
-        0
-    };
+    /* the surface is released by SDL_ffmpegAddVideoPicture */
+    return SDL_ffmpegAddVideoPicture( file, planes, pitches, frame->w, frame->h, SDL_ffmpegSurfaceFormat( frame ), frame );
+}
+
+
+/** \brief  Add a YUV 4:2:0 picture to file.
+
+            The planes are copied to the encoder as they are when the codec
+            uses YUV 4:2:0 at the same size, which is the case for most
+            codecs. Otherwise they are converted like a surface.
+\param      file SDL_ffmpegFile to which a frame needs to be added.
+\param      planes Y, U and V plane, U and V have half the width and height of Y.
+\param      pitches Size of a line of every plane in bytes.
+\param      width Width of the Y plane in pixels.
+\param      height Height of the Y plane in pixels.
+\returns    0 if frame was added, non-zero if an error occured.
+*/
+int SDL_ffmpegAddVideoPlanes( SDL_ffmpegFile *file, const uint8_t *const planes[ 3 ], const int pitches[ 3 ], int width, int height )
+{
+    if ( !file || !planes || !pitches || !planes[0] || !planes[1] || !planes[2] || width <= 0 || height <= 0 ) return -1;
+
+    /* conversion reads four planes */
+    const uint8_t *picture[] = { planes[0], planes[1], planes[2], 0 };
+    const int strides[] = { pitches[0], pitches[1], pitches[2], 0 };
+
+    return SDL_ffmpegAddVideoPicture( file, picture, strides, width, height, PIX_FMT_YUV420P, 0 );
+}
+
+
+/** \brief  Add an SDL_Overlay to file.
+
+            YV12 and IYUV overlays are added like SDL_ffmpegAddVideoPlanes,
+            YUY2 and UYVY overlays are converted to the format of the codec.
+\param      file SDL_ffmpegFile to which a frame needs to be added.
+\param      overlay SDL_Overlay which will be added to the stream.
+\returns    0 if frame was added, non-zero if an error occured.
+*/
+int SDL_ffmpegAddVideoOverlay( SDL_ffmpegFile *file, SDL_Overlay *overlay )
+{
+    if ( !file || !overlay ) return -1;
+
+    enum PixelFormat format;
+
+    /* YV12 stores V before U */
+    int u = 1,
+        v = 2;
 
-    switch ( frame->format->BitsPerPixel )
+    switch ( overlay->format )
     {
-        case 24:
-            sws_scale( getContext( &file->videoStream->conversionContext,
-                                   frame->w, frame->h, PIX_FMT_RGB24,
-                                   file->videoStream->_ffmpeg->codec->width,
-                                   file->videoStream->_ffmpeg->codec->height,
-                                   file->videoStream->_ffmpeg->codec->pix_fmt ),
-                       data,
-                       pitch,
-                       0,
-                       frame->h,
-                       file->videoStream->encodeFrame->data,
-                       file->videoStream->encodeFrame->linesize );
+        case SDL_YV12_OVERLAY:
+            u = 2;
+            v = 1;
+            format = PIX_FMT_YUV420P;
             break;
-        case 32:
-            sws_scale( getContext( &file->videoStream->conversionContext,
-                                   frame->w, frame->h, PIX_FMT_BGR32,
-                                   file->videoStream->_ffmpeg->codec->width,
-                                   file->videoStream->_ffmpeg->codec->height,
-                                   file->videoStream->_ffmpeg->codec->pix_fmt ),
-                       data,
-                       pitch,
-                       0,
-                       frame->h,
-                       file->videoStream->encodeFrame->data,
-                       file->videoStream->encodeFrame->linesize );
+
+        case SDL_IYUV_OVERLAY:
+            format = PIX_FMT_YUV420P;
             break;
-        default:
+
+        case SDL_YUY2_OVERLAY:
+            format = PIX_FMT_YUYV422;
+            break;
+
+        case SDL_UYVY_OVERLAY:
+            format = PIX_FMT_UYVY422;
             break;
+
+        default:
+            SDL_ffmpegSetError( "unsupported overlay format" );
+            return -1;
     }
 
-    /* PAL = upper field first
-    file->videoStream->encodeFrame->top_field_first = 1;
-    */
+    SDL_LockYUVOverlay( overlay );
 
-    int out_size = avcodec_encode_video( file->videoStream->_ffmpeg->codec, file->videoStream->encodeFrameBuffer, file->videoStream->encodeFrameBufferSize, file->videoStream->encodeFrame );
+    const uint8_t *planes[] = { overlay->pixels[0], 0, 0, 0 };
+    int pitches[] = { overlay->pitches[0], 0, 0, 0 };
 
-    /* if zero size, it means the image was buffered */
-    if ( out_size > 0 )
+    if ( format == PIX_FMT_YUV420P )
     {
-        AVPacket pkt;
-        av_init_packet( &pkt );
+        planes[1] = overlay->pixels[u];
+        planes[2] = overlay->pixels[v];
+        pitches[1] = overlay->pitches[u];
+        pitches[2] = overlay->pitches[v];
+    }
 
-        /* set correct stream index for this packet */
-        pkt.stream_index = file->videoStream->_ffmpeg->index;
-        /* set keyframe flag if needed */
-        if ( file->videoStream->_ffmpeg->codec->coded_frame->key_frame ) pkt.flags |= PKT_FLAG_KEY;
-        /* write encoded data into packet */
-        pkt.data = file->videoStream->encodeFrameBuffer;
-        /* set the correct size of this packet */
-        pkt.size = out_size;
-        /* set the correct duration of this packet */
-        pkt.duration = AV_TIME_BASE / file->videoStream->_ffmpeg->time_base.den;
+    int error = SDL_ffmpegAddVideoPicture( file, planes, pitches, overlay->w, overlay->h, format, 0 );
 
-        /* if needed info is available, write pts for this packet */
-        if ( file->videoStream->_ffmpeg->codec->coded_frame->pts != AV_NOPTS_VALUE )
-        {
-            pkt.pts = av_rescale_q( file->videoStream->_ffmpeg->codec->coded_frame->pts, file->videoStream->_ffmpeg->codec->time_base, file->videoStream->_ffmpeg->time_base );
-        }
+    SDL_UnlockYUVOverlay( overlay );
+
+    return error;
+}
 
-        av_write_frame( file->_ffmpeg, &pkt );
 
-        av_free_packet( &pkt );
+/** \brief  Let a separate thread encode video frames.
+
+            Converting, encoding and writing a frame takes a lot longer than
+            copying it. When video is encoded ahead, SDL_ffmpegAddVideoFrame
+            copies the frame to a queue, from which a separate thread converts,
+            encodes and writes it. When the queue is full, adding a frame waits
+            until the oldest frame was encoded. Conversion uses the threads set
+            by SDL_ffmpegSetConversionThreads. SDL_ffmpegFlushVideoEncoder waits
+            until all queued frames were written, SDL_ffmpegFree does so as well.
+\param      file SDL_ffmpegFile to which frames are added.
+\param      frames Amount of frames which can be queued, 0 stops encoding ahead
+            after all queued frames were written.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetVideoEncodeAhead( SDL_ffmpegFile *file, uint32_t frames )
+{
+    if ( !file || file->type != SDL_ffmpegOutputStream )
+    {
+        SDL_ffmpegSetError( "encoding ahead requires an output file" );
+        return -1;
+    }
+
+    /* write all queued frames and stop the current thread */
+    SDL_ffmpegStopEncodeThread( file );
 
-        file->videoStream->frameCount++;
+    /* report frames of the old queue which could not be encoded */
+    if ( !frames ) return SDL_ffmpegEncodeFailed( file );
+
+    file->encodeSlots = ( SDL_ffmpegEncodeSlot* )malloc( frames * sizeof( SDL_ffmpegEncodeSlot ) );
+    if ( !file->encodeSlots )
+    {
+        SDL_ffmpegSetError( "could not allocate encode queue" );
+        return -1;
     }
 
-    SDL_UnlockMutex( file->streamMutex );
+    memset( file->encodeSlots, 0, frames * sizeof( SDL_ffmpegEncodeSlot ) );
+
+    file->encodeCapacity = frames;
+    file->encodeHead = 0;
+    file->encodeCount = 0;
+    file->stopEncoding = 0;
+
+    file->encodeThread = SDL_CreateThread( SDL_ffmpegEncodeThread, file );
+    if ( !file->encodeThread )
+    {
+        SDL_ffmpegStopEncodeThread( file );
+
+        SDL_ffmpegSetError( "could not start encoder thread" );
+        return -1;
+    }
 
     return 0;
 }
 
 
+/** \brief  Wait until all queued video frames were written.
+
+            When video is encoded ahead, this blocks until the encode thread
+            has written every frame which was added before this call.
+\param      file SDL_ffmpegFile to which frames are added.
+\returns    -1 on error, or when a queued frame could not be encoded since
+            this was last reported, otherwise 0
+*/
+int SDL_ffmpegFlushVideoEncoder( SDL_ffmpegFile *file )
+{
+    if ( !file ) return -1;
+
+    if ( !file->encodeThread ) return 0;
+
+    SDL_LockMutex( file->encodeMutex );
+
+    while ( file->encodeCount ) SDL_CondWait( file->encodeCond, file->encodeMutex );
+
+    SDL_UnlockMutex( file->encodeMutex );
+
+    return SDL_ffmpegEncodeFailed( file );
+}
+
+
+/** \brief  Set how much encoded data may be held back to interleave streams.
+
+            Encoded packets of all streams of an output file are queued and
+            written in order of their decoding time, so players can read the
+            file without seeking back and forth. A packet is written as soon as
+            every stream has a packet queued, or when the queue grows beyond one
+            of these limits because an encoder runs ahead of the others.
+            SDL_ffmpegFree writes all packets which are still queued.
+\param      file SDL_ffmpegFile to which frames are added.
+\param      bytes Maximum size of the queued packets, zero for no limit.
+\param      milliseconds Maximum time between the first and last queued packet,
+            zero for no limit.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetInterleaveLimits( SDL_ffmpegFile *file, uint64_t bytes, uint32_t milliseconds )
+{
+    if ( !file || file->type != SDL_ffmpegOutputStream )
+    {
+        SDL_ffmpegSetError( "interleaving requires an output file" );
+        return -1;
+    }
+
+    SDL_LockMutex( file->streamMutex );
+
+    file->muxByteLimit = bytes;
+    file->muxDurationLimit = milliseconds;
+
+    /* the queue may exceed the new limits */
+    int error = SDL_ffmpegWriteMuxQueue( file, 0 );
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return error;
+}
+
+
 /** \brief  Use this to add a SDL_ffmpegAudioFrame to file
 
             By adding frames to file, an audio stream is build. If a video stream
-            is present, syncing of both streams needs to be done by user.
+            is present, the encoded packets of both streams are interleaved by
+            timestamp before they are written, up to the limits set with
+            SDL_ffmpegSetInterleaveLimits.
+            The frame may hold any number of interleaved 16 bit samples, audio
+            which does not fill a complete encoder frame is kept until more
+            audio is added, or until the file is freed. When encoding fails,
+            the error is returned right away; the samples which were not
+            encoded yet, including the rest of frame, stay queued and are
+            encoded by the next call, so frame should not be added again.
 \param      file SDL_ffmpegFile to which a frame needs to be added.
 \param      frame SDL_ffmpegAudioFrame which will be added to the stream.
 \returns    0 if frame was added, non-zero if an error occured.
 */
 int SDL_ffmpegAddAudioFrame( SDL_ffmpegFile *file, SDL_ffmpegAudioFrame *frame )
 {
+    if ( !file ) return -1;
+
     /* when accesing audio/video stream, streamMutex should be locked */
     SDL_LockMutex( file->streamMutex );
 
-    if ( !file  || !file->audioStream || !frame )
+    if ( !file->audioStream || !frame || file->type != SDL_ffmpegOutputStream )
     {
         SDL_UnlockMutex( file->streamMutex );
         return -1;
     }
 
-    AVPacket pkt;
-
-    /* initialize a packet to write */
-    av_init_packet( &pkt );
+    SDL_ffmpegStream *stream = file->audioStream;
+    SDL_ffmpegAudioFifo *fifo = &stream->audioFifo;
 
-    /* set correct stream index for this packet */
-    pkt.stream_index = file->audioStream->_ffmpeg->index;
+    if ( stream->copySource )
+    {
+        SDL_UnlockMutex( file->streamMutex );
 
-    /* set keyframe flag if needed */
-    pkt.flags |= PKT_FLAG_KEY;
+        SDL_ffmpegSetError( "audio stream copies packets and can not encode frames" );
+        return -1;
+    }
 
-    /* set the correct size of this packet */
-    pkt.size = avcodec_encode_audio( file->audioStream->_ffmpeg->codec, ( uint8_t* )file->audioStream->sampleBuffer, file->audioStream->sampleBufferSize, ( int16_t* )frame->buffer );
+    int sampleSize = 2 * stream->_ffmpeg->codec->channels;
 
-    /* write encoded data into packet */
-    pkt.data = ( uint8_t* )file->audioStream->sampleBuffer;
+    /* partial samples can not be encoded */
+    int bytes = frame->size - frame->size % sampleSize;
 
-    /* if needed info is available, write pts for this packet */
-    if ( file->audioStream->_ffmpeg->codec->coded_frame->pts != AV_NOPTS_VALUE )
+    if ( SDL_ffmpegAudioFifoReserve( fifo, bytes ) )
     {
-        pkt.pts = av_rescale_q( file->audioStream->_ffmpeg->codec->coded_frame->pts, file->audioStream->_ffmpeg->codec->time_base, file->audioStream->_ffmpeg->time_base );
+        SDL_UnlockMutex( file->streamMutex );
+        return -1;
     }
 
-    /* write packet to stream */
-    av_write_frame( file->_ffmpeg, &pkt );
+    memcpy( fifo->buffer + fifo->offset + fifo->size, frame->buffer, bytes );
 
-    av_free_packet( &pkt );
+    fifo->size += bytes;
+
+    int frameBytes = stream->encodeAudioInputSize * sampleSize;
+
+    /* encode every complete frame, the remainder waits for more audio */
+    int error = 0;
+    while ( fifo->size >= frameBytes )
+    {
+        error = SDL_ffmpegEncodeAudio( file, stream, ( const int16_t* )( fifo->buffer + fifo->offset ), stream->encodeAudioInputSize );
+
+        /* the frame which failed stays queued, so no audio is lost */
+        if ( error ) break;
+
+        fifo->offset += frameBytes;
+        fifo->size -= frameBytes;
+    }
 
-    file->audioStream->frameCount++;
+    if ( !fifo->size ) fifo->offset = 0;
 
     SDL_UnlockMutex( file->streamMutex );
 
-    return 0;
+    return error;
 }
 
 /** \brief  Use this to create a SDL_ffmpegAudioFrame
@@ -720,7 +1515,8 @@ int SDL_ffmpegAddAudioFrame( SDL_ffmpegFile *file, SDL_ffmpegAudioFrame *frame )
 \param      file SDL_ffmpegFile for which a frame needs to be created
 \param      bytes When current active audio stream is an input stream, this holds
                   the size of the buffer which will be allocated. In case of an
-                  output stream, this value is ignored.
+                  output stream, a value of zero allocates exactly one encoder
+                  frame, any other size is allocated as requested.
 \returns    Pointer to SDL_ffmpegAudioFrame, or NULL if no frame could be created
 */
 SDL_ffmpegAudioFrame* SDL_ffmpegCreateAudioFrame( SDL_ffmpegFile *file, uint32_t bytes )
@@ -738,7 +1534,7 @@ SDL_ffmpegAudioFrame* SDL_ffmpegCreateAudioFrame( SDL_ffmpegFile *file, uint32_t
     SDL_ffmpegAudioFrame *frame = ( SDL_ffmpegAudioFrame* )malloc( sizeof( SDL_ffmpegAudioFrame ) );
     memset( frame, 0, sizeof( SDL_ffmpegAudioFrame ) );
 
-    if ( file->type == SDL_ffmpegOutputStream )
+    if ( file->type == SDL_ffmpegOutputStream && !bytes )
     {
         bytes = file->audioStream->encodeAudioInputSize * 2 * file->audioStream->_ffmpeg->codec->channels;
     }
@@ -761,7 +1557,12 @@ SDL_ffmpegAudioFrame* SDL_ffmpegCreateAudioFrame( SDL_ffmpegFile *file, uint32_t
 /** \brief  Use this to create a SDL_ffmpegVideoFrame
 
             In order to receive video data, either SDL_ffmpegVideoFrame.surface or
-            SDL_ffmpegVideoFrame.overlay need to be set by user.
+            SDL_ffmpegVideoFrame.overlay need to be set by user. Overlays can be
+            of type SDL_YUY2_OVERLAY, SDL_YV12_OVERLAY or SDL_IYUV_OVERLAY, the
+            planar types are filled without conversion when their size matches
+            the size of the video. When neither is
+            set, SDL_ffmpegVideoFrame.data points to the decoded picture, without
+            converting or copying it.
 \returns    Pointer to SDL_ffmpegVideoFrame, or NULL if no frame could be created
 */
 SDL_ffmpegVideoFrame* SDL_ffmpegCreateVideoFrame()
@@ -784,73 +1585,120 @@ SDL_ffmpegVideoFrame* SDL_ffmpegCreateVideoFrame()
 */
 int SDL_ffmpegGetVideoFrame( SDL_ffmpegFile* file, SDL_ffmpegVideoFrame *frame )
 {
+    if ( !frame || !file ) return 0;
+
+    /* when frames are decoded ahead, we only take a frame from the queue */
+    if ( file->decodeThread ) return SDL_ffmpegPopDecodedFrame( file, frame );
+
     /* when accesing audio/video stream, streamMutex should be locked */
     SDL_LockMutex( file->streamMutex );
 
-    if ( !frame || !file || !file->videoStream )
+    if ( !file->videoStream )
     {
         SDL_UnlockMutex( file->streamMutex );
         return 0;
     }
 
-    SDL_LockMutex( file->videoStream->mutex );
+    /* decode a frame and convert it to the format requested by the user */
+    if ( SDL_ffmpegDecodeNextVideoFrame( file, frame ) )
+    {
+        SDL_ffmpegExposeVideoFrame( file->videoStream->decodeFrame->data,
+                                    file->videoStream->decodeFrame->linesize,
+                                    file->videoStream->_ffmpeg->codec->width,
+                                    file->videoStream->_ffmpeg->codec->height,
+                                    file->videoStream->_ffmpeg->codec->pix_fmt,
+                                    frame );
+
+        SDL_ffmpegConvertVideoFrame( file->videoStream,
+                                     ( const uint8_t* const* )file->videoStream->decodeFrame->data,
+                                     file->videoStream->decodeFrame->linesize,
+                                     file->videoStream->_ffmpeg->codec->width,
+                                     file->videoStream->_ffmpeg->codec->height,
+                                     file->videoStream->_ffmpeg->codec->pix_fmt,
+                                     frame );
+    }
 
-    /* assume current frame is empty */
-    frame->ready = 0;
-    frame->last = 0;
+    SDL_UnlockMutex( file->streamMutex );
 
-    /* get new packet */
-    SDL_ffmpegPacket *pack = SDL_ffmpegGetVideoPacket( file );
+    return frame->ready;
+}
 
-    while ( !pack && !frame->last )
-    {
-        pack = SDL_ffmpegGetVideoPacket( file );
 
-        frame->last = SDL_ffmpegGetPacket( file );
-    }
+/** \brief  Use this to release the decoded picture of a SDL_ffmpegVideoFrame.
 
-    while ( pack && !frame->ready )
-    {
-        /* when a frame is received, frame->ready will be set */
-        SDL_ffmpegDecodeVideoFrame( file, pack->data, frame );
+            When a SDL_ffmpegVideoFrame has no surface and no overlay,
+            SDL_ffmpegGetVideoFrame exposes the decoded picture through
+            SDL_ffmpegVideoFrame.data. This function signals the picture is
+            no longer used, after which its planes should not be accessed.
+\param      file SDL_ffmpegFile from which frame was retreived
+\param      frame SDL_ffmpegVideoFrame which holds the decoded picture
+*/
+void SDL_ffmpegReleaseVideoFrame( SDL_ffmpegFile *file, SDL_ffmpegVideoFrame *frame )
+{
+    if ( !file || !frame ) return;
 
-        /* destroy used packet */
-        av_free_packet( pack->data );
+    SDL_LockMutex( file->frameMutex );
 
-        av_free( pack->data );
+    memset( frame->data, 0, sizeof( frame->data ) );
+    memset( frame->linesize, 0, sizeof( frame->linesize ) );
 
-        free( pack );
+    frame->ready = 0;
 
-        pack = SDL_ffmpegGetVideoPacket( file );
+    SDL_UnlockMutex( file->frameMutex );
+}
 
-        while ( !pack && !frame->last )
-        {
-            pack = SDL_ffmpegGetVideoPacket( file );
 
-            frame->last = SDL_ffmpegGetPacket( file );
-        }
-    }
+/** \brief  Let a separate thread decode video frames ahead.
 
-    /* pack retreived, but was not used, push it back in the buffer */
-    if ( pack )
+            Decoding a frame may take considerably longer than average, for
+            example with key frames or right after a seek. When video frames are
+            decoded ahead, these delays are absorbed by a queue of decoded frames.
+            SDL_ffmpegGetVideoFrame will then take the frame with the lowest
+            timestamp from this queue, without waiting for the decoder. When no
+            frame is ready, it returns immediately. Stopping to decode ahead
+            invalidates the planes of a frame without surface or overlay.
+\param      file SDL_ffmpegFile for which frames should be decoded ahead.
+\param      frames Amount of frames to decode ahead, 0 stops decoding ahead.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetVideoDecodeAhead( SDL_ffmpegFile *file, uint32_t frames )
+{
+    if ( !file || file->type != SDL_ffmpegInputStream )
     {
-        /* take current buffer as next pointer */
-        pack->next = file->videoStream->buffer;
-
-        /* store pack as current buffer */
-        file->videoStream->buffer = pack;
+        SDL_ffmpegSetError( "decoding ahead requires an input file" );
+        return -1;
     }
-    else if ( !frame->ready && frame->last )
+
+    /* stop current thread and release its frames */
+    SDL_ffmpegStopDecodeThread( file );
+
+    if ( !frames ) return 0;
+
+    /* the extra frame holds the picture exposed to the user */
+    file->frames = ( SDL_ffmpegDecodedFrame* )malloc(( frames + 1 ) * sizeof( SDL_ffmpegDecodedFrame ) );
+    if ( !file->frames )
     {
-        /* check if there is still a frame in the buffer */
-        SDL_ffmpegDecodeVideoFrame( file, 0, frame );
+        SDL_ffmpegSetError( "could not allocate decoded frame queue" );
+        return -1;
     }
 
-    SDL_UnlockMutex( file->videoStream->mutex );
+    memset( file->frames, 0, ( frames + 1 ) * sizeof( SDL_ffmpegDecodedFrame ) );
 
-    SDL_UnlockMutex( file->streamMutex );
+    file->frameCapacity = frames;
+    file->frameCount = 0;
+    file->decodeEnd = 0;
+    file->stopDecoding = 0;
 
-    return frame->ready;
+    file->decodeThread = SDL_CreateThread( SDL_ffmpegDecodeThread, file );
+    if ( !file->decodeThread )
+    {
+        SDL_ffmpegStopDecodeThread( file );
+
+        SDL_ffmpegSetError( "could not start decoder thread" );
+        return -1;
+    }
+
+    return 0;
 }
 
 
@@ -882,6 +1730,8 @@ SDL_ffmpegStream* SDL_ffmpegGetAudioStream( SDL_ffmpegFile *file, uint32_t audio
             Use this function to select an audio stream for decoding.
             Using SDL_ffmpegGetAudioStream you can get information about the streams.
             Based on that you can chose the stream you want.
+            The decoder of a stream is opened when it gets selected, and
+            closed again when another stream is selected.
 \param      file SDL_ffmpegFile on which an action is required
 \param      audioID is the stream you whish to select. negative values de-select any audio stream.
 \returns    -1 on error, otherwise 0
@@ -902,6 +1752,34 @@ int SDL_ffmpegSelectAudioStream( SDL_ffmpegFile* file, int audioID )
         return -1;
     }
 
+    /* the reader thread should not read while streams are changed */
+    if ( file->readThread ) SDL_LockMutex( file->readMutex );
+
+    /* find stream linked to audioID, negative values select no stream */
+    SDL_ffmpegStream *selected = 0;
+
+    if ( audioID >= 0 )
+    {
+        selected = file->as;
+
+        for ( int i = 0; i < audioID && selected; i++ ) selected = selected->next;
+    }
+
+    int error = 0;
+
+    /* decoders and their buffers are only kept for the selected stream,
+       output streams keep their encoder */
+    if ( file->type == SDL_ffmpegInputStream )
+    {
+        if ( file->audioStream && file->audioStream != selected ) SDL_ffmpegDeactivateStream( file->audioStream );
+
+        if ( selected && SDL_ffmpegActivateStream( selected ) )
+        {
+            selected = 0;
+            error = -1;
+        }
+    }
+
     /* set all audio streams to discard */
     SDL_ffmpegStream *stream = file->as;
 
@@ -912,25 +1790,28 @@ int SDL_ffmpegSelectAudioStream( SDL_ffmpegFile* file, int audioID )
         stream = stream->next;
     }
 
-    if ( audioID < 0 )
-    {
-        /* reset audiostream */
-        file->audioStream = 0;
-    }
-    else
-    {
-        /* set current audiostream to stream linked to audioID */
-        file->audioStream = file->as;
+    /* audio decoded ahead belongs to the previous stream */
+    if ( selected != file->audioStream ) SDL_ffmpegFlushAudioRing( file );
+
+    /* set current audiostream, or reset it */
+    file->audioStream = selected;
+
+    /* active stream need not be discarded */
+    if ( file->audioStream ) file->audioStream->_ffmpeg->discard = AVDISCARD_DEFAULT;
+
+    /* threads waiting for packets stop decoding the previous stream */
+    SDL_ffmpegStreamsChanged( file );
 
-        for ( int i = 0; i < audioID && file->audioStream; i++ ) file->audioStream = file->audioStream->next;
+    if ( file->readThread )
+    {
+        SDL_UnlockMutex( file->readMutex );
 
-        /* active stream need not be discarded */
-        file->audioStream->_ffmpeg->discard = AVDISCARD_DEFAULT;
+        SDL_CondSignal( file->readCond );
     }
 
     SDL_UnlockMutex( file->streamMutex );
 
-    return 0;
+    return error;
 }
 
 
@@ -965,6 +1846,8 @@ SDL_ffmpegStream* SDL_ffmpegGetVideoStream( SDL_ffmpegFile *file, uint32_t video
             Use this function to select a video stream for decoding.
             Using SDL_ffmpegGetVideoStream you can get information about the streams.
             Based on that you can chose the stream you want.
+            The decoder of a stream is opened when it gets selected, and
+            closed again when another stream is selected.
 \param      file SDL_ffmpegFile on which an action is required
 \param      videoID is the stream you whish to select.
 \returns    -1 on error, otherwise 0
@@ -986,6 +1869,41 @@ int SDL_ffmpegSelectVideoStream( SDL_ffmpegFile* file, int videoID )
         return -1;
     }
 
+    /* the reader thread should not read while streams are changed */
+    if ( file->readThread ) SDL_LockMutex( file->readMutex );
+
+    /* frames decoded ahead belong to the previous stream */
+    SDL_LockMutex( file->frameMutex );
+
+    file->frameCount = 0;
+    file->decodeEnd = 0;
+
+    /* find stream linked to videoID, negative values select no stream */
+    SDL_ffmpegStream *selected = 0;
+
+    if ( videoID >= 0 )
+    {
+        selected = file->vs;
+
+        /* keep searching for correct videostream */
+        for ( int i = 0; i < videoID && selected; i++ ) selected = selected->next;
+    }
+
+    int error = 0;
+
+    /* decoders and their buffers are only kept for the selected stream,
+       output streams keep their encoder */
+    if ( file->type == SDL_ffmpegInputStream )
+    {
+        if ( file->videoStream && file->videoStream != selected ) SDL_ffmpegDeactivateStream( file->videoStream );
+
+        if ( selected && SDL_ffmpegActivateStream( selected ) )
+        {
+            selected = 0;
+            error = -1;
+        }
+    }
+
     /* set all video streams to discard */
     SDL_ffmpegStream *stream = file->vs;
 
@@ -996,31 +1914,36 @@ int SDL_ffmpegSelectVideoStream( SDL_ffmpegFile* file, int videoID )
         stream = stream->next;
     }
 
-    if ( videoID < 0 )
-    {
-        /* reset videostream */
-        file->videoStream = 0;
-    }
-    else
-    {
-        /* set current videostream to stream linked to videoID */
-        file->videoStream = file->vs;
+    /* set current videostream, or reset it */
+    file->videoStream = selected;
 
-        /* keep searching for correct videostream */
-        for ( int i = 0; i < videoID && file->videoStream; i++ ) file->videoStream = file->videoStream->next;
+    /* active stream need not be discarded */
+    if ( file->videoStream ) file->videoStream->_ffmpeg->discard = AVDISCARD_DEFAULT;
+
+    /* threads waiting for packets stop decoding the previous stream */
+    SDL_ffmpegStreamsChanged( file );
+
+    SDL_CondSignal( file->frameCond );
+
+    SDL_UnlockMutex( file->frameMutex );
+
+    if ( file->readThread )
+    {
+        SDL_UnlockMutex( file->readMutex );
 
-        /* active stream need not be discarded */
-        file->videoStream->_ffmpeg->discard = AVDISCARD_DEFAULT;
+        SDL_CondSignal( file->readCond );
     }
 
     SDL_UnlockMutex( file->streamMutex );
 
-    return 0;
+    return error;
 }
 
 /** \brief  Seek to a certain point in file.
 
-            Tries to seek to specified point in file.
+            Tries to seek to specified point in file. Audio starts at the
+            first sample at or after timestamp, the timestamps of following
+            audio frames are counted from there in samples.
 \param      file SDL_ffmpegFile on which an action is required
 \param      timestamp is represented in milliseconds.
 \returns    -1 on error, otherwise 0
@@ -1036,17 +1959,15 @@ int SDL_ffmpegSeek( SDL_ffmpegFile* file, uint64_t timestamp )
         return -1;
     }
 
-    /* convert milliseconds to AV_TIME_BASE units */
-    uint64_t seekPos = timestamp * ( AV_TIME_BASE / 1000 );
+    /* when accesing audio/video stream, streamMutex should be locked */
+    SDL_LockMutex( file->streamMutex );
 
-    /* AVSEEK_FLAG_BACKWARD means we jump to the first keyframe before seekPos */
-    av_seek_frame( file->_ffmpeg, -1, seekPos, AVSEEK_FLAG_BACKWARD );
+    SDL_ffmpegSeekStreams( file, timestamp );
 
-    /* set minimal timestamp to decode */
-    file->minimalTimestamp = timestamp;
+    /* audio which was decoded ahead belongs to the old position */
+    SDL_ffmpegFlushAudioRing( file );
 
-    /* flush buffers */
-    SDL_ffmpegFlush( file );
+    SDL_UnlockMutex( file->streamMutex );
 
     return 0;
 }
@@ -1075,27 +1996,70 @@ int SDL_ffmpegFlush( SDL_ffmpegFile *file )
     /* when accesing audio/video stream, streamMutex should be locked */
     SDL_LockMutex( file->streamMutex );
 
-    /* if we have a valid audio stream, we flush it */
-    if ( file->audioStream )
+    SDL_ffmpegFlushStreams( file );
+
+    /* audio which was decoded ahead is no longer valid */
+    SDL_ffmpegFlushAudioRing( file );
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return 0;
+}
+
+void SDL_ffmpegSeekStreams( SDL_ffmpegFile *file, uint64_t timestamp )
+{
+    /* entering this function, streamMutex should have been locked */
+
+    /* convert milliseconds to AV_TIME_BASE units */
+    uint64_t seekPos = timestamp * ( AV_TIME_BASE / 1000 );
+
+    /* the reader thread should not read while we seek */
+    if ( file->readThread ) SDL_LockMutex( file->readMutex );
+
+    /* AVSEEK_FLAG_BACKWARD means we jump to the first keyframe before seekPos */
+    av_seek_frame( file->_ffmpeg, -1, seekPos, AVSEEK_FLAG_BACKWARD );
+
+    /* set minimal timestamp to decode */
+    file->minimalTimestamp = timestamp;
+
+    /* flush buffers */
+    SDL_ffmpegFlushStreams( file );
+
+    if ( file->readThread )
     {
-        SDL_LockMutex( file->audioStream->mutex );
+        /* there is data to be read again */
+        file->endOfFile = 0;
 
-        SDL_ffmpegPacket *pack = file->audioStream->buffer;
+        SDL_UnlockMutex( file->readMutex );
 
-        while ( pack )
-        {
-            SDL_ffmpegPacket *old = pack;
+        SDL_CondSignal( file->readCond );
+    }
+}
 
-            pack = pack->next;
+void SDL_ffmpegFlushStreams( SDL_ffmpegFile *file )
+{
+    /* entering this function, streamMutex should have been locked */
 
-            av_free_packet( old->data );
+    /* threads waiting for packets of the old position stop decoding */
+    SDL_ffmpegStreamsChanged( file );
 
-            av_free( old->data );
+    /* if we have a valid audio stream, we flush it */
+    if ( file->audioStream )
+    {
+        SDL_LockMutex( file->audioStream->mutex );
 
-            free( old );
-        }
+        SDL_ffmpegQueueFlush( file->audioStream );
 
-        file->audioStream->buffer = 0;
+        /* decoded audio belongs to the old position */
+        SDL_ffmpegAudioFifo *fifo = &file->audioStream->audioFifo;
+
+        fifo->offset = 0;
+        fifo->size = 0;
+        fifo->pts = AV_NOPTS_VALUE;
+        fifo->consumed = 0;
+        fifo->skip = 0;
+
+        SDL_ffmpegAudioConverterReset( &file->audioStream->audioConverter );
 
         /* flush internal ffmpeg buffers */
         if ( file->audioStream->_ffmpeg )
@@ -1111,22 +2075,7 @@ int SDL_ffmpegFlush( SDL_ffmpegFile *file )
     {
         SDL_LockMutex( file->videoStream->mutex );
 
-        SDL_ffmpegPacket *pack = file->videoStream->buffer;
-
-        while ( pack )
-        {
-            SDL_ffmpegPacket *old = pack;
-
-            pack = pack->next;
-
-            av_free_packet( old->data );
-
-            av_free( old->data );
-
-            free( old );
-        }
-
-        file->videoStream->buffer = 0;
+        SDL_ffmpegQueueFlush( file->videoStream );
 
         /* flush internal ffmpeg buffers */
         if ( file->videoStream->_ffmpeg ) avcodec_flush_buffers( file->videoStream->_ffmpeg->codec );
@@ -1134,9 +2083,18 @@ int SDL_ffmpegFlush( SDL_ffmpegFile *file )
         SDL_UnlockMutex( file->videoStream->mutex );
     }
 
-    SDL_UnlockMutex( file->streamMutex );
+    /* buffers are empty, so the reader thread can continue */
+    if ( file->readThread ) SDL_CondSignal( file->readCond );
 
-    return 0;
+    /* frames which were decoded ahead are no longer valid */
+    SDL_LockMutex( file->frameMutex );
+
+    file->frameCount = 0;
+    file->decodeEnd = 0;
+
+    SDL_CondSignal( file->frameCond );
+
+    SDL_UnlockMutex( file->frameMutex );
 }
 /**
 \endcond
@@ -1150,6 +2108,10 @@ int SDL_ffmpegFlush( SDL_ffmpegFile *file )
             I you use data from the frame, you should adjust the size member by
             the amount of data used in bytes. This is needed so that SDL_ffmpeg can
             calculate the next frame.
+            The data is stored in the format set by SDL_ffmpegSetAudioOutput and
+            the layout set by SDL_ffmpegSetAudioLayout. A planar frame holds
+            size / channels bytes per channel, so the capacity of the frame
+            should be a multiple of the size of a sample for every channel.
 \param      file SDL_ffmpegFile from which the information is required
 \param      frame The frame to which the data will be decoded.
 \returns    Pointer to SDL_ffmpegAudioFrame, or NULL if no frame was available.
@@ -1161,1041 +2123,5895 @@ int SDL_ffmpegGetAudioFrame( SDL_ffmpegFile *file, SDL_ffmpegAudioFrame *frame )
     /* when accesing audio/video stream, streamMutex should be locked */
     SDL_LockMutex( file->streamMutex );
 
-    if ( !file->audioStream )
+    int full = SDL_ffmpegReadAudioFrame( file, frame );
+
+    /* the frame is reordered once it holds all data it is going to get */
+    if ( file->audioStream && file->audioOutput.layout == SDL_ffmpegAudioPlanar && frame->size )
     {
-        SDL_UnlockMutex( file->streamMutex );
+        int rate, channels;
+        uint16_t format;
 
-        SDL_ffmpegSetError( "no valid audio stream selected" );
-        return 0;
+        SDL_ffmpegAudioOutputSpec( file, &rate, &channels, &format );
+
+        SDL_ffmpegAudioDeinterleave( &file->audioStream->audioConverter, frame, channels, SDL_ffmpegAudioBytesPerSample( format ) );
     }
 
-    /* lock audio buffer */
-    SDL_LockMutex( file->audioStream->mutex );
+    SDL_UnlockMutex( file->streamMutex );
 
-    /* reset frame end pointer and size */
-    frame->last = 0;
-    frame->size = 0;
+    return full;
+}
 
-    /* get new packet */
-    SDL_ffmpegPacket *pack = SDL_ffmpegGetAudioPacket( file );
 
-    while ( !pack && !frame->last )
+/** \brief  Let a separate thread decode audio ahead.
+
+            Audio of the selected audio stream is decoded into a ring buffer,
+            from which SDL_ffmpegAudioCallback copies data without taking any
+            lock. Seeking, flushing or selecting another audio stream discards
+            the data in the ring buffer. While audio is decoded ahead, the user
+            should not call SDL_ffmpegGetAudioFrame on the same file.
+\param      file SDL_ffmpegFile for which audio should be decoded ahead.
+\param      bytes Amount of bytes to decode ahead, rounded up to a power of two,
+            0 stops decoding ahead. The audio device must be closed or paused
+            before decoding ahead is stopped.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetAudioDecodeAhead( SDL_ffmpegFile *file, uint32_t bytes )
+{
+    if ( !file || file->type != SDL_ffmpegInputStream )
     {
-        pack = SDL_ffmpegGetAudioPacket( file );
+        SDL_ffmpegSetError( "decoding ahead requires an input file" );
+        return -1;
+    }
 
-        frame->last = SDL_ffmpegGetPacket( file );
+    /* stop current thread and release its buffer */
+    SDL_ffmpegStopAudioThread( file );
+
+    if ( !bytes ) return 0;
+
+    if ( bytes > 0x40000000 )
+    {
+        SDL_ffmpegSetError( "audio ring buffer is too large" );
+        return -1;
     }
 
-    /* SDL_ffmpegDecodeAudioFrame will return true if data from pack was used
-       frame will be updated with the new data */
-    while ( pack && SDL_ffmpegDecodeAudioFrame( file, pack->data, frame ) )
+    /* positions wrap around, which only works for a size which is a power of two */
+    uint32_t size = SDL_FFMPEG_AUDIO_CHUNK;
+
+    while ( size < bytes ) size <<= 1;
+
+    SDL_ffmpegAudioRing *ring = &file->audioRing;
+
+    memset( ring, 0, sizeof( SDL_ffmpegAudioRing ) );
+
+    ring->buffer = ( uint8_t* )av_malloc( size );
+    if ( !ring->buffer )
     {
-        /* destroy used packet */
-        av_free_packet( pack->data );
+        SDL_ffmpegSetError( "could not allocate audio ring buffer" );
+        return -1;
+    }
 
-        av_free( pack->data );
+    ring->size = size;
 
-        free( pack );
+    file->stopAudio = 0;
 
-        pack = 0;
+    file->audioSource = file;
 
-        /* check if new packet is required */
-        if ( frame->size < frame->capacity )
+    file->audioThread = SDL_CreateThread( SDL_ffmpegAudioThread, file );
+    if ( !file->audioThread )
+    {
+        SDL_ffmpegStopAudioThread( file );
+
+        SDL_ffmpegSetError( "could not start audio thread" );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/** \brief  Audio callback which plays audio decoded ahead.
+
+            This function can be passed to SDL_ffmpegGetAudioSpec, which sets
+            the file as userdata. It copies the data which was decoded ahead
+            by SDL_ffmpegSetAudioDecodeAhead to the output, and fills the
+            remainder with silence when not enough data is available. It never
+            blocks, so it is safe to use from the SDL audio thread.
+\param      userdata SDL_ffmpegFile from which audio is played
+\param      stream buffer which receives the audio data
+\param      length size of stream in bytes
+*/
+void SDL_ffmpegAudioCallback( void *userdata, Uint8 *stream, int length )
+{
+    SDL_ffmpegFile *file = ( SDL_ffmpegFile* )userdata;
+
+    uint32_t used = 0;
+
+    if ( file && file->audioRing.buffer && length > 0 )
+    {
+        SDL_ffmpegAudioRing *ring = &file->audioRing;
+
+        /* skip data which was written before the last flush */
+        uint32_t request = ring->flushRequest;
+
+        if ( request != ring->flushSeen )
         {
-            /* try to get a new packet */
-            pack = SDL_ffmpegGetAudioPacket( file );
+            SDL_ffmpegMemoryBarrier();
 
-            while ( !pack && !frame->last )
-            {
-                pack = SDL_ffmpegGetAudioPacket( file );
+            uint32_t position = ring->flushPosition;
 
-                frame->last = SDL_ffmpegGetPacket( file );
-            }
+            if ( ( int32_t )( position - ring->tail ) > 0 ) ring->tail = position;
+
+            ring->flushSeen = request;
         }
+
+        used = SDL_ffmpegRingRead( ring, stream, length );
     }
 
-    /* pack retreived, but was not used, push it back in the buffer */
-    if ( pack )
-    {
-        /* take current buffer as next pointer */
-        pack->next = file->audioStream->buffer;
+    /* not enough data was decoded, play silence */
+    if ( ( int )used < length ) memset( stream + used, 0, length - used );
+}
 
-        /* store pack as current buffer */
-        file->audioStream->buffer = pack;
-    }
 
-    /* unlock audio buffer */
-    SDL_UnlockMutex( file->audioStream->mutex );
+/** \brief  Returns the timestamp of the audio last passed to the audio device.
 
-    SDL_UnlockMutex( file->streamMutex );
+            This is the position of the data which SDL_ffmpegAudioCallback
+            will play next, which is useful for synchronizing video to audio.
+\param      file SDL_ffmpegFile from which the information is required
+\returns    -1 when no audio is decoded ahead or no timestamp is known, otherwise the timestamp in milliseconds
+*/
+int64_t SDL_ffmpegGetAudioPosition( SDL_ffmpegFile *file )
+{
+    if ( !file || !file->audioRing.buffer ) return -1;
 
-    return ( frame->size == frame->capacity );
+    SDL_ffmpegAudioRing *ring = &file->audioRing;
+
+    SDL_ffmpegAudioTime time;
+
+    if ( SDL_ffmpegRingGetTime( ring, &time ) || !time.bytesPerSecond ) return -1;
+
+    return time.pts + ( int64_t )( int32_t )( ring->tail - time.position ) * 1000 / time.bytesPerSecond;
 }
 
 
-/** \brief  Returns the current position of the file in milliseconds.
+/** \brief  Check if all audio which was decoded ahead was played.
 
 \param      file SDL_ffmpegFile from which the information is required
-\returns    -1 on error, otherwise the length of the file in milliseconds
+\returns    non-zero when the last audio of the stream was passed to the audio device, otherwise 0
 */
-int64_t SDL_ffmpegGetPosition( SDL_ffmpegFile *file )
+int SDL_ffmpegAudioEnded( SDL_ffmpegFile *file )
+{
+    if ( !file || !file->audioRing.buffer ) return 0;
+
+    SDL_ffmpegAudioRing *ring = &file->audioRing;
+
+    return ring->last && ring->tail == ring->head;
+}
+
+
+/** \brief  Let audio which is decoded ahead start over when it ends.
+
+            When the audio stream ends and no file is queued, the audio thread
+            seeks back to the start and writes the new audio directly after
+            the last samples, so the loop plays without a gap. The timestamps
+            of SDL_ffmpegGetAudioPosition start over as well. Seeking back
+            moves all streams of a file, so audio can only loop while no video
+            stream is selected; a file which selects a video stream later on
+            stops at the end. Encoder delay and padding are not trimmed, so
+            codecs which prime their output, like MP3 and AAC, play a short
+            silence at every loop; PCM and FLAC loop gaplessly.
+\param      file SDL_ffmpegFile of which the audio is decoded ahead
+\param      loop non-zero to loop, 0 to stop at the end
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetAudioLoop( SDL_ffmpegFile *file, int loop )
 {
     if ( !file ) return -1;
 
-    /* when accesing audio/video stream, streamMutex should be locked */
+    /* the audio thread checks this value while streamMutex is locked */
     SDL_LockMutex( file->streamMutex );
 
-    int64_t pos = 0;
-
-    if ( file->audioStream )
+    if ( loop && file->videoStream )
     {
-        pos = file->audioStream->lastTimeStamp;
+        SDL_UnlockMutex( file->streamMutex );
+
+        SDL_ffmpegSetError( "audio can not loop while a video stream is selected" );
+        return -1;
     }
 
-    if ( file->videoStream && file->videoStream->lastTimeStamp > pos )
+    file->audioLoop = loop;
+
+    /* a thread which reached the end should continue */
+    if ( loop && file->audioThread && file->audioRing.last )
     {
-        pos = file->videoStream->lastTimeStamp;
+        if ( SDL_ffmpegSpliceAudio( file ) ) file->audioRing.last = 0;
     }
 
+    SDL_CondSignal( file->audioCond );
+
     SDL_UnlockMutex( file->streamMutex );
 
-    /* return the current playposition of our file */
-    return pos;
+    return 0;
 }
 
 
-/** \brief  Returns the frame rate of the stream as a fraction.
+/** \brief  Queue a file of which the audio follows the audio of file.
+
+            When the audio which is decoded ahead for file ends, the audio
+            thread continues with the selected audio stream of next. Its audio
+            is converted to the output format of file and written directly
+            after the last samples, so both play without a gap. Files can be
+            queued after each other, SDL_ffmpegGetPlayingFile tells which one
+            is heard. A queued file is not freed by SDL_ffmpeg, it should stay
+            valid until it was played, and should not be used by the user in
+            the meantime. Seeking or flushing file returns playback to file,
+            files which were queued but not yet played stay queued. Encoder
+            delay and padding are not trimmed, so codecs which prime their
+            output, like MP3 and AAC, leave a short silence between the files;
+            PCM and FLAC follow each other without a gap.
+\param      file SDL_ffmpegFile of which the audio is decoded ahead
+\param      next SDL_ffmpegFile with a selected audio stream
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegQueueAudioFile( SDL_ffmpegFile *file, SDL_ffmpegFile *next )
+{
+    if ( !file || !next || next == file || next->type != SDL_ffmpegInputStream || next->audioThread || !SDL_ffmpegValidAudio( next ) )
+    {
+        SDL_ffmpegSetError( "file can not be queued" );
+        return -1;
+    }
 
-            This retreives the frame rate of the supplied stream.
-            For example, a framerate of 25 frames per second will have a nominator
-            of 1, and a denominator of 25.
-\param      stream SDL_ffmpegStream from which the information is required.
-\param      nominator Nominator part of the fraction. Can be 0 if exact value of
-                      nominator is not required.
-\param      denominator Denominator part of the fraction. Can be 0 if exact value
-                        of denominator is not required.
-\returns    The result of nominator / denominator as floating point value.
-*/
-float SDL_ffmpegGetFrameRate( SDL_ffmpegStream *stream, int *nominator, int *denominator )
-{
-    if ( stream && stream->_ffmpeg && stream->_ffmpeg->codec )
-    {
-        if ( nominator ) *nominator = stream->_ffmpeg->r_frame_rate.num;
+    /* the queue is walked by the audio thread while streamMutex is locked */
+    SDL_LockMutex( file->streamMutex );
 
-        if ( denominator ) *denominator = stream->_ffmpeg->r_frame_rate.den;
+    SDL_ffmpegFile *last = file->audioSource ? file->audioSource : file;
 
-        return ( float )stream->_ffmpeg->r_frame_rate.num / stream->_ffmpeg->r_frame_rate.den;
-    }
-    else
+    while ( last->nextAudioFile && last != next ) last = last->nextAudioFile;
+
+    if ( last == next || next->nextAudioFile )
     {
-        SDL_ffmpegSetError( "could not retreive frame rate from stream" );
+        SDL_UnlockMutex( file->streamMutex );
 
-        if ( nominator ) *nominator = 0;
+        SDL_ffmpegSetError( "file is queued already" );
+        return -1;
+    }
 
-        if ( denominator ) *denominator = 0;
+    last->nextAudioFile = next;
+
+    /* a thread which reached the end should continue */
+    if ( file->audioThread && file->audioRing.last )
+    {
+        if ( SDL_ffmpegSpliceAudio( file ) ) file->audioRing.last = 0;
     }
 
-    return 0.0;
+    SDL_CondSignal( file->audioCond );
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return 0;
 }
 
-/** \brief  This can be used to get a SDL_AudioSpec based on values found in file
 
-            This returns a SDL_AudioSpec, if you have selected a valid audio
-            stream. Otherwise, all values are set to NULL.
-\param      file SDL_ffmpegFile from which the information is required
-\param      samples Amount of samples required every time the callback is called.
-            Lower values mean less latency, but please note that SDL has a minimal value.
-\param      callback Pointer to callback function
-\returns    SDL_AudioSpec with values set according to the selected audio stream.
-            If no valid audio stream was available, all values of returned SDL_AudioSpec are set to 0
+/** \brief  Returns the file of which the audio was last passed to the audio device.
+
+\param      file SDL_ffmpegFile of which the audio is decoded ahead
+\returns    file itself or a file which was queued after it, NULL when no audio is decoded ahead
 */
-SDL_AudioSpec SDL_ffmpegGetAudioSpec( SDL_ffmpegFile *file, uint16_t samples, SDL_ffmpegCallback callback )
+SDL_ffmpegFile* SDL_ffmpegGetPlayingFile( SDL_ffmpegFile *file )
 {
-    /* create audio spec */
-    SDL_AudioSpec spec;
+    if ( !file || !file->audioRing.buffer ) return 0;
 
-    memset( &spec, 0, sizeof( SDL_AudioSpec ) );
+    SDL_ffmpegAudioTime time;
+
+    if ( SDL_ffmpegRingGetTime( &file->audioRing, &time ) ) return file;
+
+    return time.file;
+}
 
-    if ( !file ) return spec;
+
+/** \brief  Decode the selected audio stream to the end of the file.
+
+            All audio from the current position up to the end of the file is
+            decoded and handed to sink in large contiguous blocks, in the
+            format set by SDL_ffmpegSetAudioOutput. The file is only locked
+            while a packet is decoded and sink is called without locks held,
+            so other threads can use file meanwhile. Draining stops when the
+            streams of file are flushed or changed, for example by seeking.
+            Blocks are always interleaved and are only valid during the call
+            to sink.
+            Audio can not be drained while it is decoded ahead. While
+            draining, packets of the selected video stream are discarded
+            instead of being buffered, so memory use does not grow with the
+            length of the file. Video frames of the drained part are lost.
+\param      file SDL_ffmpegFile from which the audio is extracted
+\param      sink function which receives every block, with the timestamp of
+            its first sample in milliseconds. Returning a value other than 0
+            stops draining.
+\param      userdata passed to sink unchanged
+\returns    amount of bytes handed to sink, or -1 on error
+*/
+int64_t SDL_ffmpegDrainAudio( SDL_ffmpegFile *file, SDL_ffmpegAudioSink sink, void *userdata )
+{
+    if ( !file || !sink || file->type != SDL_ffmpegInputStream ) return -1;
 
     /* when accesing audio/video stream, streamMutex should be locked */
     SDL_LockMutex( file->streamMutex );
 
-    /* if we have a valid audiofile, we can use its data to create a
-       more appropriate audio spec */
-    if ( file->audioStream )
+    if ( !file->audioStream )
     {
-        spec.format = AUDIO_S16SYS;
-        spec.samples = samples;
-        spec.userdata = file;
-        spec.callback = callback;
-        spec.freq = file->audioStream->_ffmpeg->codec->sample_rate;
-        spec.channels = ( uint8_t )file->audioStream->_ffmpeg->codec->channels;
+        SDL_UnlockMutex( file->streamMutex );
+
+        SDL_ffmpegSetError( "no valid audio stream selected" );
+        return -1;
     }
-    else
+
+    if ( file->audioThread )
     {
-        SDL_ffmpegSetError( "no valid audio stream selected" );
+        SDL_UnlockMutex( file->streamMutex );
+
+        SDL_ffmpegSetError( "audio is decoded ahead" );
+        return -1;
     }
 
-    SDL_UnlockMutex( file->streamMutex );
+    SDL_ffmpegStream *stream = file->audioStream;
+    SDL_ffmpegAudioFifo *fifo = &stream->audioFifo;
 
-    return spec;
-}
+    /* only audio is read, so video packets do not pile up in memory */
+    SDL_ffmpegStream *video = file->videoStream;
 
+    if ( video )
+    {
+        /* the reader thread should not read while streams are changed */
+        if ( file->readThread ) SDL_LockMutex( file->readMutex );
 
-/** \brief  Returns the Duration of the file in milliseconds.
+        video->_ffmpeg->discard = AVDISCARD_ALL;
 
-            Please note that this value is guestimated by FFmpeg, it may differ from
-            actual playing time.
-\param      file SDL_ffmpegFile from which the information is required
-\returns    -1 on error, otherwise the length of the file in milliseconds
-*/
-uint64_t SDL_ffmpegDuration( SDL_ffmpegFile *file )
-{
-    if ( !file ) return 0;
+        SDL_LockMutex( video->mutex );
 
-    if ( file->type == SDL_ffmpegInputStream )
-    {
-        /* returns the duration of the entire file, please note that ffmpeg doesn't
-           always get this value right! so don't bet your life on it... */
-        return file->_ffmpeg->duration / ( AV_TIME_BASE / 1000 );
-    }
+        SDL_ffmpegQueueFlush( video );
 
-    if ( file->type == SDL_ffmpegOutputStream )
-    {
-        uint64_t v = SDL_ffmpegVideoDuration( file );
-        uint64_t a = SDL_ffmpegAudioDuration( file );
+        SDL_UnlockMutex( video->mutex );
 
-        if ( v > a ) return v;
-        return a;
+        if ( file->readThread ) SDL_UnlockMutex( file->readMutex );
     }
 
-    return 0;
-}
-
+    /* draining ends when another thread flushes or changes the streams */
+    uint32_t generation = file->streamGeneration;
 
-/** \brief  Returns the duration of the audio stream in milliseconds.
+    SDL_UnlockMutex( file->streamMutex );
 
-            This value can be used to sync two output streams.
-\param      file SDL_ffmpegFile from which the information is required
-\returns    -1 on error, otherwise the length of the file in milliseconds
-*/
-uint64_t SDL_ffmpegAudioDuration( SDL_ffmpegFile *file )
-{
-    if ( !file ) return 0;
+    /* the fifo decodes into one buffer while sink reads the other */
+    uint8_t *spare = 0;
+    int spareCapacity = 0;
 
-    /* when accesing audio/video stream, streamMutex should be locked */
-    SDL_LockMutex( file->streamMutex );
+    int64_t total = 0;
 
-    uint64_t duration = 0;
+    int last = 0,
+        stop = 0;
 
-    if ( !file->audioStream )
+    while ( !stop )
     {
-        if ( file->type == SDL_ffmpegInputStream )
-        {
-            duration = av_rescale( 1000 * file->audioStream->_ffmpeg->duration, file->audioStream->_ffmpeg->time_base.num, file->audioStream->_ffmpeg->time_base.den );
-        }
-        else if ( file->type == SDL_ffmpegOutputStream )
+        /* the file is only locked for a single decode step */
+        SDL_LockMutex( file->streamMutex );
+
+        if ( generation != file->streamGeneration || file->audioThread )
         {
-            duration = file->audioStream->frameCount * file->audioStream->encodeAudioInputSize / ( file->audioStream->_ffmpeg->codec->sample_rate / 1000 );
+            SDL_UnlockMutex( file->streamMutex );
+            break;
         }
-    }
-    else
-    {
-        SDL_ffmpegSetError( "no valid audio stream selected" );
-    }
 
-    SDL_UnlockMutex( file->streamMutex );
+        /* decoded audio collects in the fifo until a block is complete */
+        if ( fifo->size < SDL_FFMPEG_AUDIO_DRAIN_BLOCK )
+        {
+            SDL_ffmpegPacket *pack = SDL_ffmpegGetAudioPacket( file );
 
-    return duration;
-}
+            while ( !pack && !last )
+            {
+                last = SDL_ffmpegFetchPacket( file, stream );
 
+                /* streams were changed while waiting for a packet */
+                if ( last < 0 ) break;
 
-/** \brief  Returns the duration of the video stream in milliseconds.
+                pack = SDL_ffmpegGetAudioPacket( file );
+            }
 
-            This value can be used to sync two output streams.
-\param      file SDL_ffmpegFile from which the information is required
-\returns    -1 on error, otherwise the length of the file in milliseconds
-*/
-uint64_t SDL_ffmpegVideoDuration( SDL_ffmpegFile *file )
-{
-    if ( !file ) return 0;
+            if ( pack )
+            {
+                SDL_ffmpegDecodeAudioPacket( file, pack->data );
 
-    /* when accesing audio/video stream, streamMutex should be locked */
-    SDL_LockMutex( file->streamMutex );
+                SDL_ffmpegReleasePacket( pack );
 
-    uint64_t duration = 0;
+                SDL_UnlockMutex( file->streamMutex );
+                continue;
+            }
+        }
 
-    if ( file->videoStream )
-    {
-        if ( file->type == SDL_ffmpegInputStream )
+        if ( !fifo->size || last < 0 )
         {
-            duration = av_rescale( 1000 * file->videoStream->_ffmpeg->duration, file->videoStream->_ffmpeg->time_base.num, file->videoStream->_ffmpeg->time_base.den );
+            SDL_UnlockMutex( file->streamMutex );
+            break;
         }
-        else if ( file->type == SDL_ffmpegOutputStream )
+
+        int64_t pts = fifo->pts;
+
+        if ( fifo->pts != AV_NOPTS_VALUE && fifo->bytesPerSecond > 0 )
         {
-            duration = av_rescale( 1000 * file->videoStream->frameCount, file->videoStream->_ffmpeg->codec->time_base.num, file->videoStream->_ffmpeg->codec->time_base.den );
+            pts += ( int64_t )( fifo->consumed * 1000 / fifo->bytesPerSecond );
         }
+
+        /* the block is handed out in the buffer it was decoded in, without
+           a copy, and the fifo continues in the buffer of the previous block */
+        uint8_t *buffer = fifo->buffer;
+        int capacity = fifo->capacity;
+
+        uint8_t *block = fifo->buffer + fifo->offset;
+        uint32_t size = fifo->size;
+
+        fifo->buffer = spare;
+        fifo->capacity = spareCapacity;
+
+        fifo->consumed += size;
+        fifo->offset = 0;
+        fifo->size = 0;
+
+        SDL_UnlockMutex( file->streamMutex );
+
+        stop = sink( userdata, block, size, pts );
+
+        total += size;
+
+        spare = buffer;
+        spareCapacity = capacity;
     }
-    else
+
+    SDL_LockMutex( file->streamMutex );
+
+    /* a video stream which was selected meanwhile is left as it is */
+    if ( video && video == file->videoStream )
     {
-        SDL_ffmpegSetError( "no valid video stream selected" );
+        if ( file->readThread ) SDL_LockMutex( file->readMutex );
+
+        video->_ffmpeg->discard = AVDISCARD_DEFAULT;
+
+        /* packets which arrived before the stream was discarded belong to another position */
+        SDL_LockMutex( video->mutex );
+
+        SDL_ffmpegQueueFlush( video );
+
+        SDL_UnlockMutex( video->mutex );
+
+        if ( file->readThread ) SDL_UnlockMutex( file->readMutex );
     }
 
     SDL_UnlockMutex( file->streamMutex );
 
-    return duration;
+    av_free( spare );
+
+    return total;
 }
 
-/** \brief  retreive the width/height of a frame beloning to file
 
-            With this function you can get the width and height of a frame, belonging to
-            your file. If there is no (valid) videostream selected w and h default
-            to 0. Please not that you will have to make sure the pointers are
-            allocated.
+/** \brief  Decode the selected audio stream to the end of the file, into a file.
 
-\param      file SDL_ffmpegFile from which the information is required
-\param      w width
-\param      h height
-\returns    -1 on error, otherwise 0
+            Works like SDL_ffmpegDrainAudio, every block is written to output.
+\param      file SDL_ffmpegFile from which the audio is extracted
+\param      output FILE to which the audio is written, opened in binary mode
+\returns    amount of bytes written, or -1 on error
 */
-int SDL_ffmpegGetVideoSize( SDL_ffmpegFile *file, int *w, int *h )
+int64_t SDL_ffmpegDrainAudioToFile( SDL_ffmpegFile *file, FILE *output )
 {
-    if ( !file || !w || !h ) return -1;
+    if ( !output ) return -1;
 
-    /* when accesing audio/video stream, streamMutex should be locked */
-    SDL_LockMutex( file->streamMutex );
+    int64_t total = SDL_ffmpegDrainAudio( file, SDL_ffmpegFileSink, output );
 
-    /* if we have a valid video file selected, we use it
-       if not, we send default values and return.
-       by checking the return value you can check if you got a valid size */
-    if ( file->videoStream )
+    if ( total >= 0 && ferror( output ) )
     {
-        *w = file->videoStream->_ffmpeg->codec->width;
-        *h = file->videoStream->_ffmpeg->codec->height;
+        SDL_ffmpegSetError( "could not write audio to file" );
+        return -1;
+    }
 
-        SDL_UnlockMutex( file->streamMutex );
+    return total;
+}
+
+
+/** \brief  Create a mixer which plays multiple files on a single device.
 
+            The mixer produces AUDIO_S16SYS samples at the given rate and
+            amount of channels. Audio of every source is converted to this
+            format while it is decoded ahead.
+\param      rate samples per second of the mixed audio
+\param      channels amount of channels of the mixed audio
+\returns    a pointer to a SDL_ffmpegMixer, or NULL on error
+*/
+SDL_ffmpegMixer* SDL_ffmpegCreateMixer( int rate, int channels )
+{
+    if ( rate <= 0 || channels < 1 || channels > SDL_FFMPEG_MAX_CHANNELS )
+    {
+        SDL_ffmpegSetError( "invalid mixer rate or channels" );
         return 0;
     }
-    else
+
+    SDL_ffmpegMixer *mixer = ( SDL_ffmpegMixer* )malloc( sizeof( SDL_ffmpegMixer ) );
+    if ( !mixer )
     {
-        SDL_ffmpegSetError( "no valid video stream selected" );
+        SDL_ffmpegSetError( "could not allocate mixer" );
+        return 0;
     }
 
-    *w = 0;
-    *h = 0;
+    memset( mixer, 0, sizeof( SDL_ffmpegMixer ) );
 
-    SDL_UnlockMutex( file->streamMutex );
+    mixer->rate = rate;
+    mixer->channels = channels;
 
-    return -1;
-}
+    mixer->mutex = SDL_CreateMutex();
 
+    /* the callback mixes in parts which fit the buffer, so it never has to grow */
+    mixer->buffer = ( int16_t* )av_malloc( SDL_FFMPEG_MIX_BUFFER );
+    mixer->bufferSize = SDL_FFMPEG_MIX_BUFFER;
 
-/** \brief  This is used to check if a valid audio stream is selected.
+    /* the callback always finds a list of sources, even when it is empty */
+    mixer->active = ( SDL_ffmpegMixerSource** )calloc( 1, sizeof( SDL_ffmpegMixerSource* ) );
 
-\param      file SDL_ffmpegFile from which the information is required
-\returns    non-zero if a valid video stream is selected, otherwise 0
-*/
-int SDL_ffmpegValidAudio( SDL_ffmpegFile* file )
-{
-    /* this function is used to check if we selected a valid audio stream */
-    return ( file && file->audioStream );
+    if ( !mixer->mutex || !mixer->buffer || !mixer->active )
+    {
+        SDL_ffmpegFreeMixer( mixer );
+
+        SDL_ffmpegSetError( "could not allocate mixer" );
+        return 0;
+    }
+
+    /* selects the mix kernels */
+    SDL_ffmpegInit();
+
+    return mixer;
 }
 
 
-/** \brief  This is used to check if a valid video stream is selected.
+/** \brief  Release a mixer.
 
-\param      file SDL_ffmpegFile from which the information is required
-\returns    non-zero if a valid video stream is selected, otherwise 0
+            All sources are removed, the files themselves are not released.
+            The audio device must be closed before the mixer is released.
+\param      mixer SDL_ffmpegMixer which is released
 */
-int SDL_ffmpegValidVideo( SDL_ffmpegFile* file )
+void SDL_ffmpegFreeMixer( SDL_ffmpegMixer *mixer )
 {
-    /* this function is used to check if we selected a valid video stream */
-    return ( file && file->videoStream );
+    if ( !mixer ) return;
+
+    /* the audio device is closed, so the callback no longer uses the sources */
+    while ( mixer->sources )
+    {
+        SDL_ffmpegMixerSource *source = mixer->sources;
+
+        mixer->sources = source->next;
+
+        SDL_ffmpegSetAudioDecodeAhead( source->file, 0 );
+
+        free( source );
+    }
+
+    free( mixer->active );
+
+    if ( mixer->mutex ) SDL_DestroyMutex( mixer->mutex );
+
+    av_free( mixer->buffer );
+
+    free( mixer );
 }
 
 
-/** \brief  This is used to add a video stream to file
+/** \brief  Add the selected audio stream of a file to a mixer.
 
-\param      file SDL_ffmpegFile to which the stream will be added
-\param      codec SDL_ffmpegCodec describing the type encoding to be used by this
-                  stream.
-\returns    The stream which was added, or NULL if no stream could be added.
+            The audio of the file is converted to the format of the mixer and
+            decoded ahead, as with SDL_ffmpegSetAudioOutput and
+            SDL_ffmpegSetAudioDecodeAhead. A new source is stopped, at unity
+            gain and centered. Every source decodes ahead in an audio thread
+            of its own, next to the reader thread of its file when packets
+            are read ahead, so every added source costs one or two threads.
+            Sources which are no longer played should be removed.
+\param      mixer SDL_ffmpegMixer to which the file is added
+\param      file SDL_ffmpegFile with a selected audio stream
+\param      bytes amount of audio which is decoded ahead
+\returns    a pointer to the new SDL_ffmpegMixerSource, or NULL on error
 */
-SDL_ffmpegStream* SDL_ffmpegAddVideoStream( SDL_ffmpegFile *file, SDL_ffmpegCodec codec )
+SDL_ffmpegMixerSource* SDL_ffmpegAddMixerSource( SDL_ffmpegMixer *mixer, SDL_ffmpegFile *file, uint32_t bytes )
 {
-    /* add a video stream */
-    AVStream *stream = av_new_stream( file->_ffmpeg, 0 );
-    if ( !stream )
+    if ( !mixer || !file || !SDL_ffmpegValidAudio( file ) )
     {
-        SDL_ffmpegSetError( "could not allocate video stream" );
+        SDL_ffmpegSetError( "mixer source requires a file with a selected audio stream" );
         return 0;
     }
 
-    stream->codec = avcodec_alloc_context();
+    if ( SDL_ffmpegSetAudioOutput( file, mixer->rate, mixer->channels, AUDIO_S16SYS, SDL_ffmpegResampleNormal ) ) return 0;
 
-    avcodec_get_context_defaults2( stream->codec, CODEC_TYPE_VIDEO );
+    if ( SDL_ffmpegSetAudioDecodeAhead( file, bytes ) ) return 0;
 
-    if ( codec.videoCodecID < 0 )
+    SDL_ffmpegMixerSource *source = ( SDL_ffmpegMixerSource* )malloc( sizeof( SDL_ffmpegMixerSource ) );
+    if ( !source )
+    {
+        SDL_ffmpegSetAudioDecodeAhead( file, 0 );
+
+        SDL_ffmpegSetError( "could not allocate mixer source" );
+        return 0;
+    }
+
+    memset( source, 0, sizeof( SDL_ffmpegMixerSource ) );
+
+    source->file = file;
+    source->gainLeft = 1 << 14;
+    source->gainRight = 1 << 14;
+
+    SDL_LockMutex( mixer->mutex );
+
+    source->next = mixer->sources;
+    mixer->sources = source;
+
+    if ( SDL_ffmpegPublishMixerSources( mixer ) )
+    {
+        mixer->sources = source->next;
+
+        SDL_UnlockMutex( mixer->mutex );
+
+        SDL_ffmpegSetAudioDecodeAhead( file, 0 );
+
+        free( source );
+
+        return 0;
+    }
+
+    SDL_UnlockMutex( mixer->mutex );
+
+    return source;
+}
+
+
+/** \brief  Remove a source from a mixer.
+
+            The source is released and its file no longer decodes audio ahead.
+            The file itself is not released.
+\param      mixer SDL_ffmpegMixer from which the source is removed
+\param      source SDL_ffmpegMixerSource which is removed
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegRemoveMixerSource( SDL_ffmpegMixer *mixer, SDL_ffmpegMixerSource *source )
+{
+    if ( !mixer || !source ) return -1;
+
+    SDL_LockMutex( mixer->mutex );
+
+    SDL_ffmpegMixerSource **s = &mixer->sources;
+
+    while ( *s && *s != source ) s = &( *s )->next;
+
+    if ( !*s )
+    {
+        SDL_UnlockMutex( mixer->mutex );
+
+        SDL_ffmpegSetError( "source is not part of this mixer" );
+        return -1;
+    }
+
+    *s = source->next;
+
+    /* once published, the callback can no longer reach source */
+    if ( SDL_ffmpegPublishMixerSources( mixer ) )
+    {
+        *s = source;
+
+        SDL_UnlockMutex( mixer->mutex );
+        return -1;
+    }
+
+    SDL_UnlockMutex( mixer->mutex );
+
+    /* the callback no longer uses the file, so it can stop decoding ahead */
+    SDL_ffmpegSetAudioDecodeAhead( source->file, 0 );
+
+    free( source );
+
+    return 0;
+}
+
+
+/** \brief  Set the volume and position of a source.
+
+            Panning only has effect when the mixer has two channels.
+\param      source SDL_ffmpegMixerSource of which the gain is set
+\param      gain volume of the source, ranging from 0 to 2, 1 keeps the volume
+\param      pan position of the source, ranging from -1 (left) to 1 (right)
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetMixerSourceGain( SDL_ffmpegMixerSource *source, float gain, float pan )
+{
+    if ( !source ) return -1;
+
+    if ( gain < 0 ) gain = 0;
+    if ( gain > 2 ) gain = 2;
+    if ( pan < -1 ) pan = -1;
+    if ( pan > 1 ) pan = 1;
+
+    /* a source is attenuated on the side opposite to its position */
+    int left = ( int )( gain * ( pan > 0 ? 1 - pan : 1 ) * ( 1 << 14 ) + 0.5f ),
+        right = ( int )( gain * ( pan < 0 ? 1 + pan : 1 ) * ( 1 << 14 ) + 0.5f );
+
+    source->gainLeft = left > 32767 ? 32767 : left;
+    source->gainRight = right > 32767 ? 32767 : right;
+
+    return 0;
+}
+
+
+/** \brief  Start playing a source.
+
+            A source which played all its audio starts at the beginning again.
+\param      source SDL_ffmpegMixerSource which is played
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegPlayMixerSource( SDL_ffmpegMixerSource *source )
+{
+    if ( !source ) return -1;
+
+    if ( SDL_ffmpegAudioEnded( source->file ) ) SDL_ffmpegSeek( source->file, 0 );
+
+    source->playing = 1;
+
+    return 0;
+}
+
+
+/** \brief  Stop playing a source, and return to the beginning.
+
+\param      source SDL_ffmpegMixerSource which is stopped
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegStopMixerSource( SDL_ffmpegMixerSource *source )
+{
+    if ( !source ) return -1;
+
+    source->playing = 0;
+
+    /* seeking discards the audio which was decoded ahead */
+    return SDL_ffmpegSeek( source->file, 0 );
+}
+
+
+/** \brief  Create an audio spec which plays the output of a mixer.
+
+\param      mixer SDL_ffmpegMixer which should be played
+\param      samples amount of samples per channel the device requests at once
+\returns    SDL_AudioSpec which uses SDL_ffmpegMixerCallback, with freq set
+            to zero on error
+*/
+SDL_AudioSpec SDL_ffmpegGetMixerAudioSpec( SDL_ffmpegMixer *mixer, uint16_t samples )
+{
+    SDL_AudioSpec spec;
+
+    memset( &spec, 0, sizeof( SDL_AudioSpec ) );
+
+    if ( !mixer ) return spec;
+
+    spec.format = AUDIO_S16SYS;
+    spec.samples = samples;
+    spec.userdata = mixer;
+    spec.callback = SDL_ffmpegMixerCallback;
+    spec.freq = mixer->rate;
+    spec.channels = ( uint8_t )mixer->channels;
+
+    return spec;
+}
+
+
+/** \brief  Audio callback which plays the output of a mixer.
+
+            The audio of every playing source is taken from the audio which
+            was decoded ahead, scaled by its gain and added with saturation.
+            No locks are taken, sources which are added or removed meanwhile
+            are mixed from the next call on.
+\param      userdata SDL_ffmpegMixer which is played
+\param      stream buffer which receives the mixed audio
+\param      length size of stream in bytes
+*/
+void SDL_ffmpegMixerCallback( void *userdata, Uint8 *stream, int length )
+{
+    SDL_ffmpegMixer *mixer = ( SDL_ffmpegMixer* )userdata;
+
+    memset( stream, 0, length );
+
+    if ( !mixer ) return;
+
+    /* tells SDL_ffmpegPublishMixerSources the sources are in use */
+    mixer->mixCount++;
+
+    SDL_ffmpegMemoryBarrier();
+
+    SDL_ffmpegMixerSource **sources = mixer->active;
+
+    /* sources are mixed in parts which fit the buffer, keeping whole
+       sample frames so left and right stay in place */
+    int frame = mixer->channels * ( int )sizeof( int16_t );
+    int part = mixer->bufferSize - mixer->bufferSize % frame;
+
+    for ( int i = 0; sources[ i ] && part > 0; i++ )
+    {
+        SDL_ffmpegMixerSource *source = sources[ i ];
+
+        if ( !source->playing ) continue;
+
+        int gainLeft = source->gainLeft,
+            gainRight = source->gainRight;
+
+        /* without two channels there is no panning, the full gain is
+           found on the side the source is panned to */
+        if ( mixer->channels != 2 ) gainLeft = gainRight = gainLeft > gainRight ? gainLeft : gainRight;
+
+        for ( int offset = 0; offset < length; offset += part )
+        {
+            int bytes = length - offset < part ? length - offset : part;
+
+            SDL_ffmpegAudioCallback( source->file, ( Uint8* )mixer->buffer, bytes );
+
+            SDL_ffmpegMix(( int16_t* )( stream + offset ), mixer->buffer, bytes / ( int )sizeof( int16_t ), gainLeft, gainRight );
+        }
+
+        /* a source stops by itself when all its audio was played */
+        if ( SDL_ffmpegAudioEnded( source->file ) ) source->playing = 0;
+    }
+
+    SDL_ffmpegMemoryBarrier();
+
+    mixer->mixCount++;
+}
+
+
+/** \brief  Returns the current position of the file in milliseconds.
+
+\param      file SDL_ffmpegFile from which the information is required
+\returns    -1 on error, otherwise the length of the file in milliseconds
+*/
+int64_t SDL_ffmpegGetPosition( SDL_ffmpegFile *file )
+{
+    if ( !file ) return -1;
+
+    /* when accesing audio/video stream, streamMutex should be locked */
+    SDL_LockMutex( file->streamMutex );
+
+    int64_t pos = 0;
+
+    if ( file->audioStream )
+    {
+        pos = file->audioStream->lastTimeStamp;
+    }
+
+    if ( file->videoStream && file->videoStream->lastTimeStamp > pos )
+    {
+        pos = file->videoStream->lastTimeStamp;
+    }
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    /* return the current playposition of our file */
+    return pos;
+}
+
+
+/** \brief  Returns the frame rate of the stream as a fraction.
+
+            This retreives the frame rate of the supplied stream.
+            For example, a framerate of 25 frames per second will have a nominator
+            of 1, and a denominator of 25.
+\param      stream SDL_ffmpegStream from which the information is required.
+\param      nominator Nominator part of the fraction. Can be 0 if exact value of
+                      nominator is not required.
+\param      denominator Denominator part of the fraction. Can be 0 if exact value
+                        of denominator is not required.
+\returns    The result of nominator / denominator as floating point value.
+*/
+float SDL_ffmpegGetFrameRate( SDL_ffmpegStream *stream, int *nominator, int *denominator )
+{
+    if ( stream && stream->_ffmpeg && stream->_ffmpeg->codec )
+    {
+        if ( nominator ) *nominator = stream->_ffmpeg->r_frame_rate.num;
+
+        if ( denominator ) *denominator = stream->_ffmpeg->r_frame_rate.den;
+
+        return ( float )stream->_ffmpeg->r_frame_rate.num / stream->_ffmpeg->r_frame_rate.den;
+    }
+    else
+    {
+        SDL_ffmpegSetError( "could not retreive frame rate from stream" );
+
+        if ( nominator ) *nominator = 0;
+
+        if ( denominator ) *denominator = 0;
+    }
+
+    return 0.0;
+}
+
+/** \brief  Limits the amount of packets which are buffered for a stream.
+
+            Packets are buffered for the selected streams until they are decoded.
+            Using this function, the buffer of a stream can be limited by amount
+            of packets, total size and total duration. When one of the limits is
+            reached, either reading is paused until packets are used
+            (SDL_ffmpegQueueBlock), or the oldest packets are dropped
+            (SDL_ffmpegQueueDrop). When reading happens in the thread requesting
+            frames or another stream would run out of packets, a blocking buffer
+            is allowed to exceed its limits. A reader thread which paused
+            because the old limits were reached continues right away.
+\param      file SDL_ffmpegFile to which stream belongs.
+\param      stream SDL_ffmpegStream of which the buffer should be limited.
+\param      packets Maximum amount of packets, 0 means no limit.
+\param      bytes Maximum total size of the packets in bytes, 0 means no limit.
+\param      milliseconds Maximum total duration of the packets, 0 means no limit.
+\param      policy Behaviour of the buffer when one of the limits is reached.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetPacketQueueLimits( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, uint32_t packets, uint64_t bytes, int64_t milliseconds, enum SDL_ffmpegQueuePolicy policy )
+{
+    if ( !file || !stream || !stream->mutex )
+    {
+        SDL_ffmpegSetError( "no valid stream supplied" );
+        return -1;
+    }
+
+    SDL_LockMutex( stream->mutex );
+
+    stream->buffer.maxPackets = packets;
+    stream->buffer.maxBytes = bytes;
+    stream->buffer.maxDuration = milliseconds;
+    stream->buffer.policy = policy;
+
+    SDL_UnlockMutex( stream->mutex );
+
+    /* the reader thread checks the limits again */
+    if ( file->readThread )
+    {
+        SDL_LockMutex( file->readMutex );
+
+        SDL_CondSignal( file->readCond );
+
+        SDL_UnlockMutex( file->readMutex );
+    }
+
+    return 0;
+}
+
+/** \brief  Sets the amount of threads used to convert frames of a stream.
+
+            By default, frames are converted to the size and format of the
+            requested surface or overlay on the calling thread. With this
+            function, pictures are split in horizontal bands which are converted
+            in parallel by a pool of worker threads shared by all files. Every
+            band uses its own conversion context. Bands are only used when the
+            picture is not scaled vertically, other conversions use a single thread.
+\param      file SDL_ffmpegFile to which stream belongs.
+\param      stream SDL_ffmpegStream for which the threads are set.
+\param      threads Amount of bands, SDL_FFMPEG_AUTO_THREADS uses one band
+                    for every core.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetConversionThreads( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, int threads )
+{
+    if ( !file || !stream )
+    {
+        SDL_ffmpegSetError( "no valid stream supplied" );
+        return -1;
+    }
+
+    /* frames are converted while either of these mutexes is locked */
+    SDL_LockMutex( file->streamMutex );
+    SDL_LockMutex( file->frameMutex );
+
+    stream->conversionThreads = threads;
+
+    SDL_UnlockMutex( file->frameMutex );
+    SDL_UnlockMutex( file->streamMutex );
+
+    return 0;
+}
+
+/** \brief  Sets the amount of conversion contexts kept for a stream.
+
+            Converting frames to a different size or format requires a
+            conversion context, which is expensive to create. The most recently
+            used contexts of every stream are kept, so switching between a few
+            sizes, for example when a window is resized, does not create a new
+            context for every frame. When the cache is full, the least recently
+            used context is released.
+\param      file SDL_ffmpegFile to which stream belongs.
+\param      stream SDL_ffmpegStream for which the cache size is set.
+\param      size Maximum amount of contexts, 0 restores the default.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetConversionCacheSize( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, uint32_t size )
+{
+    if ( !file || !stream )
+    {
+        SDL_ffmpegSetError( "no valid stream supplied" );
+        return -1;
+    }
+
+    /* contexts are used while either of these mutexes is locked */
+    SDL_LockMutex( file->streamMutex );
+    SDL_LockMutex( file->frameMutex );
+
+    stream->conversionCache.limit = size;
+
+    uint32_t limit = ( size ? size : SDL_FFMPEG_CONVERSION_CACHE_SIZE ) * ( stream->conversionCache.slices ? stream->conversionCache.slices : 1 );
+
+    /* release contexts which no longer fit */
+    while ( stream->conversionCache.count > limit )
+    {
+        SDL_ffmpegConversionEvict( &stream->conversionCache, stream->conversionCache.oldest );
+    }
+
+    SDL_UnlockMutex( file->frameMutex );
+    SDL_UnlockMutex( file->streamMutex );
+
+    return 0;
+}
+
+/** \brief  Retrieve the amount of conversion context lookups of a stream.
+
+            A hit means a conversion context could be reused, a miss means a
+            new context had to be created. Many misses indicate the cache size,
+            as set by SDL_ffmpegSetConversionCacheSize, is too small.
+\param      file SDL_ffmpegFile to which stream belongs.
+\param      stream SDL_ffmpegStream from which the statistics are retrieved.
+\param      hits Pointer which receives the amount of hits, can be NULL.
+\param      misses Pointer which receives the amount of misses, can be NULL.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegGetConversionCacheStats( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, uint64_t *hits, uint64_t *misses )
+{
+    if ( !file || !stream )
+    {
+        SDL_ffmpegSetError( "no valid stream supplied" );
+        return -1;
+    }
+
+    SDL_LockMutex( file->streamMutex );
+    SDL_LockMutex( file->frameMutex );
+
+    if ( hits ) *hits = stream->conversionCache.hits;
+
+    if ( misses ) *misses = stream->conversionCache.misses;
+
+    SDL_UnlockMutex( file->frameMutex );
+    SDL_UnlockMutex( file->streamMutex );
+
+    return 0;
+}
+
+/** \brief  Sets the amount of threads used to decode a stream.
+
+            By default, every stream is decoded using a single thread. With this
+            function, the work can be divided over multiple threads. Frame
+            threading decodes multiple frames at once and scales best, but adds
+            a frame of delay for every thread. Slice threading decodes parts of
+            a single frame at once, but only works for codecs and files which
+            support it. When the decoder was already opened, it will be reopened
+            to apply the new settings, while threads decoding ahead are paused.
+            When that fails, the previous settings are restored, and when the
+            decoder can not be reopened at all, the stream is deselected.
+            Threads for output streams are set using SDL_ffmpegCodec.
+\param      file SDL_ffmpegFile to which stream belongs.
+\param      stream SDL_ffmpegStream for which the threads are set.
+\param      threads Amount of threads, SDL_FFMPEG_AUTO_THREADS uses one thread
+                    for every core.
+\param      type SDL_ffmpegThreadType which will be used.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetCodecThreads( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, int threads, enum SDL_ffmpegThreadType type )
+{
+    if ( !file || !stream || !stream->_ffmpeg )
+    {
+        SDL_ffmpegSetError( "no valid stream supplied" );
+        return -1;
+    }
+
+    if ( file->type != SDL_ffmpegInputStream )
+    {
+        SDL_ffmpegSetError( "threads of output streams are set using SDL_ffmpegCodec" );
+        return -1;
+    }
+
+    /* when accesing audio/video stream, streamMutex should be locked, this
+       also pauses the decode ahead and audio threads, which only use the
+       codec while holding it */
+    SDL_LockMutex( file->streamMutex );
+
+    /* the reader thread should not read while the codec is reopened */
+    if ( file->readThread ) SDL_LockMutex( file->readMutex );
+
+    int previousCount = stream->threadCount;
+    enum SDL_ffmpegThreadType previousType = stream->threadType;
+
+    stream->threadCount = threads;
+    stream->threadType = type;
+
+    int error = 0;
+
+    /* reopen codec, so the new settings are used */
+    if ( stream->_ffmpeg->codec->codec )
+    {
+        avcodec_close( stream->_ffmpeg->codec );
+
+        error = SDL_ffmpegOpenDecoder( stream );
+
+        if ( error )
+        {
+            /* keep decoding with the settings which worked before */
+            stream->threadCount = previousCount;
+            stream->threadType = previousType;
+
+            if ( SDL_ffmpegOpenDecoder( stream ) )
+            {
+                /* a stream without decoder can not stay selected */
+                if ( stream == file->videoStream ) SDL_ffmpegSelectVideoStream( file, -1 );
+
+                if ( stream == file->audioStream ) SDL_ffmpegSelectAudioStream( file, -1 );
+            }
+
+            SDL_ffmpegSetError( "could not reopen codec with the requested threads" );
+        }
+
+        /* threads waiting for packets should not continue with the new codec */
+        SDL_ffmpegStreamsChanged( file );
+    }
+
+    if ( file->readThread )
+    {
+        SDL_UnlockMutex( file->readMutex );
+
+        SDL_CondSignal( file->readCond );
+    }
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return error;
+}
+
+/** \brief  This can be used to get a SDL_AudioSpec based on values found in file
+
+            This returns a SDL_AudioSpec, if you have selected a valid audio
+            stream. Otherwise, all values are set to NULL.
+\param      file SDL_ffmpegFile from which the information is required
+\param      samples Amount of samples required every time the callback is called.
+            Lower values mean less latency, but please note that SDL has a minimal value.
+\param      callback Pointer to callback function
+\returns    SDL_AudioSpec with values set according to the selected audio stream.
+            If no valid audio stream was available, all values of returned SDL_AudioSpec are set to 0
+*/
+SDL_AudioSpec SDL_ffmpegGetAudioSpec( SDL_ffmpegFile *file, uint16_t samples, SDL_ffmpegCallback callback )
+{
+    /* create audio spec */
+    SDL_AudioSpec spec;
+
+    memset( &spec, 0, sizeof( SDL_AudioSpec ) );
+
+    if ( !file ) return spec;
+
+    /* when accesing audio/video stream, streamMutex should be locked */
+    SDL_LockMutex( file->streamMutex );
+
+    /* if we have a valid audiofile, we can use its data to create a
+       more appropriate audio spec */
+    if ( file->audioStream )
+    {
+        int rate, channels;
+
+        /* audio is handed out in the output format set by the user */
+        SDL_ffmpegAudioOutputSpec( file, &rate, &channels, &spec.format );
+
+        spec.samples = samples;
+        spec.userdata = file;
+        spec.callback = callback;
+        spec.freq = rate;
+        spec.channels = ( uint8_t )channels;
+    }
+    else
+    {
+        SDL_ffmpegSetError( "no valid audio stream selected" );
+    }
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return spec;
+}
+
+
+/** \brief  Set the format in which decoded audio is handed out.
+
+            Decoded audio is remixed to the requested amount of channels,
+            resampled to the requested rate and stored in the requested sample
+            format, so a single audio device can play files of any format.
+            Audio which was decoded, but not yet handed out, is discarded.
+            Channels are assumed to be in the ffmpeg order, front left, front
+            right, center, low frequency, back left, back right, side left and
+            side right. Remixing to stereo leaves out the low frequency channel.
+\param      file SDL_ffmpegFile for which the output format is set
+\param      rate samples per second, 0 keeps the rate of the audio stream
+\param      channels amount of channels up to SDL_FFMPEG_MAX_CHANNELS, 0 keeps
+            the channels of the audio stream
+\param      format AUDIO_U8, AUDIO_S8, AUDIO_U16LSB, AUDIO_S16LSB, AUDIO_U16MSB,
+            AUDIO_S16MSB or SDL_FFMPEG_AUDIO_F32SYS, 0 selects AUDIO_S16SYS.
+            Float samples can be used with SDL_ffmpegGetAudioFrame, an SDL 1.2
+            audio device can not play them.
+\param      quality of resampling, only used when the rates differ
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetAudioOutput( SDL_ffmpegFile *file, int rate, int channels, uint16_t format, enum SDL_ffmpegResampleQuality quality )
+{
+    if ( !file ) return -1;
+
+    if ( rate < 0 || channels < 0 || channels > SDL_FFMPEG_MAX_CHANNELS )
+    {
+        SDL_ffmpegSetError( "invalid audio output rate or channels" );
+        return -1;
+    }
+
+    switch ( format )
+    {
+        case 0:
+        case AUDIO_U8:
+        case AUDIO_S8:
+        case AUDIO_U16LSB:
+        case AUDIO_S16LSB:
+        case AUDIO_U16MSB:
+        case AUDIO_S16MSB:
+        case SDL_FFMPEG_AUDIO_F32SYS:
+            break;
+
+        default:
+            SDL_ffmpegSetError( "unsupported audio output format" );
+            return -1;
+    }
+
+    /* when accesing audio/video stream, streamMutex should be locked */
+    SDL_LockMutex( file->streamMutex );
+
+    file->audioOutput.rate = rate;
+    file->audioOutput.channels = channels;
+    file->audioOutput.format = format;
+    file->audioOutput.quality = quality;
+
+    /* audio which was decoded, but not yet handed out, is in the old format */
+    if ( file->audioStream && file->type == SDL_ffmpegInputStream )
+    {
+        SDL_ffmpegAudioFifo *fifo = &file->audioStream->audioFifo;
+
+        fifo->offset = 0;
+        fifo->size = 0;
+
+        /* samples are counted in the new format from the next packet on */
+        fifo->pts = AV_NOPTS_VALUE;
+        fifo->consumed = 0;
+        fifo->skip = 0;
+
+        SDL_ffmpegAudioConverterReset( &file->audioStream->audioConverter );
+
+        /* a thread waiting for packets would mix both formats */
+        SDL_ffmpegStreamsChanged( file );
+    }
+
+    SDL_ffmpegFlushAudioRing( file );
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return 0;
+}
+
+
+/** \brief  Set the order of the samples in frames from SDL_ffmpegGetAudioFrame.
+
+            Planar frames hold all samples of the first channel, followed by
+            all samples of the next channel, which saves a DSP chain working
+            on separate channels a pass over the data. Audio which is decoded
+            ahead for SDL_ffmpegAudioCallback is always interleaved.
+\param      file SDL_ffmpegFile for which the layout is set
+\param      layout SDL_ffmpegAudioInterleaved or SDL_ffmpegAudioPlanar
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegSetAudioLayout( SDL_ffmpegFile *file, enum SDL_ffmpegAudioLayout layout )
+{
+    if ( !file ) return -1;
+
+    if ( layout != SDL_ffmpegAudioInterleaved && layout != SDL_ffmpegAudioPlanar )
+    {
+        SDL_ffmpegSetError( "invalid audio layout" );
+        return -1;
+    }
+
+    /* when accesing audio/video stream, streamMutex should be locked */
+    SDL_LockMutex( file->streamMutex );
+
+    file->audioOutput.layout = layout;
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return 0;
+}
+
+
+/** \brief  Returns the Duration of the file in milliseconds.
+
+            Please note that this value is guestimated by FFmpeg, it may differ from
+            actual playing time.
+\param      file SDL_ffmpegFile from which the information is required
+\returns    -1 on error, otherwise the length of the file in milliseconds
+*/
+uint64_t SDL_ffmpegDuration( SDL_ffmpegFile *file )
+{
+    if ( !file ) return 0;
+
+    if ( file->type == SDL_ffmpegInputStream )
+    {
+        /* returns the duration of the entire file, please note that ffmpeg doesn't
+           always get this value right! so don't bet your life on it... */
+        return file->_ffmpeg->duration / ( AV_TIME_BASE / 1000 );
+    }
+
+    if ( file->type == SDL_ffmpegOutputStream )
+    {
+        uint64_t v = SDL_ffmpegVideoDuration( file );
+        uint64_t a = SDL_ffmpegAudioDuration( file );
+
+        if ( v > a ) return v;
+        return a;
+    }
+
+    return 0;
+}
+
+
+/** \brief  Returns the duration of the audio stream in milliseconds.
+
+            This value can be used to sync two output streams.
+\param      file SDL_ffmpegFile from which the information is required
+\returns    -1 on error, otherwise the length of the file in milliseconds
+*/
+uint64_t SDL_ffmpegAudioDuration( SDL_ffmpegFile *file )
+{
+    if ( !file ) return 0;
+
+    /* when accesing audio/video stream, streamMutex should be locked */
+    SDL_LockMutex( file->streamMutex );
+
+    uint64_t duration = 0;
+
+    if ( file->audioStream )
+    {
+        if ( file->type == SDL_ffmpegInputStream )
+        {
+            duration = av_rescale( 1000 * file->audioStream->_ffmpeg->duration, file->audioStream->_ffmpeg->time_base.num, file->audioStream->_ffmpeg->time_base.den );
+        }
+        else if ( file->type == SDL_ffmpegOutputStream )
+        {
+            /* audio waiting for a complete encoder frame is part of the stream as well */
+            uint64_t samples = file->audioStream->encodeAudioSamples + file->audioStream->audioFifo.size / ( 2 * file->audioStream->_ffmpeg->codec->channels );
+
+            duration = av_rescale( samples, 1000, file->audioStream->_ffmpeg->codec->sample_rate );
+        }
+    }
+    else
+    {
+        SDL_ffmpegSetError( "no valid audio stream selected" );
+    }
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return duration;
+}
+
+
+/** \brief  Returns the duration of the video stream in milliseconds.
+
+            This value can be used to sync two output streams.
+\param      file SDL_ffmpegFile from which the information is required
+\returns    -1 on error, otherwise the length of the file in milliseconds
+*/
+uint64_t SDL_ffmpegVideoDuration( SDL_ffmpegFile *file )
+{
+    if ( !file ) return 0;
+
+    /* when accesing audio/video stream, streamMutex should be locked */
+    SDL_LockMutex( file->streamMutex );
+
+    uint64_t duration = 0;
+
+    if ( file->videoStream )
+    {
+        if ( file->type == SDL_ffmpegInputStream )
+        {
+            duration = av_rescale( 1000 * file->videoStream->_ffmpeg->duration, file->videoStream->_ffmpeg->time_base.num, file->videoStream->_ffmpeg->time_base.den );
+        }
+        else if ( file->type == SDL_ffmpegOutputStream )
+        {
+            /* frames waiting to be encoded count as added */
+            SDL_LockMutex( file->encodeMutex );
+
+            uint64_t frames = file->videoStream->frameCount + file->encodeCount;
+
+            SDL_UnlockMutex( file->encodeMutex );
+
+            duration = av_rescale( 1000 * frames, file->videoStream->_ffmpeg->codec->time_base.num, file->videoStream->_ffmpeg->codec->time_base.den );
+        }
+    }
+    else
+    {
+        SDL_ffmpegSetError( "no valid video stream selected" );
+    }
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return duration;
+}
+
+/** \brief  retreive the width/height of a frame beloning to file
+
+            With this function you can get the width and height of a frame, belonging to
+            your file. If there is no (valid) videostream selected w and h default
+            to 0. Please not that you will have to make sure the pointers are
+            allocated.
+
+\param      file SDL_ffmpegFile from which the information is required
+\param      w width
+\param      h height
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegGetVideoSize( SDL_ffmpegFile *file, int *w, int *h )
+{
+    if ( !file || !w || !h ) return -1;
+
+    /* when accesing audio/video stream, streamMutex should be locked */
+    SDL_LockMutex( file->streamMutex );
+
+    /* if we have a valid video file selected, we use it
+       if not, we send default values and return.
+       by checking the return value you can check if you got a valid size */
+    if ( file->videoStream )
+    {
+        *w = file->videoStream->_ffmpeg->codec->width;
+        *h = file->videoStream->_ffmpeg->codec->height;
+
+        SDL_UnlockMutex( file->streamMutex );
+
+        return 0;
+    }
+    else
+    {
+        SDL_ffmpegSetError( "no valid video stream selected" );
+    }
+
+    *w = 0;
+    *h = 0;
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    return -1;
+}
+
+
+/** \brief  This is used to check if a valid audio stream is selected.
+
+\param      file SDL_ffmpegFile from which the information is required
+\returns    non-zero if a valid video stream is selected, otherwise 0
+*/
+int SDL_ffmpegValidAudio( SDL_ffmpegFile* file )
+{
+    /* this function is used to check if we selected a valid audio stream */
+    return ( file && file->audioStream );
+}
+
+
+/** \brief  This is used to check if a valid video stream is selected.
+
+\param      file SDL_ffmpegFile from which the information is required
+\returns    non-zero if a valid video stream is selected, otherwise 0
+*/
+int SDL_ffmpegValidVideo( SDL_ffmpegFile* file )
+{
+    /* this function is used to check if we selected a valid video stream */
+    return ( file && file->videoStream );
+}
+
+
+/** \brief  This is used to add a video stream to file
+
+\param      file SDL_ffmpegFile to which the stream will be added
+\param      codec SDL_ffmpegCodec describing the type encoding to be used by this
+                  stream.
+\returns    The stream which was added, or NULL if no stream could be added.
+*/
+SDL_ffmpegStream* SDL_ffmpegAddVideoStream( SDL_ffmpegFile *file, SDL_ffmpegCodec codec )
+{
+    /* add a video stream */
+    AVStream *stream = av_new_stream( file->_ffmpeg, 0 );
+    if ( !stream )
+    {
+        SDL_ffmpegSetError( "could not allocate video stream" );
+        return 0;
+    }
+
+    stream->codec = avcodec_alloc_context();
+
+    avcodec_get_context_defaults2( stream->codec, CODEC_TYPE_VIDEO );
+
+    if ( codec.videoCodecID < 0 )
     {
         stream->codec->codec_id = file->_ffmpeg->oformat->video_codec;
     }
     else
     {
-        stream->codec->codec_id = ( enum CodecID ) codec.videoCodecID;
-    }
+        stream->codec->codec_id = ( enum CodecID ) codec.videoCodecID;
+    }
+
+    stream->codec->codec_type = CODEC_TYPE_VIDEO;
+
+    stream->codec->bit_rate = codec.videoBitrate;
+
+    /* resolution must be a multiple of two */
+    stream->codec->width = codec.width;
+    stream->codec->height = codec.height;
+
+    /* set time_base */
+    stream->codec->time_base.num = codec.framerateNum;
+    stream->codec->time_base.den = codec.framerateDen;
+
+    /* emit one intra frame every twelve frames at most */
+    stream->codec->gop_size = 12;
+
+    /* set pixel format */
+    stream->codec->pix_fmt = PIX_FMT_YUV420P;
+
+    /* set mpeg2 codec parameters */
+    if ( stream->codec->codec_id == CODEC_ID_MPEG2VIDEO )
+    {
+        stream->codec->max_b_frames = 2;
+    }
+
+    /* set mpeg1 codec parameters */
+    if ( stream->codec->codec_id == CODEC_ID_MPEG1VIDEO )
+    {
+        /* needed to avoid using macroblocks in which some coeffs overflow
+           this doesnt happen with normal video, it just happens here as the
+           motion of the chroma plane doesnt match the luma plane */
+        stream->codec->mb_decision = 2;
+    }
+
+    /* some formats want stream headers to be separate */
+    if ( file->_ffmpeg->oformat->flags & AVFMT_GLOBALHEADER )
+    {
+        stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    /* find the video encoder */
+    AVCodec *videoCodec = avcodec_find_encoder( stream->codec->codec_id );
+    if ( !videoCodec )
+    {
+        SDL_ffmpegSetError( "video codec not found" );
+        return 0;
+    }
+
+    /* threads need to be set before the codec is opened */
+    SDL_ffmpegApplyThreads( stream->codec, codec.threadCount, codec.threadType );
+
+    /* open the codec */
+    if ( avcodec_open( stream->codec, videoCodec ) < 0 )
+    {
+        SDL_ffmpegSetError( "could not open video codec" );
+        return 0;
+    }
+
+    /* create a new stream */
+    SDL_ffmpegStream *str = ( SDL_ffmpegStream* )malloc( sizeof( SDL_ffmpegStream ) );
+
+    if ( str )
+    {
+        /* we set our stream to zero */
+        memset( str, 0, sizeof( SDL_ffmpegStream ) );
+
+        str->id = file->audioStreams + file->videoStreams;
+
+        /* _ffmpeg holds data about streamcodec */
+        str->_ffmpeg = stream;
+
+        str->threadCount = codec.threadCount;
+        str->threadType = codec.threadType;
+
+        str->mutex = SDL_CreateMutex();
+
+        str->encodeFrame = avcodec_alloc_frame();
+
+        /* no packet was queued for muxing yet */
+        str->muxTime = AV_NOPTS_VALUE;
+
+        uint8_t *picture_buf;
+        int size = avpicture_get_size( stream->codec->pix_fmt, stream->codec->width, stream->codec->height );
+        picture_buf = ( uint8_t* )av_malloc( size + FF_INPUT_BUFFER_PADDING_SIZE );
+        avpicture_fill(( AVPicture* )str->encodeFrame, picture_buf, stream->codec->pix_fmt, stream->codec->width, stream->codec->height );
+
+        str->encodeFrameBufferSize = stream->codec->width * stream->codec->height * 4 + FF_INPUT_BUFFER_PADDING_SIZE;
+
+        str->encodeFrameBuffer = ( uint8_t* )av_malloc( str->encodeFrameBufferSize );
+
+        file->videoStreams++;
+
+        /* find correct place to save the stream */
+        SDL_ffmpegStream **s = &file->vs;
+        while ( *s )
+        {
+            s = &( *s )->next;
+        }
+
+        *s = str;
+
+        if ( av_set_parameters( file->_ffmpeg, 0 ) < 0 )
+        {
+            SDL_ffmpegSetError( "could not set encoding parameters" );
+        }
+
+        /* try to write a header */
+        av_write_header( file->_ffmpeg );
+    }
+
+    return str;
+}
+
+
+/** \brief  This is used to add a video stream to file
+
+\param      file SDL_ffmpegFile to which the stream will be added
+\param      codec SDL_ffmpegCodec describing the type encoding to be used by this
+                  stream.
+\returns    The stream which was added, or NULL if no stream could be added.
+*/
+SDL_ffmpegStream* SDL_ffmpegAddAudioStream( SDL_ffmpegFile *file, SDL_ffmpegCodec codec )
+{
+    // add an audio stream
+    AVStream *stream = av_new_stream( file->_ffmpeg, 1 );
+    if ( !stream )
+    {
+        SDL_ffmpegSetError( "could not allocate audio stream" );
+        return 0;
+    }
+
+    if ( codec.audioCodecID < 0 )
+    {
+        stream->codec->codec_id = file->_ffmpeg->oformat->audio_codec;
+    }
+    else
+    {
+        stream->codec->codec_id = ( enum CodecID ) codec.audioCodecID;
+    }
+
+    stream->codec->codec_type = CODEC_TYPE_AUDIO;
+    stream->codec->bit_rate = codec.audioBitrate;
+    stream->codec->sample_rate = codec.sampleRate;
+    stream->codec->channels = codec.channels;
+
+    // find the audio encoder
+    AVCodec *audioCodec = avcodec_find_encoder( stream->codec->codec_id );
+    if ( !audioCodec )
+    {
+        SDL_ffmpegSetError( "audio codec not found" );
+        return 0;
+    }
+
+    /* threads need to be set before the codec is opened */
+    SDL_ffmpegApplyThreads( stream->codec, codec.threadCount, codec.threadType );
+
+    // open the codec
+    if ( avcodec_open( stream->codec, audioCodec ) < 0 )
+    {
+        SDL_ffmpegSetError( "could not open audio codec" );
+        return 0;
+    }
+
+    /* some formats want stream headers to be separate */
+    if ( file->_ffmpeg->oformat->flags & AVFMT_GLOBALHEADER )
+    {
+        stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+
+    /* create a new stream */
+    SDL_ffmpegStream *str = ( SDL_ffmpegStream* )malloc( sizeof( SDL_ffmpegStream ) );
+
+    if ( str )
+    {
+        str->_ffmpeg = stream;
+
+        /* we set our stream to zero */
+        memset( str, 0, sizeof( SDL_ffmpegStream ) );
+
+        str->id = file->audioStreams + file->videoStreams;
+
+        /* _ffmpeg holds data about streamcodec */
+        str->_ffmpeg = stream;
+
+        str->threadCount = codec.threadCount;
+        str->threadType = codec.threadType;
+
+        str->mutex = SDL_CreateMutex();
+
+        /* no packet was queued for muxing yet */
+        str->muxTime = AV_NOPTS_VALUE;
+
+        if ( stream->codec->frame_size <= 1 )
+        {
+            /* PCM codecs encode as many samples as fit the output buffer */
+            int bits = av_get_bits_per_sample( stream->codec->codec_id );
+
+            str->encodeAudioInputSize = SDL_FFMPEG_PCM_FRAME_SAMPLES;
+
+            str->encodeAudioBufferSize = str->encodeAudioInputSize * stream->codec->channels * ( bits > 0 ? bits : 16 ) / 8;
+        }
+        else
+        {
+            str->encodeAudioInputSize = stream->codec->frame_size;
+
+            /* encoded audio does not outgrow its 16 bit input plus headers */
+            str->encodeAudioBufferSize = str->encodeAudioInputSize * stream->codec->channels * 2 + FF_MIN_BUFFER_SIZE;
+        }
+
+        str->encodeAudioBuffer = ( uint8_t* )av_malloc( str->encodeAudioBufferSize );
+
+        str->audioFifo.pts = AV_NOPTS_VALUE;
+
+        file->audioStreams++;
+
+        /* find correct place to save the stream */
+        SDL_ffmpegStream **s = &file->as;
+        while ( *s )
+        {
+            s = &( *s )->next;
+        }
+
+        *s = str;
+
+        if ( av_set_parameters( file->_ffmpeg, 0 ) < 0 )
+        {
+            SDL_ffmpegSetError( "could not set encoding parameters" );
+            return 0;
+        }
+
+        /* try to write a header */
+        av_write_header( file->_ffmpeg );
+    }
+
+    return str;
+}
+
+
+/** \brief  This is used to add a stream which copies the packets of an input stream
+
+            The stream takes the codec parameters of source, its packets are
+            written as they are by SDL_ffmpegRemux, without being decoded or
+            encoded. Frames can not be added to this stream.
+\param      file SDL_ffmpegFile to which the stream will be added
+\param      source Audio or video stream of a file opened by SDL_ffmpegOpen.
+\returns    The stream which was added, or NULL if no stream could be added.
+*/
+SDL_ffmpegStream* SDL_ffmpegAddCopyStream( SDL_ffmpegFile *file, SDL_ffmpegStream *source )
+{
+    if ( !file || file->type != SDL_ffmpegOutputStream || !source || !source->_ffmpeg )
+    {
+        SDL_ffmpegSetError( "copying a stream requires an input stream and an output file" );
+        return 0;
+    }
+
+    AVCodecContext *input = source->_ffmpeg->codec;
+
+    if ( input->codec_type != CODEC_TYPE_VIDEO && input->codec_type != CODEC_TYPE_AUDIO )
+    {
+        SDL_ffmpegSetError( "only audio and video streams can be copied" );
+        return 0;
+    }
+
+    /* add a stream */
+    AVStream *stream = av_new_stream( file->_ffmpeg, file->audioStreams + file->videoStreams );
+    if ( !stream )
+    {
+        SDL_ffmpegSetError( "could not allocate stream" );
+        return 0;
+    }
+
+    AVCodecContext *codec = stream->codec;
+
+    codec->codec_id = input->codec_id;
+    codec->codec_type = input->codec_type;
+
+    /* keep the tag of the input, unless the output format uses another tag for this codec */
+    AVOutputFormat *format = file->_ffmpeg->oformat;
+
+    if ( !format->codec_tag || av_codec_get_id( format->codec_tag, input->codec_tag ) == input->codec_id || av_codec_get_tag( format->codec_tag, input->codec_id ) <= 0 )
+    {
+        codec->codec_tag = input->codec_tag;
+    }
+
+    codec->bit_rate = input->bit_rate;
+
+    /* headers of the codec are stored in extradata, which the muxer needs */
+    if ( input->extradata_size > 0 )
+    {
+        codec->extradata = ( uint8_t* )av_mallocz( input->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE );
+        if ( !codec->extradata )
+        {
+            SDL_ffmpegSetError( "could not allocate codec headers" );
+            return 0;
+        }
+
+        memcpy( codec->extradata, input->extradata, input->extradata_size );
+
+        codec->extradata_size = input->extradata_size;
+    }
+
+    codec->time_base = input->time_base;
+
+    if ( codec->codec_type == CODEC_TYPE_VIDEO )
+    {
+        codec->pix_fmt = input->pix_fmt;
+        codec->width = input->width;
+        codec->height = input->height;
+        codec->has_b_frames = input->has_b_frames;
+        codec->sample_aspect_ratio = input->sample_aspect_ratio;
+
+        stream->sample_aspect_ratio = source->_ffmpeg->sample_aspect_ratio;
+    }
+    else
+    {
+        codec->channel_layout = input->channel_layout;
+        codec->sample_rate = input->sample_rate;
+        codec->channels = input->channels;
+        codec->frame_size = input->frame_size;
+        codec->block_align = input->block_align;
+    }
+
+    /* some formats want stream headers to be separate */
+    if ( file->_ffmpeg->oformat->flags & AVFMT_GLOBALHEADER )
+    {
+        codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    /* create a new stream */
+    SDL_ffmpegStream *str = ( SDL_ffmpegStream* )malloc( sizeof( SDL_ffmpegStream ) );
+
+    if ( str )
+    {
+        /* we set our stream to zero */
+        memset( str, 0, sizeof( SDL_ffmpegStream ) );
+
+        str->id = file->audioStreams + file->videoStreams;
+
+        /* _ffmpeg holds data about streamcodec */
+        str->_ffmpeg = stream;
+
+        str->copySource = source;
+
+        /* no packet was queued for muxing yet */
+        str->muxTime = AV_NOPTS_VALUE;
+
+        str->mutex = SDL_CreateMutex();
+
+        str->audioFifo.pts = AV_NOPTS_VALUE;
+
+        /* find correct place to save the stream */
+        SDL_ffmpegStream **s = &file->as;
+
+        if ( codec->codec_type == CODEC_TYPE_VIDEO )
+        {
+            s = &file->vs;
+
+            file->videoStreams++;
+        }
+        else
+        {
+            file->audioStreams++;
+        }
+
+        while ( *s )
+        {
+            s = &( *s )->next;
+        }
+
+        *s = str;
+
+        if ( av_set_parameters( file->_ffmpeg, 0 ) < 0 )
+        {
+            SDL_ffmpegSetError( "could not set encoding parameters" );
+            return 0;
+        }
+
+        /* try to write a header */
+        av_write_header( file->_ffmpeg );
+    }
+
+    return str;
+}
+
+
+/** \brief  Copy the packets of an input file into the copy streams of file
+
+            Every stream which was added to file by SDL_ffmpegAddCopyStream
+            with a stream of input as source receives the packets of that
+            stream. The cut starts at the last keyframe at or before start
+            and ends before the first keyframe at or after end, keyframes
+            of the first copied video stream are used when there is one.
+            Timestamps are rebased, so the cut starts at zero. Afterwards,
+            input is positioned at start.
+\param      file SDL_ffmpegFile which was created by SDL_ffmpegCreate.
+\param      input SDL_ffmpegFile which was opened by SDL_ffmpegOpen.
+\param      start Start of the cut in milliseconds.
+\param      end End of the cut in milliseconds, zero to copy until the end of input.
+\returns    -1 on error, otherwise 0
+*/
+int SDL_ffmpegRemux( SDL_ffmpegFile *file, SDL_ffmpegFile *input, uint64_t start, uint64_t end )
+{
+    if ( !file || !input || file->type != SDL_ffmpegOutputStream || input->type != SDL_ffmpegInputStream )
+    {
+        SDL_ffmpegSetError( "remuxing requires an input and an output file" );
+        return -1;
+    }
+
+    if ( end && end <= start )
+    {
+        SDL_ffmpegSetError( "end of cut should follow its start" );
+        return -1;
+    }
+
+    /* input is locked first, it is only read from */
+    SDL_LockMutex( input->streamMutex );
+
+    SDL_LockMutex( file->streamMutex );
+
+    /* keyframes of this stream decide where the cut starts and ends */
+    SDL_ffmpegStream *reference = file->vs;
+    while ( reference && !SDL_ffmpegCopiesFrom( reference, input ) ) reference = reference->next;
+
+    if ( !reference )
+    {
+        reference = file->as;
+        while ( reference && !SDL_ffmpegCopiesFrom( reference, input ) ) reference = reference->next;
+    }
+
+    if ( !reference )
+    {
+        SDL_UnlockMutex( file->streamMutex );
+
+        SDL_UnlockMutex( input->streamMutex );
+
+        SDL_ffmpegSetError( "no stream of file copies from input" );
+        return -1;
+    }
+
+    /* the reader thread should not read while we copy */
+    if ( input->readThread ) SDL_LockMutex( input->readMutex );
+
+    SDL_ffmpegCopyDiscard( file, input, 1 );
+
+    /* AVSEEK_FLAG_BACKWARD means we jump to the first keyframe before start */
+    av_seek_frame( input->_ffmpeg, -1, start * ( AV_TIME_BASE / 1000 ), AVSEEK_FLAG_BACKWARD );
+
+    int64_t startTime = AV_NOPTS_VALUE;
+    int64_t endTime = end * ( AV_TIME_BASE / 1000 );
+
+    int error = 0;
+
+    AVPacket pkt;
+
+    while ( !error && av_read_frame( input->_ffmpeg, &pkt ) >= 0 )
+    {
+        SDL_ffmpegStream *stream = SDL_ffmpegCopyTarget( file, input, pkt.stream_index );
+
+        if ( stream )
+        {
+            AVStream *source = input->_ffmpeg->streams[ pkt.stream_index ];
+
+            int64_t ts = pkt.dts != AV_NOPTS_VALUE ? pkt.dts : pkt.pts;
+
+            /* packets without a timestamp go along with the packets around them */
+            int64_t time = startTime;
+
+            if ( ts != AV_NOPTS_VALUE )
+            {
+                time = av_rescale( ts, AV_TIME_BASE * ( int64_t )source->time_base.num, source->time_base.den );
+            }
+
+            int key = stream == reference && ( pkt.flags & PKT_FLAG_KEY ) && ts != AV_NOPTS_VALUE;
+
+            if ( key && startTime == AV_NOPTS_VALUE ) startTime = time;
+
+            if ( key && end && time >= endTime && time > startTime )
+            {
+                av_free_packet( &pkt );
+                break;
+            }
+
+            /* packets of other streams which precede the first keyframe are dropped */
+            if ( startTime != AV_NOPTS_VALUE && time >= startTime )
+            {
+                error = SDL_ffmpegCopyPacket( file, stream, source, &pkt, startTime );
+            }
+        }
+
+        av_free_packet( &pkt );
+    }
+
+    SDL_ffmpegCopyDiscard( file, input, 0 );
+
+    if ( input->readThread ) SDL_UnlockMutex( input->readMutex );
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    /* buffers of input belong to the position before the cut */
+    SDL_ffmpegSeekStreams( input, start );
+
+    SDL_ffmpegFlushAudioRing( input );
+
+    SDL_UnlockMutex( input->streamMutex );
+
+    return error;
+}
+
+
+/** \brief  Use this function to query if an error occured
+
+            Errors are kept for every thread, so this only reports errors of
+            functions which were called by the calling thread.
+\returns    non-zero when an error occured
+*/
+int SDL_ffmpegError()
+{
+    return SDL_ffmpegErrorMessage[ 0 ];
+}
+
+
+/** \brief  Use this function to get the last error string
+
+            Every thread has its own last error.
+\returns    When no error was found, NULL is returned
+*/
+const char* SDL_ffmpegGetError()
+{
+    return SDL_ffmpegErrorMessage;
+}
+
+
+/** \brief  Use this function to clear the standing error of the calling thread
+
+*/
+void SDL_ffmpegClearError()
+{
+    SDL_ffmpegErrorMessage[ 0 ] = 0;
+}
+
+/**
+\cond
+*/
+
+void SDL_ffmpegSetError( const char *error )
+{
+    if ( !error ) return;
+
+    if ( snprintf( SDL_ffmpegErrorMessage, 512, "%s", error ) >= 511 )
+    {
+        SDL_ffmpegErrorMessage[ 511 ] = 0;
+    }
+}
+
+int SDL_ffmpegCPUCount()
+{
+#ifdef WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo( &info );
+
+    return info.dwNumberOfProcessors;
+#elif defined( _SC_NPROCESSORS_ONLN )
+    long count = sysconf( _SC_NPROCESSORS_ONLN );
+
+    return count > 0 ? ( int )count : 1;
+#else
+    return 1;
+#endif
+}
+
+void SDL_ffmpegApplyThreads( AVCodecContext *codec, int threads, int type )
+{
+    if ( threads == SDL_FFMPEG_AUTO_THREADS ) threads = SDL_ffmpegCPUCount();
+
+    if ( threads < 1 ) threads = 1;
+
+#ifdef FF_THREAD_FRAME
+    /* SDL_ffmpegThreadType matches the FF_THREAD flags, the default lets
+       the codec pick either, like a newly allocated context does */
+    codec->thread_type = type ? type : FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+    codec->thread_count = threads;
+#else
+    /* only slice threading is available in this version of ffmpeg */
+    if ( threads > 1 ) avcodec_thread_init( codec, threads );
+#endif
+}
+
+int SDL_ffmpegOpenDecoder( SDL_ffmpegStream *stream )
+{
+    AVCodecContext *context = stream->_ffmpeg->codec;
+
+    /* get the correct decoder for this stream */
+    AVCodec *codec = avcodec_find_decoder( context->codec_id );
+
+    if ( !codec )
+    {
+        SDL_ffmpegSetError( context->codec_type == CODEC_TYPE_VIDEO ? "could not find video codec" : "could not find audio codec" );
+        return -1;
+    }
+
+    /* threads need to be set before the codec is opened */
+    SDL_ffmpegApplyThreads( context, stream->threadCount, stream->threadType );
+
+    if ( avcodec_open( context, codec ) < 0 )
+    {
+        SDL_ffmpegSetError( context->codec_type == CODEC_TYPE_VIDEO ? "could not open video codec" : "could not open audio codec" );
+        return -1;
+    }
+
+    return 0;
+}
+
+int SDL_ffmpegLockManager( void **mutex, enum AVLockOp op )
+{
+    switch ( op )
+    {
+        case AV_LOCK_CREATE:
+            *mutex = SDL_CreateMutex();
+            return *mutex ? 0 : 1;
+
+        case AV_LOCK_OBTAIN:
+            return SDL_LockMutex(( SDL_mutex* )*mutex ) ? 1 : 0;
+
+        case AV_LOCK_RELEASE:
+            return SDL_UnlockMutex(( SDL_mutex* )*mutex ) ? 1 : 0;
+
+        case AV_LOCK_DESTROY:
+            SDL_DestroyMutex(( SDL_mutex* )*mutex );
+            *mutex = 0;
+            return 0;
+    }
+
+    return 1;
+}
+
+AVFormatContext* SDL_ffmpegOpenFormat( const char *filename, uint32_t probeSize, uint32_t analyzeDuration )
+{
+    AVFormatContext *format = 0;
+
+    /* open the file */
+    if ( av_open_input_file( &format, filename, 0, 0, 0 ) != 0 )
+    {
+        char c[512];
+        snprintf( c, 512, "could not open \"%s\"", filename );
+        SDL_ffmpegSetError( c );
+        return 0;
+    }
+
+    /* limit the amount of data which is analyzed to find the stream parameters */
+    if ( probeSize ) format->probesize = probeSize;
+
+    if ( analyzeDuration )
+    {
+        int64_t duration = ( int64_t )analyzeDuration * ( AV_TIME_BASE / 1000 );
+
+        format->max_analyze_duration = duration < INT_MAX ? ( int )duration : INT_MAX;
+    }
+
+    /* retrieve format information */
+    if ( av_find_stream_info( format ) < 0 )
+    {
+        char c[512];
+        snprintf( c, 512, "could not retrieve file info for \"%s\"", filename );
+        SDL_ffmpegSetError( c );
+        av_close_input_file( format );
+        return 0;
+    }
+
+    return format;
+}
+
+int SDL_ffmpegActivateStream( SDL_ffmpegStream *stream )
+{
+    /* entering this function, streamMutex should have been locked */
+
+    /* stream is already active */
+    if ( stream->_ffmpeg->codec->codec ) return 0;
+
+    if ( SDL_ffmpegOpenDecoder( stream ) ) return -1;
+
+    if ( stream->_ffmpeg->codec->codec_type == CODEC_TYPE_VIDEO )
+    {
+        stream->decodeFrame = avcodec_alloc_frame();
+    }
+    else
+    {
+        memset( &stream->audioFifo, 0, sizeof( SDL_ffmpegAudioFifo ) );
+
+        stream->audioFifo.pts = AV_NOPTS_VALUE;
+
+        /* room for at least one decoded frame */
+        SDL_ffmpegAudioFifoReserve( &stream->audioFifo, AVCODEC_MAX_AUDIO_FRAME_SIZE * sizeof( int16_t ) );
+    }
+
+    if ( !stream->decodeFrame && !stream->audioFifo.buffer )
+    {
+        avcodec_close( stream->_ffmpeg->codec );
+
+        SDL_ffmpegSetError( "could not allocate decode buffers" );
+        return -1;
+    }
+
+    return 0;
+}
+
+void SDL_ffmpegDeactivateStream( SDL_ffmpegStream *stream )
+{
+    /* entering this function, streamMutex should have been locked */
+
+    /* packets which are still buffered are of no use anymore */
+    SDL_LockMutex( stream->mutex );
+
+    SDL_ffmpegQueueFlush( stream );
+
+    SDL_UnlockMutex( stream->mutex );
+
+    if ( stream->_ffmpeg->codec->codec ) avcodec_close( stream->_ffmpeg->codec );
+
+    av_free( stream->decodeFrame );
+
+    stream->decodeFrame = 0;
+
+    SDL_ffmpegConversionFlush( &stream->conversionCache );
+
+    av_free( stream->audioFifo.buffer );
+
+    memset( &stream->audioFifo, 0, sizeof( SDL_ffmpegAudioFifo ) );
+
+    SDL_ffmpegAudioConverterFree( &stream->audioConverter );
+}
+
+int SDL_ffmpegGetPacket( SDL_ffmpegFile *file )
+{
+    /* entering this function, streamMutex should have been locked, or
+       readMutex when called from the reader thread */
+
+    AVPacket pkt;
+
+    /* initialize packet */
+    av_init_packet( &pkt );
+
+    /* read a packet from the file, if we did not get a packet,
+       we probably reached the end of the file */
+    if ( av_read_frame( file->_ffmpeg, &pkt ) < 0 ) return 1;
+
+    /* we got a packet, lets handle it */
+    SDL_ffmpegStream *stream = 0;
+
+    /* If it's a packet from either of our streams, store it */
+    if ( file->audioStream && pkt.stream_index == file->audioStream->id )
+    {
+        stream = file->audioStream;
+    }
+    else if ( file->videoStream && pkt.stream_index == file->videoStream->id )
+    {
+        stream = file->videoStream;
+    }
+
+    if ( stream )
+    {
+        /* the payload read by the demuxer is kept, only its wrapper is recycled */
+        SDL_ffmpegPacket *pack = SDL_ffmpegAdoptPacket( &file->packetPool, &pkt );
+
+        if ( pack ) SDL_ffmpegBufferPacket( stream, pack );
+    }
+
+    /* releases the payload when it was not adopted */
+    av_free_packet( &pkt );
+
+    return 0;
+}
+
+void SDL_ffmpegBufferPacket( SDL_ffmpegStream *stream, SDL_ffmpegPacket *pack )
+{
+    SDL_LockMutex( stream->mutex );
+
+    if ( SDL_ffmpegQueuePush( stream, pack ) )
+    {
+        SDL_ffmpegReleasePacket( pack );
+    }
+    else
+    {
+        /* wake up a thread waiting for this packet */
+        SDL_CondSignal( stream->bufferCond );
+    }
+
+    SDL_UnlockMutex( stream->mutex );
+}
+
+SDL_ffmpegPacket* SDL_ffmpegAcquirePacket( SDL_ffmpegPacketPool *pool, int size )
+{
+    SDL_LockMutex( pool->mutex );
+
+    /* keep track of the typical packet size, new buffers are sized after it */
+    pool->averageSize = ( pool->averageSize * 15 + size ) / 16;
+
+    SDL_UnlockMutex( pool->mutex );
+
+    SDL_ffmpegPacket *pack = SDL_ffmpegTakePacket( pool );
+    if ( !pack ) return 0;
+
+    /* (re)initialize packet, the payload is owned by the pool */
+    av_init_packet( pack->data );
+
+    pack->data->destruct = 0;
+
+    /* make sure the payload fits */
+    if ( !pack->data->data || pack->capacity < size )
+    {
+        int capacity = size > ( int )pool->averageSize ? size : ( int )pool->averageSize;
+
+        /* round up, so the buffer can hold slightly larger packets later on */
+        capacity = ( capacity + 4095 ) & ~4095;
+
+        uint8_t *data = ( uint8_t* )av_realloc( pack->data->data, capacity + FF_INPUT_BUFFER_PADDING_SIZE );
+        if ( !data )
+        {
+            SDL_ffmpegDestroyPacket( pack );
+            return 0;
+        }
+
+        pack->data->data = data;
+        pack->capacity = capacity;
+    }
+
+    return pack;
+}
+
+SDL_ffmpegPacket* SDL_ffmpegAdoptPacket( SDL_ffmpegPacketPool *pool, AVPacket *pkt )
+{
+    /* the payload might point into a buffer which the demuxer reuses,
+       in that case it is copied, otherwise pkt already owns it */
+    if ( av_dup_packet( pkt ) < 0 ) return 0;
+
+    SDL_ffmpegPacket *pack = SDL_ffmpegTakePacket( pool );
+    if ( !pack ) return 0;
+
+    /* the payload of the pool is not needed, pkt brings its own */
+    av_free( pack->data->data );
+
+    pack->capacity = 0;
+
+    /* take over payload and destructor, pkt is left empty */
+    *pack->data = *pkt;
+
+    av_init_packet( pkt );
+
+    pkt->data = 0;
+    pkt->size = 0;
+
+    return pack;
+}
+
+SDL_ffmpegPacket* SDL_ffmpegTakePacket( SDL_ffmpegPacketPool *pool )
+{
+    SDL_LockMutex( pool->mutex );
+
+    SDL_ffmpegPacket *pack = pool->free;
+
+    if ( pack )
+    {
+        pool->free = pack->next;
+
+        pool->count--;
+    }
+
+    SDL_UnlockMutex( pool->mutex );
+
+    if ( pack ) return pack;
+
+    pack = ( SDL_ffmpegPacket* )malloc( sizeof( SDL_ffmpegPacket ) );
+    if ( !pack ) return 0;
+
+    memset( pack, 0, sizeof( SDL_ffmpegPacket ) );
+
+    pack->pool = pool;
+
+    pack->data = ( AVPacket* )av_malloc( sizeof( AVPacket ) );
+    if ( !pack->data )
+    {
+        free( pack );
+        return 0;
+    }
+
+    /* a payload is attached by the caller */
+    av_init_packet( pack->data );
+
+    pack->data->data = 0;
+    pack->data->destruct = 0;
+
+    return pack;
+}
+
+void SDL_ffmpegReleasePacket( SDL_ffmpegPacket *pack )
+{
+    SDL_ffmpegPacketPool *pool = pack->pool;
+
+    /* an adopted payload is released right away, only the wrapper is kept */
+    if ( pack->data->destruct )
+    {
+        av_free_packet( pack->data );
+
+        pack->data->destruct = 0;
+    }
+
+    SDL_LockMutex( pool->mutex );
+
+    /* keep the packet for recycling, unless we have plenty; a buffer of
+       the pool is dropped when it is far larger than the packets which
+       are usually muxed, demuxed packets have no buffer left by now */
+    int keep = pool->count < SDL_FFMPEG_POOL_SIZE;
+
+    if ( pack->capacity && pack->capacity > 4 * ( int )pool->averageSize + 4096 ) keep = 0;
+
+    if ( keep )
+    {
+        pack->next = pool->free;
+
+        pool->free = pack;
+
+        pool->count++;
+
+        pack = 0;
+    }
+
+    SDL_UnlockMutex( pool->mutex );
+
+    if ( pack ) SDL_ffmpegDestroyPacket( pack );
+}
+
+void SDL_ffmpegDestroyPacket( SDL_ffmpegPacket *pack )
+{
+    if ( pack->data->destruct )
+    {
+        av_free_packet( pack->data );
+    }
+    else
+    {
+        av_free( pack->data->data );
+    }
+
+    av_free( pack->data );
+
+    free( pack );
+}
+
+int SDL_ffmpegFetchPacket( SDL_ffmpegFile *file, SDL_ffmpegStream *stream )
+{
+    /* entering this function, streamMutex should have been locked once */
+
+    /* without a reader thread, we read the packet ourselves */
+    if ( !file->readThread ) return SDL_ffmpegGetPacket( file );
+
+    SDL_LockMutex( stream->mutex );
+
+    while ( stream->buffer.head == stream->buffer.tail && !file->endOfFile && !file->stopReading )
+    {
+        uint32_t generation = file->streamGeneration;
+
+        /* other threads can use the file while the reader thread catches up,
+           stream->mutex is released first to keep the order of the locks */
+        SDL_UnlockMutex( stream->mutex );
+
+        SDL_UnlockMutex( file->streamMutex );
+
+        SDL_LockMutex( stream->mutex );
+
+        /* the reader thread signals bufferCond when a packet was added */
+        while ( stream->buffer.head == stream->buffer.tail && !file->endOfFile && !file->stopReading && generation == file->streamGeneration )
+        {
+            SDL_CondWait( stream->bufferCond, stream->mutex );
+        }
+
+        SDL_UnlockMutex( stream->mutex );
+
+        SDL_LockMutex( file->streamMutex );
+
+        /* the decoding state of the caller is gone when streams changed meanwhile */
+        if ( generation != file->streamGeneration ) return -1;
+
+        SDL_LockMutex( stream->mutex );
+    }
+
+    /* signal EOF when no more packets will arrive */
+    int eof = ( stream->buffer.head == stream->buffer.tail );
+
+    SDL_UnlockMutex( stream->mutex );
+
+    return eof;
+}
+
+void SDL_ffmpegStreamsChanged( SDL_ffmpegFile *file )
+{
+    /* entering this function, streamMutex should have been locked */
+
+    file->streamGeneration++;
+
+    /* threads waiting for packets give up what they were decoding */
+    SDL_ffmpegStream *lists[] = { file->vs, file->as };
+
+    for ( int i = 0; i < 2; i++ )
+    {
+        for ( SDL_ffmpegStream *s = lists[ i ]; s; s = s->next )
+        {
+            if ( !s->mutex ) continue;
+
+            SDL_LockMutex( s->mutex );
+
+            SDL_CondBroadcast( s->bufferCond );
+
+            SDL_UnlockMutex( s->mutex );
+        }
+    }
+}
+
+int SDL_ffmpegBuffersFull( SDL_ffmpegFile *file )
+{
+    /* readMutex should be locked, so the selected streams don't change */
+    SDL_ffmpegStream *streams[] = { file->audioStream, file->videoStream };
+
+    int selected = 0,
+        satisfied = 0,
+        blocked = 0,
+        starving = 0;
+
+    for ( int i = 0; i < 2; i++ )
+    {
+        if ( !streams[ i ] ) continue;
+
+        SDL_LockMutex( streams[ i ]->mutex );
+
+        SDL_ffmpegPacketQueue *queue = &streams[ i ]->buffer;
+
+        selected++;
+
+        if ( queue->head == queue->tail ) starving = 1;
+
+        if ( SDL_ffmpegQueueFull( queue ) )
+        {
+            satisfied++;
+
+            if ( queue->policy == SDL_ffmpegQueueBlock ) blocked = 1;
+        }
+        else if ( queue->tail - queue->head >= SDL_FFMPEG_READ_AHEAD )
+        {
+            satisfied++;
+        }
+
+        SDL_UnlockMutex( streams[ i ]->mutex );
+    }
+
+    /* when no stream is selected, there is nothing to read */
+    if ( !selected ) return 1;
+
+    /* a full blocking queue stops the reader, unless this would starve
+       another stream, in which case the limit is exceeded to prevent
+       a deadlock */
+    if ( blocked && !starving ) return 1;
+
+    /* stop reading when all streams have enough packets */
+    return satisfied == selected;
+}
+
+int SDL_ffmpegReadThread( void *data )
+{
+    SDL_ffmpegFile *file = ( SDL_ffmpegFile* )data;
+
+    while ( !file->stopReading )
+    {
+        SDL_LockMutex( file->readMutex );
+
+        /* wait until packets are taken from the buffers, or a seek occured */
+        while ( !file->stopReading && ( file->endOfFile || SDL_ffmpegBuffersFull( file ) ) )
+        {
+            SDL_CondWaitTimeout( file->readCond, file->readMutex, 10 );
+        }
+
+        if ( !file->stopReading && SDL_ffmpegGetPacket( file ) )
+        {
+            file->endOfFile = 1;
+
+            /* wake up all threads waiting for packets */
+            SDL_ffmpegStream *s;
+
+            for ( s = file->vs; s; s = s->next )
+            {
+                SDL_LockMutex( s->mutex );
+                SDL_CondBroadcast( s->bufferCond );
+                SDL_UnlockMutex( s->mutex );
+            }
+
+            for ( s = file->as; s; s = s->next )
+            {
+                SDL_LockMutex( s->mutex );
+                SDL_CondBroadcast( s->bufferCond );
+                SDL_UnlockMutex( s->mutex );
+            }
+        }
+
+        SDL_UnlockMutex( file->readMutex );
+    }
+
+    return 0;
+}
+
+SDL_ffmpegPacket* SDL_ffmpegGetAudioPacket( SDL_ffmpegFile *file )
+{
+    if ( !file->audioStream ) return 0;
+
+    SDL_LockMutex( file->audioStream->mutex );
+
+    SDL_ffmpegPacket *pack = SDL_ffmpegQueuePop( file->audioStream );
+
+    SDL_UnlockMutex( file->audioStream->mutex );
+
+    /* there is room for a new packet */
+    if ( pack && file->readThread ) SDL_CondSignal( file->readCond );
+
+    /* if a packet was found, return it */
+    return pack;
+}
+
+SDL_ffmpegPacket* SDL_ffmpegGetVideoPacket( SDL_ffmpegFile *file )
+{
+    if ( !file->videoStream ) return 0;
+
+    SDL_LockMutex( file->videoStream->mutex );
+
+    SDL_ffmpegPacket *pack = SDL_ffmpegQueuePop( file->videoStream );
+
+    SDL_UnlockMutex( file->videoStream->mutex );
+
+    /* there is room for a new packet */
+    if ( pack && file->readThread ) SDL_CondSignal( file->readCond );
+
+    /* if a packet was found, return it */
+    return pack;
+}
+
+int64_t SDL_ffmpegPacketDuration( SDL_ffmpegStream *stream, SDL_ffmpegPacket *pack )
+{
+    return av_rescale( 1000 * pack->data->duration, stream->_ffmpeg->time_base.num, stream->_ffmpeg->time_base.den );
+}
+
+int SDL_ffmpegQueueGrow( SDL_ffmpegPacketQueue *queue )
+{
+    uint32_t size = queue->size ? queue->size * 2 : 64;
+
+    SDL_ffmpegPacket **packets = ( SDL_ffmpegPacket** )malloc( size * sizeof( SDL_ffmpegPacket* ) );
+    if ( !packets ) return -1;
+
+    /* copy the queued packets in order, so the ring starts at zero again */
+    uint32_t count = queue->tail - queue->head;
+
+    for ( uint32_t i = 0; i < count; i++ )
+    {
+        packets[ i ] = queue->packets[( queue->head + i ) & ( queue->size - 1 )];
+    }
+
+    free( queue->packets );
+
+    queue->packets = packets;
+    queue->size = size;
+    queue->head = 0;
+    queue->tail = count;
+
+    return 0;
+}
+
+int SDL_ffmpegQueuePush( SDL_ffmpegStream *stream, SDL_ffmpegPacket *pack )
+{
+    /* stream->mutex should be locked before entering this function */
+    SDL_ffmpegPacketQueue *queue = &stream->buffer;
+
+    /* a dropping queue makes room by discarding its oldest packets */
+    if ( queue->policy == SDL_ffmpegQueueDrop )
+    {
+        while ( queue->head != queue->tail && SDL_ffmpegQueueFull( queue ) )
+        {
+            SDL_ffmpegReleasePacket( SDL_ffmpegQueuePop( stream ) );
+        }
+    }
+
+    if ( queue->tail - queue->head == queue->size && SDL_ffmpegQueueGrow( queue ) ) return -1;
+
+    queue->packets[ queue->tail++ & ( queue->size - 1 )] = pack;
+
+    queue->bytes += pack->data->size;
+    queue->duration += SDL_ffmpegPacketDuration( stream, pack );
+
+    return 0;
+}
+
+int SDL_ffmpegQueueUnget( SDL_ffmpegStream *stream, SDL_ffmpegPacket *pack )
+{
+    /* stream->mutex should be locked before entering this function */
+    SDL_ffmpegPacketQueue *queue = &stream->buffer;
+
+    if ( queue->tail - queue->head == queue->size && SDL_ffmpegQueueGrow( queue ) ) return -1;
+
+    queue->packets[ --queue->head & ( queue->size - 1 )] = pack;
+
+    queue->bytes += pack->data->size;
+    queue->duration += SDL_ffmpegPacketDuration( stream, pack );
+
+    return 0;
+}
+
+SDL_ffmpegPacket* SDL_ffmpegQueuePop( SDL_ffmpegStream *stream )
+{
+    /* stream->mutex should be locked before entering this function */
+    SDL_ffmpegPacketQueue *queue = &stream->buffer;
+
+    if ( queue->head == queue->tail ) return 0;
+
+    SDL_ffmpegPacket *pack = queue->packets[ queue->head++ & ( queue->size - 1 )];
+
+    queue->bytes -= pack->data->size;
+    queue->duration -= SDL_ffmpegPacketDuration( stream, pack );
+
+    return pack;
+}
+
+int SDL_ffmpegQueueFull( SDL_ffmpegPacketQueue *queue )
+{
+    if ( queue->maxPackets && queue->tail - queue->head >= queue->maxPackets ) return 1;
+
+    if ( queue->maxBytes && queue->bytes >= queue->maxBytes ) return 1;
+
+    if ( queue->maxDuration && queue->duration >= queue->maxDuration ) return 1;
+
+    return 0;
+}
+
+void SDL_ffmpegQueueFlush( SDL_ffmpegStream *stream )
+{
+    SDL_ffmpegPacket *pack;
+
+    while (( pack = SDL_ffmpegQueuePop( stream ) ) )
+    {
+        SDL_ffmpegReleasePacket( pack );
+    }
+
+    stream->buffer.bytes = 0;
+    stream->buffer.duration = 0;
+}
+
+int SDL_ffmpegReadAudioFrame( SDL_ffmpegFile *file, SDL_ffmpegAudioFrame *frame )
+{
+    /* entering this function, streamMutex should have been locked once */
+
+    if ( !file->audioStream )
+    {
+        SDL_ffmpegSetError( "no valid audio stream selected" );
+        return 0;
+    }
+
+    /* reset frame end pointer and size */
+    frame->last = 0;
+    frame->size = 0;
+
+    /* use data which was decoded earlier first, this also drains the
+       decoded audio which is left when no more packets follow */
+    SDL_ffmpegAudioFifoRead( file->audioStream, frame );
+
+    SDL_ffmpegPacket *pack = 0;
+
+    /* get new packet */
+    if ( frame->size < frame->capacity )
+    {
+        pack = SDL_ffmpegGetAudioPacket( file );
+
+        while ( !pack && !frame->last )
+        {
+            int last = SDL_ffmpegFetchPacket( file, file->audioStream );
+
+            /* the audio belongs to streams which were changed while waiting */
+            if ( last < 0 )
+            {
+                frame->size = 0;
+                return 0;
+            }
+
+            frame->last = last;
+
+            pack = SDL_ffmpegGetAudioPacket( file );
+        }
+    }
+
+    /* SDL_ffmpegDecodeAudioFrame will return true if data from pack was used
+       frame will be updated with the new data */
+    while ( pack && SDL_ffmpegDecodeAudioFrame( file, pack->data, frame ) )
+    {
+        /* destroy used packet */
+        SDL_ffmpegReleasePacket( pack );
+
+        pack = 0;
+
+        /* check if new packet is required */
+        if ( frame->size < frame->capacity )
+        {
+            /* try to get a new packet */
+            pack = SDL_ffmpegGetAudioPacket( file );
+
+            while ( !pack && !frame->last )
+            {
+                int last = SDL_ffmpegFetchPacket( file, file->audioStream );
+
+                if ( last < 0 )
+                {
+                    frame->size = 0;
+                    return 0;
+                }
+
+                frame->last = last;
+
+                pack = SDL_ffmpegGetAudioPacket( file );
+            }
+        }
+    }
+
+    /* pack retreived, but was not used, push it back in the buffer */
+    if ( pack )
+    {
+        SDL_LockMutex( file->audioStream->mutex );
+
+        if ( SDL_ffmpegQueueUnget( file->audioStream, pack ) ) SDL_ffmpegReleasePacket( pack );
+
+        SDL_UnlockMutex( file->audioStream->mutex );
+    }
+
+    return ( frame->size == frame->capacity );
+}
+
+int SDL_ffmpegDecodeAudioFrame( SDL_ffmpegFile *file, AVPacket *pack, SDL_ffmpegAudioFrame *frame )
+{
+    /* use data which was decoded earlier first */
+    SDL_ffmpegAudioFifoRead( file->audioStream, frame );
+
+    /* return 0 to signal caller that 'pack' was not used */
+    if ( frame->size == frame->capacity ) return 0;
+
+    SDL_ffmpegDecodeAudioPacket( file, pack );
+
+    SDL_ffmpegAudioFifoRead( file->audioStream, frame );
+
+    /* pack was used, return 1 */
+    return 1;
+}
+
+int SDL_ffmpegDecodeAudioPacket( SDL_ffmpegFile *file, AVPacket *pack )
+{
+    SDL_ffmpegStream *stream = file->audioStream;
+    SDL_ffmpegAudioFifo *fifo = &stream->audioFifo;
+    SDL_ffmpegAudioConverter *converter = &stream->audioConverter;
+    AVCodecContext *codec = stream->_ffmpeg->codec;
+
+    /* audio is converted when the output format differs from the stream */
+    int convert = SDL_ffmpegAudioConverterPrepare( file, stream );
+
+    /* the packet can not be used */
+    if ( convert < 0 ) return -1;
+
+    /* calculate pts to determine wheter or not this packet should be stored */
+    int64_t pts = AV_NOPTS_VALUE;
+
+    if ( pack->dts != AV_NOPTS_VALUE )
+    {
+        pts = av_rescale(( pack->dts - stream->_ffmpeg->start_time ) * 1000, stream->_ffmpeg->time_base.num, stream->_ffmpeg->time_base.den );
+    }
+
+    /* don't decode packets which end before the minimal timestamp, a packet
+       without duration might contain it and is trimmed after decoding */
+    codec->hurry_up = 0;
+
+    if ( pts != AV_NOPTS_VALUE && pack->duration > 0 )
+    {
+        int64_t end = av_rescale(( pack->dts + pack->duration - stream->_ffmpeg->start_time ) * 1000, stream->_ffmpeg->time_base.num, stream->_ffmpeg->time_base.den );
+
+        codec->hurry_up = ( end <= file->minimalTimestamp );
+    }
+
+    /* after a flush, the first packet which is decoded sets the time of the
+       first sample, from there on time is counted in samples */
+    if ( fifo->pts == AV_NOPTS_VALUE && pts != AV_NOPTS_VALUE && !codec->hurry_up )
+    {
+        fifo->pts = pts;
+        fifo->consumed = 0;
+
+        if ( pts < file->minimalTimestamp )
+        {
+            int rate, channels;
+            uint16_t format;
+
+            SDL_ffmpegAudioOutputSpec( file, &rate, &channels, &format );
+
+            AVRational base = stream->_ffmpeg->time_base;
+
+            /* samples from the start of this packet up to the minimal timestamp,
+               calculated from the exact packet time instead of milliseconds */
+            int64_t samples = av_rescale( file->minimalTimestamp * base.den - ( pack->dts - stream->_ffmpeg->start_time ) * 1000 * base.num, rate, 1000 * ( int64_t )base.den );
+
+            /* those samples are dropped, so the first sample is at the minimal timestamp */
+            fifo->skip = samples * channels * SDL_ffmpegAudioBytesPerSample( format );
+            fifo->pts = file->minimalTimestamp;
+        }
+    }
+
+    /* a packet can hold multiple frames, walk through all of them */
+    AVPacket data = *pack;
+
+    while ( data.size > 0 )
+    {
+        int16_t *samples;
+        int audioSize;
+
+        if ( convert )
+        {
+            /* converted audio is added to the fifo by SDL_ffmpegAudioConvert */
+            samples = converter->decoded;
+            audioSize = AVCODEC_MAX_AUDIO_FRAME_SIZE * sizeof( int16_t );
+        }
+        else
+        {
+            /* decoded frames are appended, so the decoder needs room at the end */
+            if ( SDL_ffmpegAudioFifoReserve( fifo, AVCODEC_MAX_AUDIO_FRAME_SIZE * sizeof( int16_t ) ) ) return -1;
+
+            samples = ( int16_t* )( fifo->buffer + fifo->offset + fifo->size );
+            audioSize = fifo->capacity - fifo->offset - fifo->size;
+        }
+
+        /* Decode the packet */
+
+#if ( LIBAVCODEC_VERSION_MAJOR <= 52 && LIBAVCODEC_VERSION_MINOR <= 20 )
+        int len = avcodec_decode_audio2( codec, samples, &audioSize, data.data, data.size );
+#else
+        int len = avcodec_decode_audio3( codec, samples, &audioSize, &data );
+#endif
+
+        /* if an error occured, we skip the rest of the packet */
+        if ( len <= 0 )
+        {
+            SDL_ffmpegSetError( "error decoding audio frame" );
+            return -1;
+        }
+
+        /* keep the decoded frame, unless it is too old */
+        if ( !codec->hurry_up && audioSize > 0 )
+        {
+            if ( !convert )
+            {
+                fifo->size += audioSize;
+            }
+            else if ( SDL_ffmpegAudioConvert( file, stream, samples, audioSize ) )
+            {
+                return -1;
+            }
+        }
+
+        /* change pointers */
+        data.data += len;
+        data.size -= len;
+    }
+
+    SDL_ffmpegAudioFifoSkip( fifo );
+
+    return 0;
+}
+
+void SDL_ffmpegAudioFifoSkip( SDL_ffmpegAudioFifo *fifo )
+{
+    if ( !fifo->skip ) return;
+
+    int bytes = fifo->skip < ( uint64_t )fifo->size ? ( int )fifo->skip : fifo->size;
+
+    /* skipped data does not count as consumed, the time of the fifo starts after it */
+    fifo->offset += bytes;
+    fifo->size -= bytes;
+    fifo->skip -= bytes;
+
+    if ( !fifo->size ) fifo->offset = 0;
+}
+
+int SDL_ffmpegAudioFifoReserve( SDL_ffmpegAudioFifo *fifo, int bytes )
+{
+    /* enough room behind the data */
+    if ( fifo->capacity - fifo->offset - fifo->size >= bytes ) return 0;
+
+    /* move the data to the front when that makes enough room */
+    if ( fifo->capacity - fifo->size >= bytes )
+    {
+        memmove( fifo->buffer, fifo->buffer + fifo->offset, fifo->size );
+
+        fifo->offset = 0;
+
+        return 0;
+    }
+
+    int capacity = fifo->capacity * 2;
+
+    if ( capacity < fifo->size + bytes ) capacity = fifo->size + bytes;
+
+    /* av_malloc keeps the alignment decoders expect from their output buffer */
+    uint8_t *buffer = ( uint8_t* )av_malloc( capacity );
+    if ( !buffer )
+    {
+        SDL_ffmpegSetError( "could not grow decoded audio buffer" );
+        return -1;
+    }
+
+    if ( fifo->size ) memcpy( buffer, fifo->buffer + fifo->offset, fifo->size );
+
+    av_free( fifo->buffer );
+
+    fifo->buffer = buffer;
+    fifo->capacity = capacity;
+    fifo->offset = 0;
+
+    return 0;
+}
+
+void SDL_ffmpegAudioFifoRead( SDL_ffmpegStream *stream, SDL_ffmpegAudioFrame *frame )
+{
+    SDL_ffmpegAudioFifo *fifo = &stream->audioFifo;
+
+    int bytes = frame->capacity - frame->size;
+
+    if ( bytes > fifo->size ) bytes = fifo->size;
+
+    if ( bytes <= 0 ) return;
+
+    /* set new pts */
+    if ( !frame->size )
+    {
+        frame->pts = fifo->pts;
+
+        if ( fifo->pts != AV_NOPTS_VALUE && fifo->bytesPerSecond > 0 )
+        {
+            frame->pts += ( int64_t )( fifo->consumed * 1000 / fifo->bytesPerSecond );
+        }
+    }
+
+    /* the data is contiguous, so a single copy will do */
+    memcpy( frame->buffer + frame->size, fifo->buffer + fifo->offset, bytes );
+
+    frame->size += bytes;
+
+    fifo->offset += bytes;
+    fifo->size -= bytes;
+    fifo->consumed += bytes;
+
+    /* start at the front again when the fifo is empty */
+    if ( !fifo->size ) fifo->offset = 0;
+}
+
+void SDL_ffmpegAudioOutputSpec( SDL_ffmpegFile *file, int *rate, int *channels, uint16_t *format )
+{
+    /* entering this function, streamMutex should have been locked */
+
+    AVCodecContext *codec = file->audioStream->_ffmpeg->codec;
+
+    *rate = file->audioOutput.rate ? file->audioOutput.rate : codec->sample_rate;
+    *channels = file->audioOutput.channels ? file->audioOutput.channels : codec->channels;
+    *format = file->audioOutput.format ? file->audioOutput.format : AUDIO_S16SYS;
+}
+
+int SDL_ffmpegAudioBytesPerSample( uint16_t format )
+{
+    /* the lowest byte of an SDL audio format holds the amount of bits */
+    return ( format & 0xFF ) / 8;
+}
+
+int SDL_ffmpegAudioConverterPrepare( SDL_ffmpegFile *file, SDL_ffmpegStream *stream )
+{
+    AVCodecContext *codec = stream->_ffmpeg->codec;
+    SDL_ffmpegAudioConverter *converter = &stream->audioConverter;
+
+    int rate, channels;
+    uint16_t format;
+
+    SDL_ffmpegAudioOutputSpec( file, &rate, &channels, &format );
+
+    stream->audioFifo.bytesPerSecond = rate * channels * SDL_ffmpegAudioBytesPerSample( format );
+
+    /* decoded audio can be used as is */
+    if ( rate == codec->sample_rate && channels == codec->channels && format == AUDIO_S16SYS ) return 0;
+
+    if ( codec->sample_rate <= 0 || codec->channels < 1 || codec->channels > SDL_FFMPEG_MAX_CHANNELS )
+    {
+        SDL_ffmpegSetError( "audio stream can not be converted" );
+        return -1;
+    }
+
+    /* set up again when the decoded audio or the output changed */
+    if ( converter->inRate != codec->sample_rate ||
+         converter->inChannels != codec->channels ||
+         converter->outRate != rate ||
+         converter->outChannels != channels ||
+         converter->quality != file->audioOutput.quality )
+    {
+        SDL_ffmpegAudioConverterFree( converter );
+
+        converter->inRate = codec->sample_rate;
+        converter->inChannels = codec->channels;
+        converter->outRate = rate;
+        converter->outChannels = channels;
+        converter->quality = file->audioOutput.quality;
+
+        SDL_ffmpegAudioConverterMatrix( converter );
+    }
+
+    if ( !converter->decoded )
+    {
+        converter->decoded = ( int16_t* )av_malloc( AVCODEC_MAX_AUDIO_FRAME_SIZE * sizeof( int16_t ) );
+        if ( !converter->decoded )
+        {
+            SDL_ffmpegSetError( "could not allocate audio conversion buffer" );
+            return -1;
+        }
+    }
+
+    if ( rate != codec->sample_rate && !converter->resampler )
+    {
+        /* longer filters and more phases give a better result, at a cost */
+        switch ( converter->quality )
+        {
+            case SDL_ffmpegResampleFast:
+                converter->resampler = av_resample_init( rate, codec->sample_rate, 8, 6, 1, 0.75 );
+                break;
+
+            case SDL_ffmpegResampleHigh:
+                converter->resampler = av_resample_init( rate, codec->sample_rate, 32, 12, 1, 0.95 );
+                break;
+
+            default:
+                converter->resampler = av_resample_init( rate, codec->sample_rate, 16, 10, 0, 0.8 );
+                break;
+        }
+
+        if ( !converter->resampler )
+        {
+            SDL_ffmpegSetError( "could not create audio resampler" );
+            return -1;
+        }
+    }
+
+    return 1;
+}
+
+void SDL_ffmpegAudioConverterMatrix( SDL_ffmpegAudioConverter *converter )
+{
+    /* weights of the channels in ffmpeg order when remixing to stereo */
+    static const int left[ SDL_FFMPEG_MAX_CHANNELS ] = { 16384, 0, 11585, 0, 16384, 0, 16384, 0 };
+    static const int right[ SDL_FFMPEG_MAX_CHANNELS ] = { 0, 16384, 11585, 0, 0, 16384, 0, 16384 };
+
+    int in = converter->inChannels,
+        out = converter->outChannels;
+
+    memset( converter->matrix, 0, sizeof( converter->matrix ) );
+
+    for ( int i = 0; i < in; i++ )
+    {
+        if ( in == 1 )
+        {
+            /* mono is copied to every channel */
+            for ( int o = 0; o < out; o++ ) converter->matrix[ o ][ i ] = 1 << 14;
+        }
+        else if ( out == 1 )
+        {
+            /* every channel contributes equally to mono */
+            converter->matrix[ 0 ][ i ] = 1 << 14;
+        }
+        else if ( out == 2 )
+        {
+            converter->matrix[ 0 ][ i ] = left[ i ];
+            converter->matrix[ 1 ][ i ] = right[ i ];
+        }
+        else
+        {
+            /* channels keep their position, extra channels are folded back */
+            converter->matrix[ i % out ][ i ] = 1 << 14;
+        }
+    }
+
+    /* scale down outputs which sum multiple channels, so they do not clip */
+    for ( int o = 0; o < out; o++ )
+    {
+        int sum = 0;
+
+        for ( int i = 0; i < in; i++ ) sum += converter->matrix[ o ][ i ];
+
+        if ( sum <= 1 << 14 ) continue;
+
+        for ( int i = 0; i < in; i++ ) converter->matrix[ o ][ i ] = converter->matrix[ o ][ i ] * ( 1 << 14 ) / sum;
+    }
+}
+
+int SDL_ffmpegAudioConvert( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, const int16_t *samples, int bytes )
+{
+    SDL_ffmpegAudioConverter *converter = &stream->audioConverter;
+    SDL_ffmpegAudioFifo *fifo = &stream->audioFifo;
+
+    int in = converter->inChannels,
+        out = converter->outChannels;
+
+    int count = bytes / ( in * ( int )sizeof( int16_t ) );
+
+    /* remixed audio is added behind the samples the resampler did not consume yet */
+    int total = converter->history + count;
+
+    if ( total > converter->planeSize )
+    {
+        int size = total * 2;
+
+        for ( int c = 0; c < out; c++ )
+        {
+            int16_t *plane = ( int16_t* )av_malloc( size * sizeof( int16_t ) );
+            if ( !plane )
+            {
+                SDL_ffmpegSetError( "could not grow audio conversion buffer" );
+                return -1;
+            }
+
+            if ( converter->history ) memcpy( plane, converter->planes[ c ], converter->history * sizeof( int16_t ) );
+
+            av_free( converter->planes[ c ] );
+
+            converter->planes[ c ] = plane;
+        }
+
+        converter->planeSize = size;
+    }
+
+    /* remix into a plane per output channel */
+    for ( int c = 0; c < out; c++ )
+    {
+        const int *weights = converter->matrix[ c ];
+
+        int16_t *dst = converter->planes[ c ] + converter->history;
+
+        for ( int n = 0; n < count; n++ )
+        {
+            const int16_t *src = samples + n * in;
+
+            int sum = 0;
+
+            for ( int i = 0; i < in; i++ ) sum += weights[ i ] * src[ i ];
+
+            sum /= 1 << 14;
+
+            dst[ n ] = ( int16_t )( sum > 32767 ? 32767 : sum < -32768 ? -32768 : sum );
+        }
+    }
+
+    int16_t **result = converter->planes;
+    int produced = total;
+
+    if ( converter->resampler )
+    {
+        /* room for all output, plus some slack for the filter */
+        int size = ( int )(( int64_t )total * converter->outRate / converter->inRate ) + 16;
+
+        if ( size > converter->resampledSize )
+        {
+            for ( int c = 0; c < out; c++ )
+            {
+                av_free( converter->resampled[ c ] );
+
+                converter->resampled[ c ] = ( int16_t* )av_malloc( size * sizeof( int16_t ) );
+                if ( !converter->resampled[ c ] )
+                {
+                    converter->resampledSize = 0;
+
+                    SDL_ffmpegSetError( "could not grow audio conversion buffer" );
+                    return -1;
+                }
+            }
+
+            converter->resampledSize = size;
+        }
+
+        int consumed = 0;
+
+        /* all channels are resampled with the same state, which is only
+           updated after the last channel */
+        for ( int c = 0; c < out; c++ )
+        {
+            produced = av_resample( converter->resampler, converter->resampled[ c ], converter->planes[ c ], &consumed, total, converter->resampledSize, c == out - 1 );
+        }
+
+        /* keep the samples the filter still needs */
+        converter->history = total - consumed;
+
+        for ( int c = 0; c < out; c++ )
+        {
+            memmove( converter->planes[ c ], converter->planes[ c ] + consumed, converter->history * sizeof( int16_t ) );
+        }
+
+        result = converter->resampled;
+    }
+    else
+    {
+        converter->history = 0;
+    }
+
+    if ( produced <= 0 ) return 0;
+
+    int rate, channels;
+    uint16_t format;
+
+    SDL_ffmpegAudioOutputSpec( file, &rate, &channels, &format );
+
+    if ( SDL_ffmpegAudioFifoReserve( fifo, produced * out * SDL_ffmpegAudioBytesPerSample( format ) ) ) return -1;
+
+    fifo->size += SDL_ffmpegAudioInterleave( fifo->buffer + fifo->offset + fifo->size, result, out, produced, format );
+
+    return 0;
+}
+
+int SDL_ffmpegAudioInterleave( uint8_t *dst, int16_t* const *planes, int channels, int samples, uint16_t format )
+{
+    if ( format == SDL_FFMPEG_AUDIO_F32SYS )
+    {
+        float *out = ( float* )dst;
+
+        for ( int n = 0; n < samples; n++ )
+        {
+            for ( int c = 0; c < channels; c++ ) *out++ = planes[ c ][ n ] * ( 1.0f / 32768.0f );
+        }
+
+        return samples * channels * ( int )sizeof( float );
+    }
+
+    if ( SDL_ffmpegAudioBytesPerSample( format ) == 1 )
+    {
+        /* 8 bit samples keep the high byte, unsigned samples are centered around 0x80 */
+        int bias = format == AUDIO_U8 ? 0x80 : 0;
+
+        for ( int n = 0; n < samples; n++ )
+        {
+            for ( int c = 0; c < channels; c++ ) *dst++ = ( uint8_t )(( planes[ c ][ n ] >> 8 ) + bias );
+        }
+
+        return samples * channels;
+    }
+
+    /* unsigned samples flip the sign bit, the byte order is swapped when
+       it differs from the system */
+    uint16_t flip = ( format & 0x8000 ) ? 0 : 0x8000;
+    int swap = ( format & 0x1000 ) != ( AUDIO_S16SYS & 0x1000 );
+
+    uint16_t *out = ( uint16_t* )dst;
+
+    for ( int n = 0; n < samples; n++ )
+    {
+        for ( int c = 0; c < channels; c++ )
+        {
+            uint16_t v = ( uint16_t )planes[ c ][ n ] ^ flip;
+
+            *out++ = swap ? ( uint16_t )(( v >> 8 ) | ( v << 8 ) ) : v;
+        }
+    }
+
+    return samples * channels * 2;
+}
+
+int SDL_ffmpegAudioDeinterleave( SDL_ffmpegAudioConverter *converter, SDL_ffmpegAudioFrame *frame, int channels, int bytesPerSample )
+{
+    /* entering this function, streamMutex should have been locked */
+
+    int samples = frame->size / ( channels * bytesPerSample );
+
+    int bytes = samples * channels * bytesPerSample;
+
+    /* a single channel is planar already */
+    if ( channels < 2 || !samples ) return 0;
+
+    if ( bytes > converter->layoutBufferSize )
+    {
+        av_free( converter->layoutBuffer );
+
+        converter->layoutBuffer = ( uint8_t* )av_malloc( bytes );
+        if ( !converter->layoutBuffer )
+        {
+            converter->layoutBufferSize = 0;
+
+            SDL_ffmpegSetError( "could not allocate audio layout buffer" );
+            return -1;
+        }
+
+        converter->layoutBufferSize = bytes;
+    }
+
+    /* gather the samples of every channel, partial samples at the end are left as is */
+    for ( int c = 0; c < channels; c++ )
+    {
+        switch ( bytesPerSample )
+        {
+            case 1:
+            {
+                const uint8_t *src = frame->buffer + c;
+                uint8_t *dst = converter->layoutBuffer + c * samples;
+
+                for ( int n = 0; n < samples; n++ ) dst[ n ] = src[ n * channels ];
+
+                break;
+            }
+
+            case 2:
+            {
+                const uint16_t *src = ( const uint16_t* )frame->buffer + c;
+                uint16_t *dst = ( uint16_t* )converter->layoutBuffer + c * samples;
+
+                for ( int n = 0; n < samples; n++ ) dst[ n ] = src[ n * channels ];
+
+                break;
+            }
+
+            default:
+            {
+                const uint32_t *src = ( const uint32_t* )frame->buffer + c;
+                uint32_t *dst = ( uint32_t* )converter->layoutBuffer + c * samples;
+
+                for ( int n = 0; n < samples; n++ ) dst[ n ] = src[ n * channels ];
+
+                break;
+            }
+        }
+    }
+
+    memcpy( frame->buffer, converter->layoutBuffer, bytes );
+
+    return 0;
+}
+
+int SDL_ffmpegFileSink( void *userdata, const uint8_t *data, uint32_t size, int64_t pts )
+{
+    /* stop draining when the data could not be written */
+    return fwrite( data, 1, size, ( FILE* )userdata ) != size;
+}
+
+void SDL_ffmpegAudioConverterReset( SDL_ffmpegAudioConverter *converter )
+{
+    /* samples kept for the resampler belong to the old position */
+    converter->history = 0;
+
+    /* the resampler keeps its own position, it is created again when needed */
+    if ( converter->resampler ) av_resample_close( converter->resampler );
+
+    converter->resampler = 0;
+}
+
+void SDL_ffmpegAudioConverterFree( SDL_ffmpegAudioConverter *converter )
+{
+    SDL_ffmpegAudioConverterReset( converter );
+
+    av_free( converter->decoded );
+    av_free( converter->layoutBuffer );
+
+    for ( int c = 0; c < SDL_FFMPEG_MAX_CHANNELS; c++ )
+    {
+        av_free( converter->planes[ c ] );
+        av_free( converter->resampled[ c ] );
+    }
+
+    memset( converter, 0, sizeof( SDL_ffmpegAudioConverter ) );
+}
+
+int SDL_ffmpegDecodeNextVideoFrame( SDL_ffmpegFile* file, SDL_ffmpegVideoFrame *frame )
+{
+    /* entering this function, streamMutex should have been locked */
+
+    /* assume current frame is empty */
+    frame->ready = 0;
+    frame->last = 0;
+
+    /* get new packet */
+    SDL_ffmpegPacket *pack = SDL_ffmpegGetVideoPacket( file );
+
+    while ( !pack && !frame->last )
+    {
+        int last = SDL_ffmpegFetchPacket( file, file->videoStream );
+
+        /* streams were changed while waiting, the frame can not be finished */
+        if ( last < 0 ) return 0;
+
+        frame->last = last;
+
+        pack = SDL_ffmpegGetVideoPacket( file );
+    }
+
+    while ( pack && !frame->ready )
+    {
+        /* when a frame is received, frame->ready will be set */
+        SDL_ffmpegDecodeVideoFrame( file, pack->data, frame );
+
+        /* destroy used packet */
+        SDL_ffmpegReleasePacket( pack );
+
+        pack = SDL_ffmpegGetVideoPacket( file );
+
+        while ( !pack && !frame->last )
+        {
+            int last = SDL_ffmpegFetchPacket( file, file->videoStream );
+
+            if ( last < 0 ) return 0;
+
+            frame->last = last;
+
+            pack = SDL_ffmpegGetVideoPacket( file );
+        }
+    }
+
+    /* pack retreived, but was not used, push it back in the buffer */
+    if ( pack )
+    {
+        SDL_LockMutex( file->videoStream->mutex );
+
+        if ( SDL_ffmpegQueueUnget( file->videoStream, pack ) ) SDL_ffmpegReleasePacket( pack );
+
+        SDL_UnlockMutex( file->videoStream->mutex );
+    }
+    else if ( !frame->ready && frame->last )
+    {
+        /* check if there is still a frame in the buffer */
+        SDL_ffmpegDecodeVideoFrame( file, 0, frame );
+    }
+
+    return frame->ready;
+}
+
+int SDL_ffmpegDecodeVideoFrame( SDL_ffmpegFile* file, AVPacket *pack, SDL_ffmpegVideoFrame *frame )
+{
+    int got_frame = 0;
+
+    if ( pack )
+    {
+        /* usefull when dealing with B frames */
+        if ( pack->dts == AV_NOPTS_VALUE )
+        {
+            /* if we did not get a valid timestamp, we make one up based on the last
+               valid timestamp + the duration of a frame */
+            frame->pts = file->videoStream->lastTimeStamp + av_rescale( 1000 * pack->duration, file->videoStream->_ffmpeg->time_base.num, file->videoStream->_ffmpeg->time_base.den );
+        }
+        else
+        {
+            /* write timestamp into the buffer */
+            frame->pts = av_rescale(( pack->dts - file->videoStream->_ffmpeg->start_time ) * 1000, file->videoStream->_ffmpeg->time_base.num, file->videoStream->_ffmpeg->time_base.den );
+        }
+
+        /* check if we are decoding frames which we need not store */
+        if ( frame->pts != AV_NOPTS_VALUE && frame->pts < file->minimalTimestamp )
+        {
+            file->videoStream->_ffmpeg->codec->hurry_up = 1;
+        }
+        else
+        {
+            file->videoStream->_ffmpeg->codec->hurry_up = 0;
+        }
+
+        /* Decode the packet */
+#if ( ( LIBAVCODEC_VERSION_MAJOR <= 52 ) && ( LIBAVCODEC_VERSION_MINOR <= 20 ) )
+        avcodec_decode_video( file->videoStream->_ffmpeg->codec, file->videoStream->decodeFrame, &got_frame, pack->data, pack->size );
+#else
+        avcodec_decode_video2( file->videoStream->_ffmpeg->codec, file->videoStream->decodeFrame, &got_frame, pack );
+#endif
+    }
+    else
+    {
+        /* check if there is still a frame left in the buffer */
+
+#if ( LIBAVCODEC_VERSION_MAJOR <= 52 && LIBAVCODEC_VERSION_MINOR <= 20 )
+        avcodec_decode_video( file->videoStream->_ffmpeg->codec, file->videoStream->decodeFrame, &got_frame, 0, 0 );
+#else
+        AVPacket temp;
+        av_init_packet( &temp );
+        temp.data = 0;
+        temp.size = 0;
+        temp.stream_index = file->videoStream->_ffmpeg->index;
+        avcodec_decode_video2( file->videoStream->_ffmpeg->codec, file->videoStream->decodeFrame, &got_frame, &temp );
+#endif
+    }
+
+    /* if we did not get a frame or we need to hurry, we return */
+    if ( got_frame && !file->videoStream->_ffmpeg->codec->hurry_up )
+    {
+        /* decodeFrame now holds the picture, converting it is up to the caller */
+
+        /* we write the lastTimestamp we got */
+        file->videoStream->lastTimeStamp = frame->pts;
+
+        /* flag this frame as ready */
+        frame->ready = 1;
+    }
+
+    return frame->ready;
+}
+
+void SDL_ffmpegCopyPlane( uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int bytes, int lines )
+{
+    /* copy all lines at once when they are stored without gaps */
+    if ( dstPitch == bytes && srcPitch == bytes )
+    {
+        memcpy( dst, src, bytes * lines );
+        return;
+    }
+
+    for ( int i = 0; i < lines; i++ )
+    {
+        memcpy( dst, src, bytes );
+
+        dst += dstPitch;
+        src += srcPitch;
+    }
+}
+
+void SDL_ffmpegExposeVideoFrame( uint8_t* const* data, const int *linesize, int width, int height, enum PixelFormat format, SDL_ffmpegVideoFrame *frame )
+{
+    /* only frames without surface or overlay receive the decoded picture */
+    if ( frame->surface || frame->overlay ) return;
+
+    for ( int i = 0; i < 4; i++ )
+    {
+        frame->data[ i ] = data[ i ];
+        frame->linesize[ i ] = linesize[ i ];
+    }
+
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+}
+
+void SDL_ffmpegConvertVideoFrame( SDL_ffmpegStream *stream, const uint8_t* const* data, const int *linesize, int width, int height, enum PixelFormat format, SDL_ffmpegVideoFrame *frame )
+{
+    /* convert YUV 420 to YUYV 422 data */
+    if ( frame->overlay && frame->overlay->format == SDL_YUY2_OVERLAY )
+    {
+        int pitch[] =
+        {
+            frame->overlay->pitches[ 0 ],
+            0, 0, 0
+        };
+
+        uint8_t *const pixels[] =
+        {
+            frame->overlay->pixels[ 0 ],
+            0, 0, 0
+        };
+
+        SDL_ffmpegScale( stream,
+                         data,
+                         linesize,
+                         width,
+                         height,
+                         format,
+                         pixels,
+                         pitch,
+                         frame->overlay->w, frame->overlay->h,
+                         PIX_FMT_YUYV422 );
+    }
+
+    /* planar overlays only differ in the order of the chroma planes */
+    if ( frame->overlay && ( frame->overlay->format == SDL_YV12_OVERLAY || frame->overlay->format == SDL_IYUV_OVERLAY ) )
+    {
+        /* YV12 stores V before U */
+        int u = frame->overlay->format == SDL_YV12_OVERLAY ? 2 : 1,
+            v = frame->overlay->format == SDL_YV12_OVERLAY ? 1 : 2;
+
+        if (( format == PIX_FMT_YUV420P || format == PIX_FMT_YUVJ420P ) &&
+                frame->overlay->w == width && frame->overlay->h == height )
+        {
+            /* same size and layout, a copy of the planes is all we need */
+            SDL_ffmpegCopyPlane( frame->overlay->pixels[ 0 ], frame->overlay->pitches[ 0 ], data[ 0 ], linesize[ 0 ], width, height );
+            SDL_ffmpegCopyPlane( frame->overlay->pixels[ u ], frame->overlay->pitches[ u ], data[ 1 ], linesize[ 1 ], ( width + 1 ) / 2, ( height + 1 ) / 2 );
+            SDL_ffmpegCopyPlane( frame->overlay->pixels[ v ], frame->overlay->pitches[ v ], data[ 2 ], linesize[ 2 ], ( width + 1 ) / 2, ( height + 1 ) / 2 );
+        }
+        else
+        {
+            int pitch[] =
+            {
+                frame->overlay->pitches[ 0 ],
+                frame->overlay->pitches[ u ],
+                frame->overlay->pitches[ v ],
+                0
+            };
+
+            uint8_t *const pixels[] =
+            {
+                frame->overlay->pixels[ 0 ],
+                frame->overlay->pixels[ u ],
+                frame->overlay->pixels[ v ],
+                0
+            };
+
+            SDL_ffmpegScale( stream,
+                             data,
+                             linesize,
+                             width,
+                             height,
+                             format,
+                             pixels,
+                             pitch,
+                             frame->overlay->w, frame->overlay->h,
+                             PIX_FMT_YUV420P );
+        }
+    }
+
+    /* convert YUV to RGB data */
+    if ( frame->surface && frame->surface->format )
+    {
+        int pitch[] =
+        {
+            frame->surface->pitch,
+            0, 0, 0
+        };
+
+        uint8_t *const pixels[] =
+        {
+            ( uint8_t* )frame->surface->pixels,
+            0, 0, 0
+        };
+
+        switch ( frame->surface->format->BitsPerPixel )
+        {
+            case 32:
+                SDL_ffmpegScale( stream,
+                                 data,
+                                 linesize,
+                                 width,
+                                 height,
+                                 format,
+                                 pixels,
+                                 pitch,
+                                 frame->surface->w, frame->surface->h,
+                                 PIX_FMT_RGB32 );
+                break;
+            case 24:
+                SDL_ffmpegScale( stream,
+                                 data,
+                                 linesize,
+                                 width,
+                                 height,
+                                 format,
+                                 pixels,
+                                 pitch,
+                                 frame->surface->w, frame->surface->h,
+                                 PIX_FMT_RGB24 );
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/*
+ *  Colour conversion kernels, used instead of swscale when a picture only
+ *  changes between YUV420P and packed RGB without being resized. Every kernel
+ *  uses the same BT.601 fixed point formulas, so all of them give the same
+ *  result. The vector kernels return the amount of pixels they converted,
+ *  the scalar kernels convert the remaining pixels of a line.
+ */
+
+#define SDL_ffmpegClamp( x ) (( x ) < 0 ? 0 : ( x ) > 255 ? 255 : ( x ) )
+
+void SDL_ffmpegStorePixel( uint8_t *dst, int r, int g, int b, enum PixelFormat format )
+{
+    if ( format == PIX_FMT_RGB24 )
+    {
+        dst[ 0 ] = r;
+        dst[ 1 ] = g;
+        dst[ 2 ] = b;
+    }
+    else
+    {
+        /* 32 bit formats are stored in native byte order */
+        uint32_t pixel = format == PIX_FMT_RGB32 ?
+                         0xFF000000u | ( r << 16 ) | ( g << 8 ) | b :
+                         0xFF000000u | ( b << 16 ) | ( g << 8 ) | r;
+
+        memcpy( dst, &pixel, 4 );
+    }
+}
+
+void SDL_ffmpegLoadPixel( const uint8_t *src, int *r, int *g, int *b, enum PixelFormat format )
+{
+    if ( format == PIX_FMT_RGB24 )
+    {
+        *r = src[ 0 ];
+        *g = src[ 1 ];
+        *b = src[ 2 ];
+    }
+    else
+    {
+        uint32_t pixel;
+
+        memcpy( &pixel, src, 4 );
+
+        *r = format == PIX_FMT_RGB32 ? ( pixel >> 16 ) & 0xFF : pixel & 0xFF;
+        *g = ( pixel >> 8 ) & 0xFF;
+        *b = format == PIX_FMT_RGB32 ? pixel & 0xFF : ( pixel >> 16 ) & 0xFF;
+    }
+}
+
+void SDL_ffmpegYUVToRGBScalar( const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int start, int width, enum PixelFormat format )
+{
+    int bytes = format == PIX_FMT_RGB24 ? 3 : 4;
+
+    for ( int x = start; x < width; x++ )
+    {
+        int c = y[ x ] - 16,
+            d = u[ x >> 1 ] - 128,
+            e = v[ x >> 1 ] - 128;
+
+        int r = ( 298 * c + 409 * e + 128 ) >> 8,
+            g = ( 298 * c - 100 * d - 208 * e + 128 ) >> 8,
+            b = ( 298 * c + 516 * d + 128 ) >> 8;
+
+        SDL_ffmpegStorePixel( dst + x * bytes, SDL_ffmpegClamp( r ), SDL_ffmpegClamp( g ), SDL_ffmpegClamp( b ), format );
+    }
+}
+
+void SDL_ffmpegRGBToYUVScalar( const uint8_t *s0, const uint8_t *s1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, int start, int width, enum PixelFormat format )
+{
+    int bytes = format == PIX_FMT_RGB24 ? 3 : 4;
+
+    /* every pair of pixels on both lines shares its chroma */
+    for ( int x = start; x < width; x += 2 )
+    {
+        int x1 = x + 1 < width ? x + 1 : x;
+
+        int r[ 4 ], g[ 4 ], b[ 4 ];
+
+        SDL_ffmpegLoadPixel( s0 + x * bytes, &r[ 0 ], &g[ 0 ], &b[ 0 ], format );
+        SDL_ffmpegLoadPixel( s0 + x1 * bytes, &r[ 1 ], &g[ 1 ], &b[ 1 ], format );
+        SDL_ffmpegLoadPixel( s1 + x * bytes, &r[ 2 ], &g[ 2 ], &b[ 2 ], format );
+        SDL_ffmpegLoadPixel( s1 + x1 * bytes, &r[ 3 ], &g[ 3 ], &b[ 3 ], format );
+
+        y0[ x ] = (( 66 * r[ 0 ] + 129 * g[ 0 ] + 25 * b[ 0 ] + 128 ) >> 8 ) + 16;
+        y0[ x1 ] = (( 66 * r[ 1 ] + 129 * g[ 1 ] + 25 * b[ 1 ] + 128 ) >> 8 ) + 16;
+        y1[ x ] = (( 66 * r[ 2 ] + 129 * g[ 2 ] + 25 * b[ 2 ] + 128 ) >> 8 ) + 16;
+        y1[ x1 ] = (( 66 * r[ 3 ] + 129 * g[ 3 ] + 25 * b[ 3 ] + 128 ) >> 8 ) + 16;
+
+        int rs = r[ 0 ] + r[ 1 ] + r[ 2 ] + r[ 3 ],
+            gs = g[ 0 ] + g[ 1 ] + g[ 2 ] + g[ 3 ],
+            bs = b[ 0 ] + b[ 1 ] + b[ 2 ] + b[ 3 ];
+
+        /* the sums hold four pixels, which is compensated in the shift */
+        u[ x >> 1 ] = (( -38 * rs - 74 * gs + 112 * bs + 512 ) >> 10 ) + 128;
+        v[ x >> 1 ] = (( 112 * rs - 94 * gs - 18 * bs + 512 ) >> 10 ) + 128;
+    }
+}
+
+#ifdef SDL_FFMPEG_X86
+
+/* two 16 bit coefficients, as used by _mm_madd_epi16 on interleaved values */
+#define SDL_ffmpegPair( a, b ) (( int )(( uint32_t )( uint16_t )( a ) | (( uint32_t )( uint16_t )( b ) << 16 ) ) )
+
+SDL_FFMPEG_TARGET( "sse2" )
+int SDL_ffmpegYUVToRGBSSE2( const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, enum PixelFormat format )
+{
+    const __m128i zero = _mm_setzero_si128(),
+                  alpha = _mm_set1_epi8( -1 ),
+                  round = _mm_set1_epi32( 128 ),
+                  luma = _mm_set1_epi16( 16 ),
+                  chroma = _mm_set1_epi16( 128 ),
+                  coefR = _mm_set1_epi32( SDL_ffmpegPair( 298, 409 ) ),
+                  coefGU = _mm_set1_epi32( SDL_ffmpegPair( 298, -100 ) ),
+                  coefGV = _mm_set1_epi32( SDL_ffmpegPair( -208, 0 ) ),
+                  coefB = _mm_set1_epi32( SDL_ffmpegPair( 298, 516 ) );
+
+    int x = 0;
+
+    for ( ; x + 8 <= width; x += 8 )
+    {
+        uint32_t u4, v4;
+
+        memcpy( &u4, u + x / 2, 4 );
+        memcpy( &v4, v + x / 2, 4 );
+
+        __m128i c = _mm_sub_epi16( _mm_unpacklo_epi8( _mm_loadl_epi64(( const __m128i* )( y + x ) ), zero ), luma ),
+                d = _mm_sub_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( u4 ), zero ), chroma ),
+                e = _mm_sub_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( v4 ), zero ), chroma );
+
+        /* every chroma value is used by two pixels */
+        d = _mm_unpacklo_epi16( d, d );
+        e = _mm_unpacklo_epi16( e, e );
+
+        __m128i cdLo = _mm_unpacklo_epi16( c, d ), cdHi = _mm_unpackhi_epi16( c, d ),
+                ceLo = _mm_unpacklo_epi16( c, e ), ceHi = _mm_unpackhi_epi16( c, e ),
+                e0Lo = _mm_unpacklo_epi16( e, zero ), e0Hi = _mm_unpackhi_epi16( e, zero );
+
+        __m128i r = _mm_packs_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( ceLo, coefR ), round ), 8 ),
+                                     _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( ceHi, coefR ), round ), 8 ) ),
+                g = _mm_packs_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( cdLo, coefGU ), _mm_madd_epi16( e0Lo, coefGV ) ), round ), 8 ),
+                                     _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( cdHi, coefGU ), _mm_madd_epi16( e0Hi, coefGV ) ), round ), 8 ) ),
+                b = _mm_packs_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( cdLo, coefB ), round ), 8 ),
+                                     _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( cdHi, coefB ), round ), 8 ) );
+
+        /* saturate to 0 - 255 */
+        r = _mm_packus_epi16( r, zero );
+        g = _mm_packus_epi16( g, zero );
+        b = _mm_packus_epi16( b, zero );
+
+        if ( format == PIX_FMT_RGB24 )
+        {
+            uint8_t rgb[ 3 ][ 16 ];
+
+            _mm_storeu_si128(( __m128i* )rgb[ 0 ], r );
+            _mm_storeu_si128(( __m128i* )rgb[ 1 ], g );
+            _mm_storeu_si128(( __m128i* )rgb[ 2 ], b );
+
+            for ( int i = 0; i < 8; i++ ) SDL_ffmpegStorePixel( dst + ( x + i ) * 3, rgb[ 0 ][ i ], rgb[ 1 ][ i ], rgb[ 2 ][ i ], format );
+        }
+        else
+        {
+            /* x86 is little endian, so RGB32 is stored as B, G, R, A */
+            __m128i lo = format == PIX_FMT_RGB32 ? _mm_unpacklo_epi8( b, g ) : _mm_unpacklo_epi8( r, g ),
+                    hi = _mm_unpacklo_epi8( format == PIX_FMT_RGB32 ? r : b, alpha );
+
+            _mm_storeu_si128(( __m128i* )( dst + x * 4 ), _mm_unpacklo_epi16( lo, hi ) );
+            _mm_storeu_si128(( __m128i* )( dst + x * 4 + 16 ), _mm_unpackhi_epi16( lo, hi ) );
+        }
+    }
+
+    return x;
+}
+
+SDL_FFMPEG_TARGET( "sse2" )
+int SDL_ffmpegRGBToYUVSSE2( const uint8_t *s0, const uint8_t *s1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, int width, enum PixelFormat format )
+{
+    /* only 32 bit pixels can be loaded as vectors */
+    if ( format == PIX_FMT_RGB24 ) return 0;
+
+    const int shiftR = format == PIX_FMT_RGB32 ? 16 : 0,
+              shiftB = format == PIX_FMT_RGB32 ? 0 : 16;
+
+    const __m128i zero = _mm_setzero_si128(),
+                  mask = _mm_set1_epi32( 0xFF ),
+                  ones = _mm_set1_epi16( 1 ),
+                  round = _mm_set1_epi32( 128 ),
+                  roundChroma = _mm_set1_epi32( 512 ),
+                  luma = _mm_set1_epi16( 16 ),
+                  chroma = _mm_set1_epi32( 128 ),
+                  coefYRG = _mm_set1_epi32( SDL_ffmpegPair( 66, 129 ) ),
+                  coefYB = _mm_set1_epi32( SDL_ffmpegPair( 25, 0 ) ),
+                  coefURG = _mm_set1_epi32( SDL_ffmpegPair( -38, -74 ) ),
+                  coefUB = _mm_set1_epi32( SDL_ffmpegPair( 112, 0 ) ),
+                  coefVRG = _mm_set1_epi32( SDL_ffmpegPair( 112, -94 ) ),
+                  coefVB = _mm_set1_epi32( SDL_ffmpegPair( -18, 0 ) );
+
+    int x = 0;
+
+    for ( ; x + 8 <= width; x += 8 )
+    {
+        const uint8_t *line[ 2 ] = { s0 + x * 4, s1 + x * 4 };
+        uint8_t *out[ 2 ] = { y0 + x, y1 + x };
+
+        __m128i r[ 2 ], g[ 2 ], b[ 2 ];
+
+        for ( int i = 0; i < 2; i++ )
+        {
+            __m128i p0 = _mm_loadu_si128(( const __m128i* )line[ i ] ),
+                    p1 = _mm_loadu_si128(( const __m128i* )( line[ i ] + 16 ) );
+
+            r[ i ] = _mm_packs_epi32( _mm_and_si128( _mm_srli_epi32( p0, shiftR ), mask ), _mm_and_si128( _mm_srli_epi32( p1, shiftR ), mask ) );
+            g[ i ] = _mm_packs_epi32( _mm_and_si128( _mm_srli_epi32( p0, 8 ), mask ), _mm_and_si128( _mm_srli_epi32( p1, 8 ), mask ) );
+            b[ i ] = _mm_packs_epi32( _mm_and_si128( _mm_srli_epi32( p0, shiftB ), mask ), _mm_and_si128( _mm_srli_epi32( p1, shiftB ), mask ) );
+
+            __m128i lo = _mm_add_epi32( _mm_madd_epi16( _mm_unpacklo_epi16( r[ i ], g[ i ] ), coefYRG ), _mm_madd_epi16( _mm_unpacklo_epi16( b[ i ], zero ), coefYB ) ),
+                    hi = _mm_add_epi32( _mm_madd_epi16( _mm_unpackhi_epi16( r[ i ], g[ i ] ), coefYRG ), _mm_madd_epi16( _mm_unpackhi_epi16( b[ i ], zero ), coefYB ) );
+
+            __m128i luminance = _mm_add_epi16( _mm_packs_epi32( _mm_srai_epi32( _mm_add_epi32( lo, round ), 8 ), _mm_srai_epi32( _mm_add_epi32( hi, round ), 8 ) ), luma );
+
+            _mm_storel_epi64(( __m128i* )out[ i ], _mm_packus_epi16( luminance, zero ) );
+        }
+
+        /* sum every block of two by two pixels */
+        __m128i rs = _mm_packs_epi32( _mm_madd_epi16( _mm_add_epi16( r[ 0 ], r[ 1 ] ), ones ), zero ),
+                gs = _mm_packs_epi32( _mm_madd_epi16( _mm_add_epi16( g[ 0 ], g[ 1 ] ), ones ), zero ),
+                bs = _mm_packs_epi32( _mm_madd_epi16( _mm_add_epi16( b[ 0 ], b[ 1 ] ), ones ), zero );
+
+        __m128i rg = _mm_unpacklo_epi16( rs, gs ), b0 = _mm_unpacklo_epi16( bs, zero );
+
+        __m128i cu = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( rg, coefURG ), _mm_madd_epi16( b0, coefUB ) ), roundChroma ), 10 ), chroma ),
+                cv = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( rg, coefVRG ), _mm_madd_epi16( b0, coefVB ) ), roundChroma ), 10 ), chroma );
+
+        uint32_t u4 = _mm_cvtsi128_si32( _mm_packus_epi16( _mm_packs_epi32( cu, zero ), zero ) ),
+                 v4 = _mm_cvtsi128_si32( _mm_packus_epi16( _mm_packs_epi32( cv, zero ), zero ) );
+
+        memcpy( u + x / 2, &u4, 4 );
+        memcpy( v + x / 2, &v4, 4 );
+    }
+
+    return x;
+}
+
+SDL_FFMPEG_TARGET( "avx2" )
+int SDL_ffmpegYUVToRGBAVX2( const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, enum PixelFormat format )
+{
+    const __m256i zero = _mm256_setzero_si256(),
+                  alpha = _mm256_set1_epi8( -1 ),
+                  round = _mm256_set1_epi32( 128 ),
+                  luma = _mm256_set1_epi16( 16 ),
+                  chroma = _mm256_set1_epi16( 128 ),
+                  coefR = _mm256_set1_epi32( SDL_ffmpegPair( 298, 409 ) ),
+                  coefGU = _mm256_set1_epi32( SDL_ffmpegPair( 298, -100 ) ),
+                  coefGV = _mm256_set1_epi32( SDL_ffmpegPair( -208, 0 ) ),
+                  coefB = _mm256_set1_epi32( SDL_ffmpegPair( 298, 516 ) );
+
+    int x = 0;
+
+    for ( ; x + 16 <= width; x += 16 )
+    {
+        __m128i u8 = _mm_loadl_epi64(( const __m128i* )( u + x / 2 ) ),
+                v8 = _mm_loadl_epi64(( const __m128i* )( v + x / 2 ) );
+
+        /* every chroma value is used by two pixels */
+        __m256i c = _mm256_sub_epi16( _mm256_cvtepu8_epi16( _mm_loadu_si128(( const __m128i* )( y + x ) ) ), luma ),
+                d = _mm256_sub_epi16( _mm256_cvtepu8_epi16( _mm_unpacklo_epi8( u8, u8 ) ), chroma ),
+                e = _mm256_sub_epi16( _mm256_cvtepu8_epi16( _mm_unpacklo_epi8( v8, v8 ) ), chroma );
+
+        /* unpacking works within 128 bit lanes, lo holds pixels 0-3 and 8-11 */
+        __m256i cdLo = _mm256_unpacklo_epi16( c, d ), cdHi = _mm256_unpackhi_epi16( c, d ),
+                ceLo = _mm256_unpacklo_epi16( c, e ), ceHi = _mm256_unpackhi_epi16( c, e ),
+                e0Lo = _mm256_unpacklo_epi16( e, zero ), e0Hi = _mm256_unpackhi_epi16( e, zero );
+
+        /* packing restores the order of the pixels */
+        __m256i r = _mm256_packs_epi32( _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( ceLo, coefR ), round ), 8 ),
+                                        _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( ceHi, coefR ), round ), 8 ) ),
+                g = _mm256_packs_epi32( _mm256_srai_epi32( _mm256_add_epi32( _mm256_add_epi32( _mm256_madd_epi16( cdLo, coefGU ), _mm256_madd_epi16( e0Lo, coefGV ) ), round ), 8 ),
+                                        _mm256_srai_epi32( _mm256_add_epi32( _mm256_add_epi32( _mm256_madd_epi16( cdHi, coefGU ), _mm256_madd_epi16( e0Hi, coefGV ) ), round ), 8 ) ),
+                b = _mm256_packs_epi32( _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( cdLo, coefB ), round ), 8 ),
+                                        _mm256_srai_epi32( _mm256_add_epi32( _mm256_madd_epi16( cdHi, coefB ), round ), 8 ) );
+
+        /* saturate to 0 - 255, every lane holds 8 pixels followed by zeros */
+        r = _mm256_packus_epi16( r, zero );
+        g = _mm256_packus_epi16( g, zero );
+        b = _mm256_packus_epi16( b, zero );
+
+        if ( format == PIX_FMT_RGB24 )
+        {
+            uint8_t rgb[ 3 ][ 32 ];
+
+            _mm256_storeu_si256(( __m256i* )rgb[ 0 ], r );
+            _mm256_storeu_si256(( __m256i* )rgb[ 1 ], g );
+            _mm256_storeu_si256(( __m256i* )rgb[ 2 ], b );
+
+            for ( int i = 0; i < 16; i++ )
+            {
+                int j = ( i & 7 ) + ( i & 8 ) * 2;
+
+                SDL_ffmpegStorePixel( dst + ( x + i ) * 3, rgb[ 0 ][ j ], rgb[ 1 ][ j ], rgb[ 2 ][ j ], format );
+            }
+        }
+        else
+        {
+            /* x86 is little endian, so RGB32 is stored as B, G, R, A */
+            __m256i lo = format == PIX_FMT_RGB32 ? _mm256_unpacklo_epi8( b, g ) : _mm256_unpacklo_epi8( r, g ),
+                    hi = _mm256_unpacklo_epi8( format == PIX_FMT_RGB32 ? r : b, alpha );
+
+            __m256i p0 = _mm256_unpacklo_epi16( lo, hi ), p1 = _mm256_unpackhi_epi16( lo, hi );
+
+            _mm256_storeu_si256(( __m256i* )( dst + x * 4 ), _mm256_permute2x128_si256( p0, p1, 0x20 ) );
+            _mm256_storeu_si256(( __m256i* )( dst + x * 4 + 32 ), _mm256_permute2x128_si256( p0, p1, 0x31 ) );
+        }
+    }
+
+    /* let the SSE2 kernel handle a remaining block of 8 pixels */
+    return x + SDL_ffmpegYUVToRGBSSE2( y + x, u + x / 2, v + x / 2, dst + x * ( format == PIX_FMT_RGB24 ? 3 : 4 ), width - x, format );
+}
+
+SDL_FFMPEG_TARGET( "avx2" )
+int SDL_ffmpegRGBToYUVAVX2( const uint8_t *s0, const uint8_t *s1, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, int width, enum PixelFormat format )
+{
+    /* only 32 bit pixels can be loaded as vectors */
+    if ( format == PIX_FMT_RGB24 ) return 0;
+
+    const int shiftR = format == PIX_FMT_RGB32 ? 16 : 0,
+              shiftB = format == PIX_FMT_RGB32 ? 0 : 16;
+
+    const __m256i zero = _mm256_setzero_si256(),
+                  mask = _mm256_set1_epi32( 0xFF ),
+                  ones = _mm256_set1_epi16( 1 ),
+                  round = _mm256_set1_epi32( 128 ),
+                  luma = _mm256_set1_epi16( 16 ),
+                  coefYRG = _mm256_set1_epi32( SDL_ffmpegPair( 66, 129 ) ),
+                  coefYB = _mm256_set1_epi32( SDL_ffmpegPair( 25, 0 ) );
+
+    const __m128i zero128 = _mm_setzero_si128(),
+                  roundChroma = _mm_set1_epi32( 512 ),
+                  chroma = _mm_set1_epi32( 128 ),
+                  coefURG = _mm_set1_epi32( SDL_ffmpegPair( -38, -74 ) ),
+                  coefUB = _mm_set1_epi32( SDL_ffmpegPair( 112, 0 ) ),
+                  coefVRG = _mm_set1_epi32( SDL_ffmpegPair( 112, -94 ) ),
+                  coefVB = _mm_set1_epi32( SDL_ffmpegPair( -18, 0 ) );
+
+    int x = 0;
+
+    for ( ; x + 16 <= width; x += 16 )
+    {
+        const uint8_t *line[ 2 ] = { s0 + x * 4, s1 + x * 4 };
+        uint8_t *out[ 2 ] = { y0 + x, y1 + x };
+
+        __m256i r[ 2 ], g[ 2 ], b[ 2 ];
+
+        for ( int i = 0; i < 2; i++ )
+        {
+            __m256i p0 = _mm256_loadu_si256(( const __m256i* )line[ i ] ),
+                    p1 = _mm256_loadu_si256(( const __m256i* )( line[ i ] + 32 ) );
+
+            /* packing works within 128 bit lanes, the permute restores the order of the pixels */
+            r[ i ] = _mm256_permute4x64_epi64( _mm256_packs_epi32( _mm256_and_si256( _mm256_srli_epi32( p0, shiftR ), mask ), _mm256_and_si256( _mm256_srli_epi32( p1, shiftR ), mask ) ), 0xD8 );
+            g[ i ] = _mm256_permute4x64_epi64( _mm256_packs_epi32( _mm256_and_si256( _mm256_srli_epi32( p0, 8 ), mask ), _mm256_and_si256( _mm256_srli_epi32( p1, 8 ), mask ) ), 0xD8 );
+            b[ i ] = _mm256_permute4x64_epi64( _mm256_packs_epi32( _mm256_and_si256( _mm256_srli_epi32( p0, shiftB ), mask ), _mm256_and_si256( _mm256_srli_epi32( p1, shiftB ), mask ) ), 0xD8 );
+
+            __m256i lo = _mm256_add_epi32( _mm256_madd_epi16( _mm256_unpacklo_epi16( r[ i ], g[ i ] ), coefYRG ), _mm256_madd_epi16( _mm256_unpacklo_epi16( b[ i ], zero ), coefYB ) ),
+                    hi = _mm256_add_epi32( _mm256_madd_epi16( _mm256_unpackhi_epi16( r[ i ], g[ i ] ), coefYRG ), _mm256_madd_epi16( _mm256_unpackhi_epi16( b[ i ], zero ), coefYB ) );
+
+            __m256i luminance = _mm256_add_epi16( _mm256_packs_epi32( _mm256_srai_epi32( _mm256_add_epi32( lo, round ), 8 ), _mm256_srai_epi32( _mm256_add_epi32( hi, round ), 8 ) ), luma );
+
+            /* every lane holds 8 values followed by zeros */
+            luminance = _mm256_permute4x64_epi64( _mm256_packus_epi16( luminance, zero ), 0xD8 );
+
+            _mm_storeu_si128(( __m128i* )out[ i ], _mm256_castsi256_si128( luminance ) );
+        }
+
+        /* sum every block of two by two pixels, giving 8 sums in order */
+        __m256i rs = _mm256_madd_epi16( _mm256_add_epi16( r[ 0 ], r[ 1 ] ), ones ),
+                gs = _mm256_madd_epi16( _mm256_add_epi16( g[ 0 ], g[ 1 ] ), ones ),
+                bs = _mm256_madd_epi16( _mm256_add_epi16( b[ 0 ], b[ 1 ] ), ones );
+
+        __m128i rs16 = _mm_packs_epi32( _mm256_castsi256_si128( rs ), _mm256_extracti128_si256( rs, 1 ) ),
+                gs16 = _mm_packs_epi32( _mm256_castsi256_si128( gs ), _mm256_extracti128_si256( gs, 1 ) ),
+                bs16 = _mm_packs_epi32( _mm256_castsi256_si128( bs ), _mm256_extracti128_si256( bs, 1 ) );
+
+        __m128i rgLo = _mm_unpacklo_epi16( rs16, gs16 ), rgHi = _mm_unpackhi_epi16( rs16, gs16 ),
+                b0Lo = _mm_unpacklo_epi16( bs16, zero128 ), b0Hi = _mm_unpackhi_epi16( bs16, zero128 );
+
+        __m128i cu = _mm_packs_epi32( _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( rgLo, coefURG ), _mm_madd_epi16( b0Lo, coefUB ) ), roundChroma ), 10 ), chroma ),
+                                      _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( rgHi, coefURG ), _mm_madd_epi16( b0Hi, coefUB ) ), roundChroma ), 10 ), chroma ) ),
+                cv = _mm_packs_epi32( _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( rgLo, coefVRG ), _mm_madd_epi16( b0Lo, coefVB ) ), roundChroma ), 10 ), chroma ),
+                                      _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( rgHi, coefVRG ), _mm_madd_epi16( b0Hi, coefVB ) ), roundChroma ), 10 ), chroma ) );
+
+        _mm_storel_epi64(( __m128i* )( u + x / 2 ), _mm_packus_epi16( cu, zero128 ) );
+        _mm_storel_epi64(( __m128i* )( v + x / 2 ), _mm_packus_epi16( cv, zero128 ) );
+    }
+
+    /* let the SSE2 kernel handle a remaining block of 8 pixels */
+    return x + SDL_ffmpegRGBToYUVSSE2( s0 + x * 4, s1 + x * 4, y0 + x, y1 + x, u + x / 2, v + x / 2, width - x, format );
+}
+
+SDL_FFMPEG_TARGET( "sse2" )
+int SDL_ffmpegMixSSE2( int16_t *dst, const int16_t *src, int count, int gainLeft, int gainRight )
+{
+    int x = 0;
+
+    if ( gainLeft == 1 << 14 && gainRight == 1 << 14 )
+    {
+        /* unity gain, only add with saturation */
+        for ( ; x + 8 <= count; x += 8 )
+        {
+            __m128i d = _mm_loadu_si128(( const __m128i* )( dst + x ) );
+
+            _mm_storeu_si128(( __m128i* )( dst + x ), _mm_adds_epi16( d, _mm_loadu_si128(( const __m128i* )( src + x ) ) ) );
+        }
+
+        return x;
+    }
+
+    /* even samples are left, odd samples are right */
+    const __m128i gain = _mm_set_epi16( gainRight, gainLeft, gainRight, gainLeft, gainRight, gainLeft, gainRight, gainLeft );
+
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        __m128i a = _mm_loadu_si128(( const __m128i* )( src + x ) );
+
+        /* full 32 bit products, scaled back to 16 bit with saturation */
+        __m128i lo = _mm_mullo_epi16( a, gain ),
+                hi = _mm_mulhi_epi16( a, gain );
+
+        __m128i scaled = _mm_packs_epi32( _mm_srai_epi32( _mm_unpacklo_epi16( lo, hi ), 14 ), _mm_srai_epi32( _mm_unpackhi_epi16( lo, hi ), 14 ) );
+
+        __m128i d = _mm_loadu_si128(( const __m128i* )( dst + x ) );
+
+        _mm_storeu_si128(( __m128i* )( dst + x ), _mm_adds_epi16( d, scaled ) );
+    }
+
+    return x;
+}
+
+SDL_FFMPEG_TARGET( "avx2" )
+int SDL_ffmpegMixAVX2( int16_t *dst, const int16_t *src, int count, int gainLeft, int gainRight )
+{
+    int x = 0;
+
+    if ( gainLeft == 1 << 14 && gainRight == 1 << 14 )
+    {
+        /* unity gain, only add with saturation */
+        for ( ; x + 16 <= count; x += 16 )
+        {
+            __m256i d = _mm256_loadu_si256(( const __m256i* )( dst + x ) );
+
+            _mm256_storeu_si256(( __m256i* )( dst + x ), _mm256_adds_epi16( d, _mm256_loadu_si256(( const __m256i* )( src + x ) ) ) );
+        }
+    }
+    else
+    {
+        /* even samples are left, odd samples are right */
+        const __m256i gain = _mm256_set1_epi32( SDL_ffmpegPair( gainLeft, gainRight ) );
+
+        for ( ; x + 16 <= count; x += 16 )
+        {
+            __m256i a = _mm256_loadu_si256(( const __m256i* )( src + x ) );
+
+            /* unpacking and packing both work within 128 bit lanes, so the
+               order of the samples is kept */
+            __m256i lo = _mm256_mullo_epi16( a, gain ),
+                    hi = _mm256_mulhi_epi16( a, gain );
+
+            __m256i scaled = _mm256_packs_epi32( _mm256_srai_epi32( _mm256_unpacklo_epi16( lo, hi ), 14 ), _mm256_srai_epi32( _mm256_unpackhi_epi16( lo, hi ), 14 ) );
+
+            __m256i d = _mm256_loadu_si256(( const __m256i* )( dst + x ) );
+
+            _mm256_storeu_si256(( __m256i* )( dst + x ), _mm256_adds_epi16( d, scaled ) );
+        }
+    }
+
+    /* let the SSE2 kernel handle a remaining block of 8 samples */
+    return x + SDL_ffmpegMixSSE2( dst + x, src + x, count - x, gainLeft, gainRight );
+}
+
+int SDL_ffmpegHasAVX2()
+{
+#if defined( _MSC_VER )
+    int info[ 4 ];
+
+    __cpuid( info, 0 );
+    if ( info[ 0 ] < 7 ) return 0;
+
+    /* the operating system needs to save the AVX registers */
+    __cpuid( info, 1 );
+    if ( !( info[ 2 ] & ( 1 << 27 ) ) || ( _xgetbv( 0 ) & 6 ) != 6 ) return 0;
+
+    __cpuidex( info, 7, 0 );
+
+    return ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+#elif defined( __GNUC__ )
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports( "avx2" );
+#else
+    return 0;
+#endif
+}
+
+#endif
+
+void SDL_ffmpegSelectKernels()
+{
+#ifdef SDL_FFMPEG_X86
+    if ( SDL_ffmpegHasAVX2() )
+    {
+        SDL_ffmpegYUVToRGBKernel = SDL_ffmpegYUVToRGBAVX2;
+        SDL_ffmpegRGBToYUVKernel = SDL_ffmpegRGBToYUVAVX2;
+        SDL_ffmpegMixKernel = SDL_ffmpegMixAVX2;
+    }
+    else if ( SDL_HasSSE2() )
+    {
+        SDL_ffmpegYUVToRGBKernel = SDL_ffmpegYUVToRGBSSE2;
+        SDL_ffmpegRGBToYUVKernel = SDL_ffmpegRGBToYUVSSE2;
+        SDL_ffmpegMixKernel = SDL_ffmpegMixSSE2;
+    }
+#endif
+}
+
+int SDL_ffmpegKernelSupported( enum PixelFormat inFormat, enum PixelFormat outFormat )
+{
+    if ( inFormat == PIX_FMT_YUV420P )
+    {
+        return outFormat == PIX_FMT_RGB24 || outFormat == PIX_FMT_RGB32 || outFormat == PIX_FMT_BGR32;
+    }
+
+    if ( outFormat == PIX_FMT_YUV420P )
+    {
+        return inFormat == PIX_FMT_RGB24 || inFormat == PIX_FMT_RGB32 || inFormat == PIX_FMT_BGR32;
+    }
+
+    return 0;
+}
+
+void SDL_ffmpegKernelConvert( const uint8_t* const* src, const int *srcStride, enum PixelFormat inFormat, uint8_t* const* dst, const int *dstStride, enum PixelFormat outFormat, int width, int height )
+{
+    if ( inFormat == PIX_FMT_YUV420P )
+    {
+        for ( int i = 0; i < height; i++ )
+        {
+            const uint8_t *y = src[ 0 ] + i * srcStride[ 0 ],
+                          *u = src[ 1 ] + ( i >> 1 ) * srcStride[ 1 ],
+                          *v = src[ 2 ] + ( i >> 1 ) * srcStride[ 2 ];
+
+            uint8_t *line = dst[ 0 ] + i * dstStride[ 0 ];
+
+            int x = SDL_ffmpegYUVToRGBKernel ? SDL_ffmpegYUVToRGBKernel( y, u, v, line, width, outFormat ) : 0;
+
+            SDL_ffmpegYUVToRGBScalar( y, u, v, line, x, width, outFormat );
+        }
+    }
+    else
+    {
+        /* two lines share their chroma, an odd last line is paired with itself */
+        for ( int i = 0; i < height; i += 2 )
+        {
+            int j = i + 1 < height ? i + 1 : i;
+
+            const uint8_t *s0 = src[ 0 ] + i * srcStride[ 0 ],
+                          *s1 = src[ 0 ] + j * srcStride[ 0 ];
+
+            uint8_t *y0 = dst[ 0 ] + i * dstStride[ 0 ],
+                    *y1 = dst[ 0 ] + j * dstStride[ 0 ],
+                    *u = dst[ 1 ] + ( i >> 1 ) * dstStride[ 1 ],
+                    *v = dst[ 2 ] + ( i >> 1 ) * dstStride[ 2 ];
+
+            int x = SDL_ffmpegRGBToYUVKernel ? SDL_ffmpegRGBToYUVKernel( s0, s1, y0, y1, u, v, width, inFormat ) : 0;
+
+            SDL_ffmpegRGBToYUVScalar( s0, s1, y0, y1, u, v, x, width, inFormat );
+        }
+    }
+}
+
+void SDL_ffmpegMix( int16_t *dst, const int16_t *src, int count, int gainLeft, int gainRight )
+{
+    int x = SDL_ffmpegMixKernel ? SDL_ffmpegMixKernel( dst, src, count, gainLeft, gainRight ) : 0;
+
+    /* kernels handle an even amount of samples, so x is a left sample */
+    for ( ; x < count; x++ )
+    {
+        /* the scaled sample saturates before it is added, as in the kernels */
+        int p = ( src[ x ] * ( x & 1 ? gainRight : gainLeft ) ) >> 14;
+
+        p = p > 32767 ? 32767 : p < -32768 ? -32768 : p;
+
+        int v = dst[ x ] + p;
+
+        dst[ x ] = ( int16_t )( v > 32767 ? 32767 : v < -32768 ? -32768 : v );
+    }
+}
+
+int SDL_ffmpegPublishMixerSources( SDL_ffmpegMixer *mixer )
+{
+    /* entering this function, mixer->mutex should have been locked */
+
+    int count = 0;
+
+    for ( SDL_ffmpegMixerSource *s = mixer->sources; s; s = s->next ) count++;
+
+    SDL_ffmpegMixerSource **active = ( SDL_ffmpegMixerSource** )malloc(( count + 1 ) * sizeof( SDL_ffmpegMixerSource* ) );
+    if ( !active )
+    {
+        SDL_ffmpegSetError( "could not allocate mixer sources" );
+        return -1;
+    }
+
+    count = 0;
+
+    for ( SDL_ffmpegMixerSource *s = mixer->sources; s; s = s->next ) active[ count++ ] = s;
+
+    active[ count ] = 0;
+
+    SDL_ffmpegMixerSource **previous = mixer->active;
+
+    /* a callback which starts after this uses the new sources */
+    SDL_ffmpegCompareAndSwap( &mixer->active, previous, active );
+
+    SDL_ffmpegMemoryBarrier();
+
+    /* a callback which is mixing could still use the previous sources */
+    uint32_t mixing = mixer->mixCount;
+
+    if ( mixing & 1 )
+    {
+        while ( mixer->mixCount == mixing ) SDL_Delay( 1 );
+    }
+
+    free( previous );
+
+    return 0;
+}
+
+/**
+ *  Convert a picture, in horizontal bands on multiple threads when the
+ *  stream is set up to do so. All plane arrays hold four entries.
+ *  \returns 0 on succes, -1 when no conversion context could be created.
+ */
+int SDL_ffmpegScale( SDL_ffmpegStream *stream, const uint8_t* const* src, const int *srcStride, int inWidth, int inHeight, enum PixelFormat inFormat, uint8_t* const* dst, const int *dstStride, int outWidth, int outHeight, enum PixelFormat outFormat )
+{
+    int slices = stream->conversionThreads;
+
+    if ( slices == SDL_FFMPEG_AUTO_THREADS ) slices = SDL_ffmpegCPUCount();
+
+    if ( slices > SDL_FFMPEG_MAX_SCALE_THREADS ) slices = SDL_FFMPEG_MAX_SCALE_THREADS;
+
+    /* bands can only be converted on their own when they are not scaled
+       vertically, palette formats can not be split at all */
+    if ( inHeight != outHeight || inFormat == PIX_FMT_PAL8 || inHeight < slices * SDL_FFMPEG_SCALE_ALIGN ) slices = 1;
+
+    /* colour conversion without resizing is done by our own kernels */
+    int kernel = inWidth == outWidth && inHeight == outHeight && SDL_ffmpegKernelSupported( inFormat, outFormat );
+
+    if ( slices <= 1 || !SDL_ffmpegScalePoolStart() )
+    {
+        if ( kernel )
+        {
+            SDL_ffmpegKernelConvert( src, srcStride, inFormat, dst, dstStride, outFormat, inWidth, inHeight );
+
+            return 0;
+        }
+
+        stream->conversionCache.slices = 1;
+
+        struct SwsContext *context = getContext( &stream->conversionCache, 0, inWidth, inHeight, inFormat, outWidth, outHeight, outFormat );
+        if ( !context ) return -1;
+
+        sws_scale( context, src, srcStride, 0, inHeight, dst, dstStride );
+
+        return 0;
+    }
+
+    stream->conversionCache.slices = slices;
+
+    int inShiftX, inShiftY, outShiftX, outShiftY;
+
+    avcodec_get_chroma_sub_sample( inFormat, &inShiftX, &inShiftY );
+    avcodec_get_chroma_sub_sample( outFormat, &outShiftX, &outShiftY );
+
+    int band = (( inHeight + slices - 1 ) / slices + SDL_FFMPEG_SCALE_ALIGN - 1 ) & ~( SDL_FFMPEG_SCALE_ALIGN - 1 );
+
+    SDL_ffmpegScaleJob jobs[ SDL_FFMPEG_MAX_SCALE_THREADS ];
+
+    int count = 0;
+
+    for ( int y = 0; y < inHeight; y += band, count++ )
+    {
+        SDL_ffmpegScaleJob *job = &jobs[ count ];
+
+        job->width = inWidth;
+        job->height = inHeight - y < band ? inHeight - y : band;
+        job->inFormat = inFormat;
+        job->outFormat = outFormat;
+
+        job->context = 0;
+
+        if ( !kernel )
+        {
+            job->context = getContext( &stream->conversionCache, count + 1, inWidth, job->height, inFormat, outWidth, job->height, outFormat );
+            if ( !job->context ) return -1;
+        }
+
+        /* point planes to the first line of this band, chroma planes may hold less lines */
+        for ( int p = 0; p < 4; p++ )
+        {
+            int shift = p == 1 || p == 2;
+
+            job->src[ p ] = src[ p ] ? src[ p ] + ( y >> ( shift ? inShiftY : 0 ) ) * srcStride[ p ] : 0;
+            job->srcStride[ p ] = srcStride[ p ];
+
+            job->dst[ p ] = dst[ p ] ? dst[ p ] + ( y >> ( shift ? outShiftY : 0 ) ) * dstStride[ p ] : 0;
+            job->dstStride[ p ] = dstStride[ p ];
+        }
+    }
+
+    SDL_ffmpegScaleRun( jobs, count );
+
+    return 0;
+}
+
+int SDL_ffmpegScalePoolStart()
+{
+    SDL_ffmpegScalePool *pool = &SDL_ffmpegScaleWorkers;
+
+    /* initialization already happened, so its mutex exists */
+    SDL_LockMutex( SDL_ffmpegInitMutex );
+
+    if ( !pool->mutex )
+    {
+        pool->mutex = SDL_CreateMutex();
+
+        pool->workCond = SDL_CreateCond();
+
+        pool->doneCond = SDL_CreateCond();
+
+        /* the thread requesting a conversion helps out */
+        int threads = SDL_ffmpegCPUCount() - 1;
+
+        if ( threads < 1 ) threads = 1;
+
+        if ( threads > SDL_FFMPEG_MAX_SCALE_THREADS - 1 ) threads = SDL_FFMPEG_MAX_SCALE_THREADS - 1;
+
+        for ( int i = 0; i < threads; i++ )
+        {
+            pool->threads[ pool->threadCount ] = SDL_CreateThread( SDL_ffmpegScaleThread, pool );
+
+            if ( !pool->threads[ pool->threadCount ] ) break;
+
+            pool->threadCount++;
+        }
+    }
+
+    int threads = pool->threadCount;
+
+    SDL_UnlockMutex( SDL_ffmpegInitMutex );
+
+    return threads;
+}
+
+void SDL_ffmpegScalePoolStop()
+{
+    SDL_ffmpegScalePool *pool = &SDL_ffmpegScaleWorkers;
+
+    /* without initialization, no workers were started */
+    if ( !SDL_ffmpegInitMutex ) return;
+
+    SDL_LockMutex( SDL_ffmpegInitMutex );
+
+    if ( pool->mutex )
+    {
+        SDL_LockMutex( pool->mutex );
+
+        pool->quit = 1;
+
+        SDL_CondBroadcast( pool->workCond );
+
+        SDL_UnlockMutex( pool->mutex );
+
+        for ( int i = 0; i < pool->threadCount; i++ )
+        {
+            SDL_WaitThread( pool->threads[ i ], 0 );
+        }
+
+        SDL_DestroyCond( pool->workCond );
+
+        SDL_DestroyCond( pool->doneCond );
+
+        SDL_DestroyMutex( pool->mutex );
+
+        /* the workers are started again by the next parallel conversion */
+        memset( pool, 0, sizeof( SDL_ffmpegScalePool ) );
+    }
+
+    SDL_UnlockMutex( SDL_ffmpegInitMutex );
+}
+
+void SDL_ffmpegScaleRun( SDL_ffmpegScaleJob *jobs, int count )
+{
+    SDL_ffmpegScalePool *pool = &SDL_ffmpegScaleWorkers;
+
+    SDL_ffmpegScaleBatch batch;
+
+    batch.jobs = jobs;
+    batch.jobCount = count;
+    batch.nextJob = 0;
+    batch.doneJobs = 0;
+    batch.next = 0;
+
+    SDL_LockMutex( pool->mutex );
+
+    /* queue behind the pictures of other threads, so workers share their time */
+    SDL_ffmpegScaleBatch **b = &pool->batches;
+
+    while ( *b ) b = &( *b )->next;
+
+    *b = &batch;
+
+    SDL_CondBroadcast( pool->workCond );
+
+    /* convert bands ourselves instead of waiting idle */
+    SDL_ffmpegScaleJob *job;
+
+    while (( job = SDL_ffmpegScaleTake( pool, &batch ) ))
+    {
+        SDL_UnlockMutex( pool->mutex );
+
+        SDL_ffmpegScaleJobRun( job );
+
+        SDL_LockMutex( pool->mutex );
+
+        batch.doneJobs++;
+    }
+
+    /* wait for the bands which are converted by the workers */
+    while ( batch.doneJobs < batch.jobCount ) SDL_CondWait( pool->doneCond, pool->mutex );
+
+    SDL_UnlockMutex( pool->mutex );
+}
+
+SDL_ffmpegScaleJob* SDL_ffmpegScaleTake( SDL_ffmpegScalePool *pool, SDL_ffmpegScaleBatch *batch )
+{
+    /* entering this function, pool->mutex should have been locked */
+
+    if ( batch->nextJob >= batch->jobCount ) return 0;
+
+    SDL_ffmpegScaleJob *job = &batch->jobs[ batch->nextJob++ ];
+
+    /* a batch leaves the queue once all of its bands are taken */
+    if ( batch->nextJob == batch->jobCount )
+    {
+        SDL_ffmpegScaleBatch **b = &pool->batches;
+
+        while ( *b && *b != batch ) b = &( *b )->next;
+
+        if ( *b ) *b = batch->next;
+    }
+
+    return job;
+}
+
+void SDL_ffmpegScaleJobRun( SDL_ffmpegScaleJob *job )
+{
+    if ( job->context )
+    {
+        sws_scale( job->context, job->src, job->srcStride, 0, job->height, job->dst, job->dstStride );
+    }
+    else
+    {
+        SDL_ffmpegKernelConvert( job->src, job->srcStride, job->inFormat, job->dst, job->dstStride, job->outFormat, job->width, job->height );
+    }
+}
+
+int SDL_ffmpegScaleThread( void *data )
+{
+    SDL_ffmpegScalePool *pool = ( SDL_ffmpegScalePool* )data;
+
+    SDL_LockMutex( pool->mutex );
+
+    for ( ;; )
+    {
+        /* wait for bands to convert */
+        while ( !pool->batches && !pool->quit ) SDL_CondWait( pool->workCond, pool->mutex );
+
+        if ( pool->quit ) break;
+
+        SDL_ffmpegScaleBatch *batch = pool->batches;
+
+        SDL_ffmpegScaleJob *job = SDL_ffmpegScaleTake( pool, batch );
+
+        SDL_UnlockMutex( pool->mutex );
+
+        SDL_ffmpegScaleJobRun( job );
+
+        SDL_LockMutex( pool->mutex );
+
+        /* several threads may wait for their batch */
+        if ( ++batch->doneJobs == batch->jobCount ) SDL_CondBroadcast( pool->doneCond );
+    }
+
+    SDL_UnlockMutex( pool->mutex );
+
+    return 0;
+}
+
+int SDL_ffmpegDecodeThread( void *data )
+{
+    SDL_ffmpegFile *file = ( SDL_ffmpegFile* )data;
+
+    /* frame without surface or overlay, so decoded pictures are not converted */
+    SDL_ffmpegVideoFrame frame;
+
+    memset( &frame, 0, sizeof( SDL_ffmpegVideoFrame ) );
+
+    while ( !file->stopDecoding )
+    {
+        /* wait until there is room for a new frame */
+        SDL_LockMutex( file->frameMutex );
+
+        while ( !file->stopDecoding && ( file->decodeEnd || file->frameCount == file->frameCapacity ) )
+        {
+            SDL_CondWaitTimeout( file->frameCond, file->frameMutex, 10 );
+        }
+
+        SDL_UnlockMutex( file->frameMutex );
+
+        if ( file->stopDecoding ) break;
+
+        /* when accesing audio/video stream, streamMutex should be locked */
+        SDL_LockMutex( file->streamMutex );
+
+        if ( !file->videoStream )
+        {
+            SDL_UnlockMutex( file->streamMutex );
+
+            /* nothing to decode, wait for a stream to be selected */
+            SDL_Delay( 10 );
+
+            continue;
+        }
+
+        SDL_ffmpegDecodeNextVideoFrame( file, &frame );
+
+        SDL_LockMutex( file->frameMutex );
+
+        if ( frame.ready ) SDL_ffmpegStoreDecodedFrame( file, &frame );
+
+        if ( frame.last ) file->decodeEnd = 1;
+
+        SDL_UnlockMutex( file->frameMutex );
+
+        SDL_UnlockMutex( file->streamMutex );
+    }
+
+    return 0;
+}
+
+void SDL_ffmpegStopDecodeThread( SDL_ffmpegFile *file )
+{
+    if ( file->decodeThread )
+    {
+        file->stopDecoding = 1;
+
+        SDL_CondSignal( file->frameCond );
+
+        SDL_WaitThread( file->decodeThread, 0 );
+
+        file->decodeThread = 0;
+    }
+
+    for ( uint32_t i = 0; file->frames && i <= file->frameCapacity; i++ )
+    {
+        if ( file->frames[ i ].picture )
+        {
+            avpicture_free( file->frames[ i ].picture );
+
+            av_free( file->frames[ i ].picture );
+        }
+    }
+
+    free( file->frames );
+
+    file->frames = 0;
+    file->frameCapacity = 0;
+    file->frameCount = 0;
+}
+
+int SDL_ffmpegStoreDecodedFrame( SDL_ffmpegFile *file, SDL_ffmpegVideoFrame *frame )
+{
+    /* entering this function, streamMutex and frameMutex should have been locked */
+    AVCodecContext *codec = file->videoStream->_ffmpeg->codec;
+
+    /* use the first unused frame */
+    SDL_ffmpegDecodedFrame *f = &file->frames[ file->frameCount ];
+
+    /* (re)allocate picture when the video size changed */
+    if ( !f->picture || f->width != codec->width || f->height != codec->height || f->format != codec->pix_fmt )
+    {
+        if ( f->picture )
+        {
+            avpicture_free( f->picture );
+        }
+        else
+        {
+            f->picture = ( AVPicture* )av_malloc( sizeof( AVPicture ) );
+            if ( !f->picture ) return -1;
+        }
+
+        if ( avpicture_alloc( f->picture, codec->pix_fmt, codec->width, codec->height ) < 0 )
+        {
+            av_free( f->picture );
+
+            f->picture = 0;
+
+            SDL_ffmpegSetError( "could not allocate decoded frame" );
+            return -1;
+        }
+
+        f->width = codec->width;
+        f->height = codec->height;
+        f->format = codec->pix_fmt;
+    }
+
+    av_picture_copy( f->picture, ( AVPicture* )file->videoStream->decodeFrame, codec->pix_fmt, codec->width, codec->height );
+
+    f->pts = frame->pts;
+    f->last = frame->last;
+
+    /* keep frames sorted by pts */
+    for ( uint32_t i = file->frameCount++; i > 0 && file->frames[ i - 1 ].pts > file->frames[ i ].pts; i-- )
+    {
+        SDL_ffmpegDecodedFrame temp = file->frames[ i - 1 ];
+        file->frames[ i - 1 ] = file->frames[ i ];
+        file->frames[ i ] = temp;
+    }
+
+    SDL_CondSignal( file->frameCond );
+
+    return 0;
+}
+
+int SDL_ffmpegPopDecodedFrame( SDL_ffmpegFile *file, SDL_ffmpegVideoFrame *frame )
+{
+    SDL_LockMutex( file->frameMutex );
+
+    frame->ready = 0;
+    frame->last = 0;
+
+    if ( file->frameCount && file->videoStream )
+    {
+        SDL_ffmpegDecodedFrame f = file->frames[ 0 ];
+
+        frame->pts = f.pts;
+        frame->last = f.last;
+        frame->ready = 1;
+
+        if ( !frame->surface && !frame->overlay )
+        {
+            /* the picture is exposed to the user, so it is kept aside until
+               the next request, and the previously exposed picture is reused */
+            file->frames[ 0 ] = file->frames[ file->frameCapacity ];
+            file->frames[ file->frameCapacity ] = f;
+
+            SDL_ffmpegExposeVideoFrame( f.picture->data, f.picture->linesize, f.width, f.height, ( enum PixelFormat )f.format, frame );
+
+            f = file->frames[ 0 ];
+        }
+        else
+        {
+            SDL_ffmpegConvertVideoFrame( file->videoStream,
+                                         ( const uint8_t* const* )f.picture->data,
+                                         f.picture->linesize,
+                                         f.width, f.height,
+                                         ( enum PixelFormat )f.format,
+                                         frame );
+        }
+
+        /* move the used frame to the back, so its picture can be reused */
+        memmove( file->frames, file->frames + 1, ( file->frameCapacity - 1 ) * sizeof( SDL_ffmpegDecodedFrame ) );
+
+        file->frames[ file->frameCapacity - 1 ] = f;
+
+        file->frameCount--;
+
+        /* there is room for a new frame */
+        SDL_CondSignal( file->frameCond );
+    }
+    else
+    {
+        /* no frame is ready, tell user when no more frames will follow */
+        frame->last = file->decodeEnd;
+    }
+
+    SDL_UnlockMutex( file->frameMutex );
+
+    return frame->ready;
+}
+
+enum PixelFormat SDL_ffmpegSurfaceFormat( SDL_Surface *surface )
+{
+    /* SDL surfaces are stored in system byte order */
+    switch ( surface->format->BitsPerPixel )
+    {
+        case 24:
+            return PIX_FMT_RGB24;
+
+        case 32:
+            return PIX_FMT_BGR32;
+
+        default:
+            return PIX_FMT_NONE;
+    }
+}
+
+int SDL_ffmpegPictureLayout( enum PixelFormat format, const int *pitches, int height, int *sizes )
+{
+    /* sizes of the planes in bytes, returns the amount of planes */
+    if ( format == PIX_FMT_YUV420P )
+    {
+        sizes[0] = pitches[0] * height;
+        sizes[1] = pitches[1] * (( height + 1 ) / 2 );
+        sizes[2] = pitches[2] * (( height + 1 ) / 2 );
+
+        return 3;
+    }
+
+    sizes[0] = pitches[0] * height;
+
+    return 1;
+}
+
+int SDL_ffmpegAddVideoPicture( SDL_ffmpegFile *file, const uint8_t *const *planes, const int *pitches, int width, int height, enum PixelFormat format, SDL_Surface *surface )
+{
+    if ( format == PIX_FMT_NONE )
+    {
+        if ( surface ) SDL_FreeSurface( surface );
+
+        SDL_ffmpegSetError( "unsupported surface format, use 24 or 32 bits per pixel" );
+        return -1;
+    }
+
+    if ( file->encodeThread )
+    {
+        /* a frame which was added before could not be encoded */
+        if ( SDL_ffmpegEncodeFailed( file ) )
+        {
+            if ( surface ) SDL_FreeSurface( surface );
+
+            return -1;
+        }
+
+        return SDL_ffmpegQueueVideoPicture( file, planes, pitches, width, height, format, surface );
+    }
+
+    /* when accesing audio/video stream, streamMutex should be locked */
+    SDL_LockMutex( file->streamMutex );
+
+    int error = SDL_ffmpegEncodeVideoFrame( file, file->videoStream, planes, pitches, width, height, format );
+
+    SDL_UnlockMutex( file->streamMutex );
+
+    if ( surface ) SDL_FreeSurface( surface );
+
+    return error;
+}
+
+int SDL_ffmpegEncodeVideoFrame( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, const uint8_t *const *planes, const int *pitches, int width, int height, enum PixelFormat format )
+{
+    /* the encoder of stream is only used by one thread at a time, either the
+       caller of SDL_ffmpegAddVideoFrame or the encode thread */
+
+    if ( !stream )
+    {
+        SDL_ffmpegSetError( "no valid video stream selected" );
+        return -1;
+    }
+
+    if ( stream->copySource )
+    {
+        SDL_ffmpegSetError( "video stream copies packets and can not encode frames" );
+        return -1;
+    }
+
+    AVCodecContext *codec = stream->_ffmpeg->codec;
+    AVFrame *picture = stream->encodeFrame;
+
+    if ( format == PIX_FMT_YUV420P && codec->pix_fmt == PIX_FMT_YUV420P && width == codec->width && height == codec->height )
+    {
+        /* the picture is in the format of the encoder already */
+        SDL_ffmpegCopyPlane( picture->data[0], picture->linesize[0], planes[0], pitches[0], width, height );
+        SDL_ffmpegCopyPlane( picture->data[1], picture->linesize[1], planes[1], pitches[1], ( width + 1 ) / 2, ( height + 1 ) / 2 );
+        SDL_ffmpegCopyPlane( picture->data[2], picture->linesize[2], planes[2], pitches[2], ( width + 1 ) / 2, ( height + 1 ) / 2 );
+    }
+    else if ( SDL_ffmpegScale( stream, planes, pitches, width, height, format, picture->data, picture->linesize, codec->width, codec->height, codec->pix_fmt ) )
+    {
+        /* encoding would repeat the previous picture */
+        SDL_ffmpegSetError( "could not convert frame to the format of the codec" );
+        return -1;
+    }
+
+    /* PAL = upper field first
+    stream->encodeFrame->top_field_first = 1;
+    */
+
+    int out_size = avcodec_encode_video( codec, stream->encodeFrameBuffer, stream->encodeFrameBufferSize, picture );
+
+    /* if zero size, it means the image was buffered */
+    if ( out_size > 0 )
+    {
+        AVPacket pkt;
+        av_init_packet( &pkt );
+
+        /* set correct stream index for this packet */
+        pkt.stream_index = stream->_ffmpeg->index;
+        /* set keyframe flag if needed */
+        if ( stream->_ffmpeg->codec->coded_frame->key_frame ) pkt.flags |= PKT_FLAG_KEY;
+        /* write encoded data into packet */
+        pkt.data = stream->encodeFrameBuffer;
+        /* set the correct size of this packet */
+        pkt.size = out_size;
+        /* set the correct duration of this packet */
+        pkt.duration = AV_TIME_BASE / stream->_ffmpeg->time_base.den;
+
+        /* if needed info is available, write pts for this packet */
+        if ( stream->_ffmpeg->codec->coded_frame->pts != AV_NOPTS_VALUE )
+        {
+            pkt.pts = av_rescale_q( stream->_ffmpeg->codec->coded_frame->pts, stream->_ffmpeg->codec->time_base, stream->_ffmpeg->time_base );
+        }
+
+        /* the muxer is shared with the audio stream */
+        SDL_LockMutex( file->streamMutex );
+
+        int error = SDL_ffmpegMuxPacket( file, stream, &pkt );
+
+        stream->frameCount++;
+
+        SDL_UnlockMutex( file->streamMutex );
+
+        av_free_packet( &pkt );
+
+        if ( error ) return -1;
+    }
+
+    return 0;
+}
+
+int SDL_ffmpegQueueVideoPicture( SDL_ffmpegFile *file, const uint8_t *const *planes, const int *pitches, int width, int height, enum PixelFormat format, SDL_Surface *surface )
+{
+    int sizes[ 3 ];
+
+    int count = SDL_ffmpegPictureLayout( format, pitches, height, sizes );
+
+    SDL_LockMutex( file->encodeMutex );
+
+    /* wait for the encoder when the queue is full */
+    while ( file->encodeCount == file->encodeCapacity ) SDL_CondWait( file->encodeCond, file->encodeMutex );
+
+    SDL_ffmpegEncodeSlot *slot = &file->encodeSlots[ ( file->encodeHead + file->encodeCount ) % file->encodeCapacity ];
+
+    slot->width = width;
+    slot->height = height;
+    slot->format = format;
+
+    memset( slot->pitch, 0, sizeof( slot->pitch ) );
+    memset( slot->offset, 0, sizeof( slot->offset ) );
+
+    if ( surface )
+    {
+        /* a surface which was handed over is encoded from its own pixels */
+        slot->surface = surface;
+        slot->pitch[0] = pitches[0];
+    }
+    else
+    {
+        int size = 0;
 
-    stream->codec->codec_type = CODEC_TYPE_VIDEO;
+        for ( int i = 0; i < count; i++ ) size += sizes[i];
 
-    stream->codec->bit_rate = codec.videoBitrate;
+        if ( size > slot->capacity )
+        {
+            av_free( slot->pixels );
 
-    /* resolution must be a multiple of two */
-    stream->codec->width = codec.width;
-    stream->codec->height = codec.height;
+            slot->pixels = ( uint8_t* )av_malloc( size );
+            if ( !slot->pixels )
+            {
+                slot->capacity = 0;
 
-    /* set time_base */
-    stream->codec->time_base.num = codec.framerateNum;
-    stream->codec->time_base.den = codec.framerateDen;
+                SDL_UnlockMutex( file->encodeMutex );
 
-    /* emit one intra frame every twelve frames at most */
-    stream->codec->gop_size = 12;
+                SDL_ffmpegSetError( "could not allocate encode buffer" );
+                return -1;
+            }
 
-    /* set pixel format */
-    stream->codec->pix_fmt = PIX_FMT_YUV420P;
+            slot->capacity = size;
+        }
 
-    /* set mpeg2 codec parameters */
-    if ( stream->codec->codec_id == CODEC_ID_MPEG2VIDEO )
-    {
-        stream->codec->max_b_frames = 2;
-    }
+        /* planes are stored after each other, with the pitch of the caller */
+        for ( int i = 0, offset = 0; i < count; offset += sizes[i], i++ )
+        {
+            memcpy( slot->pixels + offset, planes[i], sizes[i] );
 
-    /* set mpeg1 codec parameters */
-    if ( stream->codec->codec_id == CODEC_ID_MPEG1VIDEO )
-    {
-        /* needed to avoid using macroblocks in which some coeffs overflow
-           this doesnt happen with normal video, it just happens here as the
-           motion of the chroma plane doesnt match the luma plane */
-        stream->codec->mb_decision = 2;
+            slot->pitch[i] = pitches[i];
+            slot->offset[i] = offset;
+        }
     }
 
-    /* some formats want stream headers to be separate */
-    if ( file->_ffmpeg->oformat->flags & AVFMT_GLOBALHEADER )
-    {
-        stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
-    }
+    file->encodeCount++;
 
-    /* find the video encoder */
-    AVCodec *videoCodec = avcodec_find_encoder( stream->codec->codec_id );
-    if ( !videoCodec )
-    {
-        SDL_ffmpegSetError( "video codec not found" );
-        return 0;
-    }
+    SDL_CondBroadcast( file->encodeCond );
 
-    /* open the codec */
-    if ( avcodec_open( stream->codec, videoCodec ) < 0 )
-    {
-        SDL_ffmpegSetError( "could not open video codec" );
-        return 0;
-    }
+    SDL_UnlockMutex( file->encodeMutex );
 
-    /* create a new stream */
-    SDL_ffmpegStream *str = ( SDL_ffmpegStream* )malloc( sizeof( SDL_ffmpegStream ) );
+    return 0;
+}
 
-    if ( str )
-    {
-        /* we set our stream to zero */
-        memset( str, 0, sizeof( SDL_ffmpegStream ) );
+int SDL_ffmpegEncodeThread( void *data )
+{
+    SDL_ffmpegFile *file = ( SDL_ffmpegFile* )data;
 
-        str->id = file->audioStreams + file->videoStreams;
+    SDL_LockMutex( file->encodeMutex );
 
-        /* _ffmpeg holds data about streamcodec */
-        str->_ffmpeg = stream;
+    for ( ;; )
+    {
+        while ( !file->encodeCount && !file->stopEncoding ) SDL_CondWait( file->encodeCond, file->encodeMutex );
 
-        str->mutex = SDL_CreateMutex();
+        /* all frames are written before the thread stops */
+        if ( !file->encodeCount ) break;
 
-        str->encodeFrame = avcodec_alloc_frame();
+        /* the slot stays in use until the frame was encoded */
+        SDL_ffmpegEncodeSlot *slot = &file->encodeSlots[ file->encodeHead ];
 
-        uint8_t *picture_buf;
-        int size = avpicture_get_size( stream->codec->pix_fmt, stream->codec->width, stream->codec->height );
-        picture_buf = ( uint8_t* )av_malloc( size + FF_INPUT_BUFFER_PADDING_SIZE );
-        avpicture_fill(( AVPicture* )str->encodeFrame, picture_buf, stream->codec->pix_fmt, stream->codec->width, stream->codec->height );
+        SDL_UnlockMutex( file->encodeMutex );
 
-        str->encodeFrameBufferSize = stream->codec->width * stream->codec->height * 4 + FF_INPUT_BUFFER_PADDING_SIZE;
+        /* the selected stream should not change while frames are added */
+        SDL_LockMutex( file->streamMutex );
 
-        str->encodeFrameBuffer = ( uint8_t* )av_malloc( str->encodeFrameBufferSize );
+        SDL_ffmpegStream *stream = file->videoStream;
 
-        file->videoStreams++;
+        SDL_UnlockMutex( file->streamMutex );
 
-        /* find correct place to save the stream */
-        SDL_ffmpegStream **s = &file->vs;
-        while ( *s )
+        const uint8_t *base = slot->surface ? ( const uint8_t* )slot->surface->pixels : slot->pixels;
+
+        const uint8_t *planes[] =
         {
-            *s = ( *s )->next;
-        }
+            base + slot->offset[0],
+            slot->pitch[1] ? base + slot->offset[1] : 0,
+            slot->pitch[2] ? base + slot->offset[2] : 0,
+            0
+        };
 
-        *s = str;
+        int error = SDL_ffmpegEncodeVideoFrame( file, stream, planes, slot->pitch, slot->width, slot->height, ( enum PixelFormat )slot->format );
 
-        if ( av_set_parameters( file->_ffmpeg, 0 ) < 0 )
+        if ( slot->surface ) SDL_FreeSurface( slot->surface );
+
+        slot->surface = 0;
+
+        SDL_LockMutex( file->encodeMutex );
+
+        /* the caller learns about the first failure when adding or flushing frames */
+        if ( error && !file->encodeFailed )
         {
-            SDL_ffmpegSetError( "could not set encoding parameters" );
+            file->encodeFailed = 1;
+
+            snprintf( file->encodeError, sizeof( file->encodeError ), "%s", SDL_ffmpegGetError() );
         }
 
-        /* try to write a header */
-        av_write_header( file->_ffmpeg );
+        file->encodeHead = ( file->encodeHead + 1 ) % file->encodeCapacity;
+        file->encodeCount--;
+
+        /* there is room in the queue, and it might be empty */
+        SDL_CondBroadcast( file->encodeCond );
     }
 
-    return str;
+    SDL_UnlockMutex( file->encodeMutex );
+
+    return 0;
 }
 
+int SDL_ffmpegEncodeFailed( SDL_ffmpegFile *file )
+{
+    SDL_LockMutex( file->encodeMutex );
 
-/** \brief  This is used to add a video stream to file
+    int failed = file->encodeFailed;
 
-\param      file SDL_ffmpegFile to which the stream will be added
-\param      codec SDL_ffmpegCodec describing the type encoding to be used by this
-                  stream.
-\returns    The stream which was added, or NULL if no stream could be added.
-*/
-SDL_ffmpegStream* SDL_ffmpegAddAudioStream( SDL_ffmpegFile *file, SDL_ffmpegCodec codec )
+    file->encodeFailed = 0;
+
+    /* the error was raised on the encode thread */
+    if ( failed ) SDL_ffmpegSetError( file->encodeError );
+
+    SDL_UnlockMutex( file->encodeMutex );
+
+    return failed ? -1 : 0;
+}
+
+void SDL_ffmpegStopEncodeThread( SDL_ffmpegFile *file )
 {
-    // add an audio stream
-    AVStream *stream = av_new_stream( file->_ffmpeg, 1 );
-    if ( !stream )
+    if ( file->encodeThread )
     {
-        SDL_ffmpegSetError( "could not allocate audio stream" );
-        return 0;
+        SDL_LockMutex( file->encodeMutex );
+
+        file->stopEncoding = 1;
+
+        SDL_CondBroadcast( file->encodeCond );
+
+        SDL_UnlockMutex( file->encodeMutex );
+
+        SDL_WaitThread( file->encodeThread, 0 );
+
+        file->encodeThread = 0;
     }
 
-    if ( codec.audioCodecID < 0 )
+    for ( uint32_t i = 0; i < file->encodeCapacity; i++ )
     {
-        stream->codec->codec_id = file->_ffmpeg->oformat->audio_codec;
+        av_free( file->encodeSlots[ i ].pixels );
+
+        if ( file->encodeSlots[ i ].surface ) SDL_FreeSurface( file->encodeSlots[ i ].surface );
     }
-    else
+
+    free( file->encodeSlots );
+
+    file->encodeSlots = 0;
+    file->encodeCapacity = 0;
+    file->encodeCount = 0;
+}
+
+int SDL_ffmpegEncodeAudio( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, const int16_t *samples, int count )
+{
+    AVCodecContext *codec = stream->_ffmpeg->codec;
+
+    int bufferSize = stream->encodeAudioBufferSize;
+
+    /* PCM codecs derive the number of samples from the output size */
+    if ( samples && codec->frame_size <= 1 )
     {
-        stream->codec->codec_id = ( enum CodecID ) codec.audioCodecID;
+        bufferSize = bufferSize / stream->encodeAudioInputSize * count;
     }
 
-    stream->codec->codec_type = CODEC_TYPE_AUDIO;
-    stream->codec->bit_rate = codec.audioBitrate;
-    stream->codec->sample_rate = codec.sampleRate;
-    stream->codec->channels = codec.channels;
+    int size = avcodec_encode_audio( codec, stream->encodeAudioBuffer, bufferSize, samples );
 
-    // find the audio encoder
-    AVCodec *audioCodec = avcodec_find_encoder( stream->codec->codec_id );
-    if ( !audioCodec )
+    if ( size < 0 )
     {
-        SDL_ffmpegSetError( "audio codec not found" );
-        return 0;
+        SDL_ffmpegSetError( "could not encode audio frame" );
+        return -1;
     }
 
-    // open the codec
-    if ( avcodec_open( stream->codec, audioCodec ) < 0 )
+    /* the timestamp follows the samples which were handed to the encoder */
+    int64_t pts = stream->encodeAudioSamples;
+
+    stream->encodeAudioSamples += count;
+
+    /* encoder is buffering this frame */
+    if ( !size ) return 0;
+
+    AVPacket pkt;
+
+    /* initialize a packet to write */
+    av_init_packet( &pkt );
+
+    /* set correct stream index for this packet */
+    pkt.stream_index = stream->_ffmpeg->index;
+
+    /* set keyframe flag if needed */
+    pkt.flags |= PKT_FLAG_KEY;
+
+    /* write encoded data into packet */
+    pkt.data = stream->encodeAudioBuffer;
+    pkt.size = size;
+
+    /* if needed info is available, write pts for this packet */
+    if ( codec->coded_frame && codec->coded_frame->pts != AV_NOPTS_VALUE )
     {
-        SDL_ffmpegSetError( "could not open audio codec" );
-        return 0;
+        pkt.pts = av_rescale_q( codec->coded_frame->pts, codec->time_base, stream->_ffmpeg->time_base );
     }
-
-    /* some formats want stream headers to be separate */
-    if ( file->_ffmpeg->oformat->flags & AVFMT_GLOBALHEADER )
+    else if ( samples )
     {
-        stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+        pkt.pts = av_rescale( pts, ( int64_t )stream->_ffmpeg->time_base.den, ( int64_t )codec->sample_rate * stream->_ffmpeg->time_base.num );
     }
 
+    /* write packet to stream */
+    int error = SDL_ffmpegMuxPacket( file, stream, &pkt );
 
-    /* create a new stream */
-    SDL_ffmpegStream *str = ( SDL_ffmpegStream* )malloc( sizeof( SDL_ffmpegStream ) );
+    av_free_packet( &pkt );
 
-    if ( str )
-    {
-        str->_ffmpeg = stream;
+    stream->frameCount++;
 
-        /* we set our stream to zero */
-        memset( str, 0, sizeof( SDL_ffmpegStream ) );
+    return error;
+}
 
-        str->id = file->audioStreams + file->videoStreams;
+int SDL_ffmpegFlushAudioEncoder( SDL_ffmpegFile *file, SDL_ffmpegStream *stream )
+{
+    /* streams copying packets have no encoder */
+    if ( stream->copySource ) return 0;
 
-        /* _ffmpeg holds data about streamcodec */
-        str->_ffmpeg = stream;
+    SDL_LockMutex( file->streamMutex );
 
-        str->mutex = SDL_CreateMutex();
+    SDL_ffmpegAudioFifo *fifo = &stream->audioFifo;
 
-        str->sampleBufferSize = 10000;
+    int sampleSize = 2 * stream->_ffmpeg->codec->channels;
 
-        str->sampleBuffer = ( int8_t* )av_malloc( str->sampleBufferSize );
+    int frameBytes = stream->encodeAudioInputSize * sampleSize;
 
-        /* ugly hack for PCM codecs (will be removed ASAP with new PCM
-           support to compute the input frame size in samples */
-        if ( stream->codec->frame_size <= 1 )
+    int error = 0;
+
+    /* complete frames are left when encoding failed before */
+    while ( fifo->size >= frameBytes && !error )
+    {
+        error = SDL_ffmpegEncodeAudio( file, stream, ( const int16_t* )( fifo->buffer + fifo->offset ), stream->encodeAudioInputSize );
+
+        fifo->offset += frameBytes;
+        fifo->size -= frameBytes;
+    }
+
+    if ( fifo->size && !error )
+    {
+        int count = fifo->size / sampleSize;
+
+        /* codecs with a fixed frame size get their last frame padded with silence */
+        if ( stream->_ffmpeg->codec->frame_size > 1 )
         {
-            str->encodeAudioInputSize = str->sampleBufferSize / stream->codec->channels;
+            error = SDL_ffmpegAudioFifoReserve( fifo, frameBytes - fifo->size );
 
-            switch ( stream->codec->codec_id )
+            if ( !error )
             {
-                case CODEC_ID_PCM_S16LE:
-                case CODEC_ID_PCM_S16BE:
-                case CODEC_ID_PCM_U16LE:
-                case CODEC_ID_PCM_U16BE:
-                    str->encodeAudioInputSize >>= 1;
-                    break;
-                default:
-                    break;
+                memset( fifo->buffer + fifo->offset + fifo->size, 0, frameBytes - fifo->size );
+
+                fifo->size = frameBytes;
             }
         }
-        else
+
+        /* the padding is not part of the stream */
+        if ( !error ) error = SDL_ffmpegEncodeAudio( file, stream, ( const int16_t* )( fifo->buffer + fifo->offset ), count );
+    }
+
+    /* whatever could not be encoded is dropped, the stream ends here */
+    fifo->offset = 0;
+    fifo->size = 0;
+
+    /* collect the frames a delaying encoder still holds */
+    if ( stream->_ffmpeg->codec->codec->capabilities & CODEC_CAP_DELAY )
+    {
+        uint64_t frames;
+
+        do
         {
-            str->encodeAudioInputSize = stream->codec->frame_size;
+            frames = stream->frameCount;
+
+            if ( SDL_ffmpegEncodeAudio( file, stream, 0, 0 ) ) error = -1;
         }
+        while ( !error && frames != stream->frameCount );
+    }
 
-        file->audioStreams++;
+    SDL_UnlockMutex( file->streamMutex );
 
-        /* find correct place to save the stream */
-        SDL_ffmpegStream **s = &file->as;
-        while ( *s )
+    return error;
+}
+
+int SDL_ffmpegMuxPacket( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, AVPacket *pkt )
+{
+    SDL_ffmpegPacket *pack = SDL_ffmpegAcquirePacket( &file->packetPool, pkt->size );
+    if ( !pack )
+    {
+        SDL_ffmpegSetError( "could not queue encoded packet" );
+        return -1;
+    }
+
+    /* the payload of pkt is owned by the encoder, so it is copied */
+    AVPacket *data = pack->data;
+
+    data->pts = pkt->pts;
+    data->dts = pkt->dts;
+    data->size = pkt->size;
+    data->stream_index = pkt->stream_index;
+    data->flags = pkt->flags;
+    data->duration = pkt->duration;
+
+    memcpy( data->data, pkt->data, pkt->size );
+    memset( data->data + pkt->size, 0, FF_INPUT_BUFFER_PADDING_SIZE );
+
+    /* encoders only provide a presentation time, which is close enough to
+       interleave streams, but the packets of a stream are written in the order
+       they were encoded, so their time never goes back */
+    int64_t ts = data->dts != AV_NOPTS_VALUE ? data->dts : data->pts;
+
+    if ( ts != AV_NOPTS_VALUE )
+    {
+        int64_t time = av_rescale( ts, AV_TIME_BASE * ( int64_t )stream->_ffmpeg->time_base.num, stream->_ffmpeg->time_base.den );
+
+        if ( stream->muxTime == AV_NOPTS_VALUE || time > stream->muxTime ) stream->muxTime = time;
+    }
+
+    pack->time = stream->muxTime;
+    pack->next = 0;
+
+    /* packets usually arrive in order, so look for their place from the front
+       only when they do not belong at the end */
+    if ( !file->muxQueue || file->muxTail->time <= pack->time )
+    {
+        if ( file->muxTail ) file->muxTail->next = pack;
+        else file->muxQueue = pack;
+
+        file->muxTail = pack;
+    }
+    else
+    {
+        SDL_ffmpegPacket **p = &file->muxQueue;
+        while ( ( *p )->time <= pack->time )
+        {
+            p = &( *p )->next;
+        }
+
+        pack->next = *p;
+
+        *p = pack;
+    }
+
+    file->muxBytes += data->size;
+
+    stream->muxCount++;
+
+    return SDL_ffmpegWriteMuxQueue( file, 0 );
+}
+
+int SDL_ffmpegMuxReady( SDL_ffmpegFile *file )
+{
+    if ( file->muxByteLimit && file->muxBytes > file->muxByteLimit ) return 1;
+
+    if ( file->muxDurationLimit && file->muxQueue->time != AV_NOPTS_VALUE && file->muxTail->time - file->muxQueue->time > ( int64_t )file->muxDurationLimit * ( AV_TIME_BASE / 1000 ) ) return 1;
+
+    /* no later packet of another stream can precede the first packet
+       once every stream has a packet waiting */
+    for ( SDL_ffmpegStream *s = file->vs; s; s = s->next )
+    {
+        if ( !s->muxCount ) return 0;
+    }
+
+    for ( SDL_ffmpegStream *s = file->as; s; s = s->next )
+    {
+        if ( !s->muxCount ) return 0;
+    }
+
+    return 1;
+}
+
+int SDL_ffmpegWriteMuxQueue( SDL_ffmpegFile *file, int all )
+{
+    int error = 0;
+
+    while ( file->muxQueue && ( all || SDL_ffmpegMuxReady( file ) ) )
+    {
+        SDL_ffmpegPacket *pack = file->muxQueue;
+
+        file->muxQueue = pack->next;
+
+        if ( !file->muxQueue ) file->muxTail = 0;
+
+        file->muxBytes -= pack->data->size;
+
+        /* find the stream this packet belongs to */
+        SDL_ffmpegStream *stream = file->vs;
+        while ( stream && stream->_ffmpeg->index != pack->data->stream_index ) stream = stream->next;
+
+        if ( !stream )
         {
-            *s = ( *s )->next;
+            stream = file->as;
+            while ( stream && stream->_ffmpeg->index != pack->data->stream_index ) stream = stream->next;
         }
 
-        *s = str;
+        if ( stream ) stream->muxCount--;
 
-        if ( av_set_parameters( file->_ffmpeg, 0 ) < 0 )
+        if ( av_write_frame( file->_ffmpeg, pack->data ) < 0 )
         {
-            SDL_ffmpegSetError( "could not set encoding parameters" );
-            return 0;
+            SDL_ffmpegSetError( "could not write encoded packet" );
+            error = -1;
         }
 
-        /* try to write a header */
-        av_write_header( file->_ffmpeg );
+        SDL_ffmpegReleasePacket( pack );
     }
 
-    return str;
+    return error;
 }
 
-
-/** \brief  Use this function to query if an error occured
-
-\returns    non-zero when an error occured
-*/
-int SDL_ffmpegError()
+int SDL_ffmpegCopiesFrom( SDL_ffmpegStream *stream, SDL_ffmpegFile *input )
 {
-    return SDL_ffmpegErrorMessage[ 0 ];
-}
+    if ( !stream->copySource ) return 0;
 
+    unsigned int index = stream->copySource->_ffmpeg->index;
 
-/** \brief  Use this function to get the last error string
+    return index < input->_ffmpeg->nb_streams && input->_ffmpeg->streams[ index ] == stream->copySource->_ffmpeg;
+}
 
-\returns    When no error was found, NULL is returned
-*/
-const char* SDL_ffmpegGetError()
+SDL_ffmpegStream* SDL_ffmpegCopyTarget( SDL_ffmpegFile *file, SDL_ffmpegFile *input, int index )
 {
-    return SDL_ffmpegErrorMessage;
-}
+    SDL_ffmpegStream *stream = file->vs;
+    while ( stream )
+    {
+        if ( SDL_ffmpegCopiesFrom( stream, input ) && stream->copySource->_ffmpeg->index == index ) return stream;
 
+        stream = stream->next;
+    }
 
-/** \brief  Use this function to clear all standing errors
+    stream = file->as;
+    while ( stream )
+    {
+        if ( SDL_ffmpegCopiesFrom( stream, input ) && stream->copySource->_ffmpeg->index == index ) return stream;
 
-*/
-void SDL_ffmpegClearError()
-{
-    SDL_ffmpegErrorMessage[ 0 ] = 0;
-}
+        stream = stream->next;
+    }
 
-/**
-\cond
-*/
+    return 0;
+}
 
-void SDL_ffmpegSetError( const char *error )
+void SDL_ffmpegCopyDiscard( SDL_ffmpegFile *file, SDL_ffmpegFile *input, int copying )
 {
-    if ( !error ) return;
+    SDL_ffmpegStream *lists[] = { file->vs, file->as };
 
-    if ( snprintf( SDL_ffmpegErrorMessage, 512, "%s", error ) >= 511 )
+    for ( int i = 0; i < 2; i++ )
     {
-        SDL_ffmpegErrorMessage[ 511 ] = 0;
+        for ( SDL_ffmpegStream *s = lists[ i ]; s; s = s->next )
+        {
+            if ( !SDL_ffmpegCopiesFrom( s, input ) ) continue;
+
+            SDL_ffmpegStream *source = s->copySource;
+
+            /* copied streams are read, afterwards only selected streams are */
+            if ( copying || source == input->videoStream || source == input->audioStream )
+            {
+                source->_ffmpeg->discard = AVDISCARD_DEFAULT;
+            }
+            else
+            {
+                source->_ffmpeg->discard = AVDISCARD_ALL;
+            }
+        }
     }
 }
 
-int SDL_ffmpegGetPacket( SDL_ffmpegFile *file )
+int SDL_ffmpegCopyPacket( SDL_ffmpegFile *file, SDL_ffmpegStream *stream, AVStream *source, AVPacket *pkt, int64_t startTime )
 {
-    /* entering this function, streamMutex should have been locked */
+    /* start of the cut in the time base of source */
+    int64_t offset = av_rescale( startTime, source->time_base.den, AV_TIME_BASE * ( int64_t )source->time_base.num );
 
-    /* create a packet for our data */
-    AVPacket *pack = ( AVPacket* )av_malloc( sizeof( AVPacket ) );
+    if ( pkt->pts != AV_NOPTS_VALUE ) pkt->pts = av_rescale_q( pkt->pts - offset, source->time_base, stream->_ffmpeg->time_base );
 
-    /* initialize packet */
-    av_init_packet( pack );
+    if ( pkt->dts != AV_NOPTS_VALUE ) pkt->dts = av_rescale_q( pkt->dts - offset, source->time_base, stream->_ffmpeg->time_base );
 
-    /* read a packet from the file */
-    int decode = av_read_frame( file->_ffmpeg, pack );
+    pkt->duration = ( int )av_rescale_q( pkt->duration, source->time_base, stream->_ffmpeg->time_base );
 
-    /* if we did not get a packet, we probably reached the end of the file */
-    if ( decode < 0 )
-    {
-        av_free( pack );
+    pkt->stream_index = stream->_ffmpeg->index;
 
-        /* signal EOF */
-        return 1;
-    }
+    int error = SDL_ffmpegMuxPacket( file, stream, pkt );
 
-    /* we got a packet, lets handle it */
+    stream->frameCount++;
+
+    return error;
+}
+
+int SDL_ffmpegAudioThread( void *data )
+{
+    SDL_ffmpegFile *file = ( SDL_ffmpegFile* )data;
 
-    /* try to allocate the packet */
-    if ( av_dup_packet( pack ) )
+    SDL_ffmpegAudioRing *ring = &file->audioRing;
+
+    /* decoded audio which still has to be written to the ring */
+    SDL_ffmpegAudioFrame chunk;
+
+    memset( &chunk, 0, sizeof( SDL_ffmpegAudioFrame ) );
+
+    chunk.buffer = ( uint8_t* )av_malloc( SDL_FFMPEG_AUDIO_CHUNK );
+    if ( !chunk.buffer )
     {
-        /* error allocating packet */
-        av_free_packet( pack );
+        /* nothing will ever be decoded, let the user know playback ended */
+        ring->last = 1;
+
+        return -1;
     }
-    else
+
+    uint32_t offset = 0,
+             generation = 0;
+
+    /* set when the next chunk does not continue the timing of the previous one */
+    int discontinuity = 1;
+
+    SDL_ffmpegFile *source = 0;
+
+    while ( !file->stopAudio )
     {
-        /* If it's a packet from either of our streams, return it */
-        if ( file->audioStream && pack->stream_index == file->audioStream->id )
+        /* when accesing audio/video stream, streamMutex should be locked */
+        SDL_LockMutex( file->streamMutex );
+
+        /* data decoded before a flush is no longer valid */
+        if ( generation != file->audioGeneration )
         {
-            /* prepare packet */
-            SDL_ffmpegPacket *temp = ( SDL_ffmpegPacket* )malloc( sizeof( SDL_ffmpegPacket ) );
-            temp->data = pack;
-            temp->next = 0;
+            generation = file->audioGeneration;
 
-            SDL_ffmpegPacket **p = &file->audioStream->buffer;
+            chunk.size = offset = 0;
+            chunk.last = 0;
 
-            while ( *p )
-            {
-                p = &( *p )->next;
-            }
+            discontinuity = 1;
+        }
+
+        /* audio of another file, or of the start of the file, follows */
+        if ( source != file->audioSource )
+        {
+            source = file->audioSource;
 
-            *p = temp;
+            discontinuity = 1;
         }
-        else if ( file->videoStream && pack->stream_index == file->videoStream->id )
+
+        if ( offset == chunk.size && source->audioStream && !ring->last )
         {
-            /* prepare packet */
-            SDL_ffmpegPacket *temp = ( SDL_ffmpegPacket* )malloc( sizeof( SDL_ffmpegPacket ) );
-            temp->data = pack;
-            temp->next = 0;
+            int rate, channels;
+            uint16_t format;
+
+            SDL_ffmpegAudioOutputSpec( source, &rate, &channels, &format );
 
-//            SDL_LockMutex( file->videoStream->mutex );
+            /* decode whole samples for every channel */
+            uint32_t frameSize = channels > 0 ? channels * SDL_ffmpegAudioBytesPerSample( format ) : 2;
 
-            SDL_ffmpegPacket **p = &file->videoStream->buffer;
+            chunk.capacity = SDL_FFMPEG_AUDIO_CHUNK - SDL_FFMPEG_AUDIO_CHUNK % frameSize;
+            chunk.size = offset = 0;
+            chunk.last = 0;
 
-            while ( *p )
+            /* SDL expects interleaved audio, whatever layout the user selected */
+            if ( source == file )
+            {
+                SDL_ffmpegReadAudioFrame( source, &chunk );
+            }
+            else
             {
-                p = &( *p )->next;
+                /* a queued file is decoded with only its own streamMutex
+                   locked, so the reader of source can be waited for */
+                SDL_UnlockMutex( file->streamMutex );
+
+                SDL_LockMutex( source->streamMutex );
+
+                SDL_ffmpegReadAudioFrame( source, &chunk );
+
+                SDL_UnlockMutex( source->streamMutex );
+
+                SDL_LockMutex( file->streamMutex );
+
+                /* file was flushed or returned to its own audio meanwhile */
+                if ( generation != file->audioGeneration || source != file->audioSource )
+                {
+                    chunk.size = 0;
+                    chunk.last = 0;
+                }
             }
 
-            *p = temp;
+            /* timing is counted in samples, so it only has to be stored when it jumps */
+            if ( chunk.size && chunk.pts != AV_NOPTS_VALUE && discontinuity )
+            {
+                SDL_ffmpegRingSetTime( ring, ring->head, chunk.pts, frameSize * rate, source );
 
-//            SDL_UnlockMutex( file->videoStream->mutex );
+                discontinuity = 0;
+            }
         }
-        else
+
+        uint32_t written = 0;
+
+        if ( offset < chunk.size )
+        {
+            written = SDL_ffmpegRingWrite( ring, chunk.buffer + offset, chunk.size - offset );
+
+            offset += written;
+        }
+
+        if ( offset == chunk.size && chunk.last )
         {
-            av_free_packet( pack );
+            chunk.last = 0;
+
+            /* continue with a queued file or the start of the file, or stop */
+            if ( SDL_ffmpegSpliceAudio( file ) )
+            {
+                written = 1;
+            }
+            else
+            {
+                ring->last = 1;
+            }
         }
+
+        /* wait when the ring is full, or there is nothing to decode */
+        if ( !written && !file->stopAudio ) SDL_CondWaitTimeout( file->audioCond, file->streamMutex, 10 );
+
+        SDL_UnlockMutex( file->streamMutex );
     }
 
+    av_free( chunk.buffer );
+
     return 0;
 }
 
-SDL_ffmpegPacket* SDL_ffmpegGetAudioPacket( SDL_ffmpegFile *file )
+void SDL_ffmpegStopAudioThread( SDL_ffmpegFile *file )
 {
-    if ( !file->audioStream ) return 0;
+    if ( file->audioThread )
+    {
+        SDL_LockMutex( file->streamMutex );
 
-    /* file->audioStream->mutex should be locked before entering this function */
+        file->stopAudio = 1;
 
-    SDL_ffmpegPacket *pack = 0;
+        SDL_CondSignal( file->audioCond );
 
-    /* check if there are still packets in buffer */
-    if ( file->audioStream->buffer )
-    {
-        pack = file->audioStream->buffer;
+        SDL_UnlockMutex( file->streamMutex );
+
+        SDL_WaitThread( file->audioThread, 0 );
 
-        file->audioStream->buffer = pack->next;
+        file->audioThread = 0;
+
+        SDL_ffmpegRestoreAudioSource( file );
     }
 
-    /* if a packet was found, return it */
-    return pack;
+    av_free( file->audioRing.buffer );
+
+    memset( &file->audioRing, 0, sizeof( SDL_ffmpegAudioRing ) );
 }
 
-SDL_ffmpegPacket* SDL_ffmpegGetVideoPacket( SDL_ffmpegFile *file )
+void SDL_ffmpegFlushAudioRing( SDL_ffmpegFile *file )
 {
-    if ( !file->videoStream ) return 0;
+    if ( !file->audioThread ) return;
 
-    /* file->videoStream->mutex should be locked before entering this function */
+    SDL_ffmpegAudioRing *ring = &file->audioRing;
 
-    SDL_ffmpegPacket *pack = 0;
+    /* streamMutex is locked, so the audio thread does not write right now,
+       the audio callback skips all data up to the current head */
+    ring->flushPosition = ring->head;
 
-    /* check if there are still packets in buffer */
-    if ( file->videoStream->buffer )
-    {
-        pack = file->videoStream->buffer;
+    SDL_ffmpegMemoryBarrier();
 
-        file->videoStream->buffer = pack->next;
-    }
+    ring->flushRequest++;
 
-    /* if a packet was found, return it */
-    return pack;
+    ring->last = 0;
+
+    /* data which the audio thread is holding should not be written */
+    file->audioGeneration++;
+
+    SDL_ffmpegRestoreAudioSource( file );
+
+    SDL_CondSignal( file->audioCond );
 }
 
-int SDL_ffmpegDecodeAudioFrame( SDL_ffmpegFile *file, AVPacket *pack, SDL_ffmpegAudioFrame *frame )
+int SDL_ffmpegSpliceAudio( SDL_ffmpegFile *file )
 {
-    uint8_t *data = pack->data;
-    int size = pack->size;
-    int audioSize = AVCODEC_MAX_AUDIO_FRAME_SIZE * sizeof( int16_t );
+    /* entering this function, streamMutex should have been locked */
+
+    SDL_ffmpegFile *source = file->audioSource;
+
+    if ( !source ) return 0;
 
-    /* check if there is still data in the buffer */
-    if ( file->audioStream->sampleBufferSize )
+    SDL_ffmpegFile *next = source->nextAudioFile;
+
+    if ( next )
     {
-        /* set new pts */
-        if ( !frame->size ) frame->pts = file->audioStream->sampleBufferTime;
+        int rate, channels;
+        uint16_t format;
 
-        /* calculate free space in frame */
-        int fs = frame->capacity - frame->size;
+        /* the audio device keeps playing in the format of file */
+        SDL_ffmpegAudioOutputSpec( file, &rate, &channels, &format );
 
-        /* check the amount of data which needs to be copied */
-        if ( fs < file->audioStream->sampleBufferSize )
-        {
-            /* copy data from sampleBuffer into frame buffer until frame buffer is full */
-            memcpy( frame->buffer + frame->size, file->audioStream->sampleBuffer + file->audioStream->sampleBufferOffset, fs );
+        if ( SDL_ffmpegSetAudioOutput( next, rate, channels, format, file->audioOutput.quality ) ) return 0;
 
-            /* mark the amount of bytes still in the buffer */
-            file->audioStream->sampleBufferSize -= fs;
+        /* a played file leaves the queue */
+        source->nextAudioFile = 0;
 
-            /* move offset accordingly */
-            file->audioStream->sampleBufferOffset += fs;
+        file->audioSource = next;
 
-            /* update framesize */
-            frame->size = frame->capacity;
-        }
-        else
-        {
-            /* copy data from sampleBuffer into frame buffer until sampleBuffer is empty */
-            memcpy( frame->buffer + frame->size, file->audioStream->sampleBuffer + file->audioStream->sampleBufferOffset, file->audioStream->sampleBufferSize );
+        return 1;
+    }
+
+    /* seeking back would cut off the video which is still buffered */
+    if ( file->audioLoop && !source->videoStream )
+    {
+        SDL_LockMutex( source->streamMutex );
 
-            /* update framesize */
-            frame->size += file->audioStream->sampleBufferSize;
+        /* the audio ring is left as it is, so the start follows the last samples */
+        SDL_ffmpegSeekStreams( source, 0 );
 
-            /* at this point, samplebuffer should have been handled */
-            file->audioStream->sampleBufferSize = 0;
+        SDL_UnlockMutex( source->streamMutex );
 
-            /* no more data in buffer, reset offset */
-            file->audioStream->sampleBufferOffset = 0;
-        }
+        /* the audio thread stores the timing of the new start */
+        file->audioGeneration++;
 
-        /* return 0 to signal caller that 'pack' was not used */
-        if ( frame->size == frame->capacity ) return 0;
+        return 1;
     }
 
-    file->audioStream->_ffmpeg->codec->hurry_up = 0;
+    return 0;
+}
+
+void SDL_ffmpegRestoreAudioSource( SDL_ffmpegFile *file )
+{
+    /* entering this function, streamMutex should have been locked */
 
-    /* calculate pts to determine wheter or not this frame should be stored */
-    file->audioStream->sampleBufferTime = av_rescale(( pack->dts - file->audioStream->_ffmpeg->start_time ) * 1000, file->audioStream->_ffmpeg->time_base.num, file->audioStream->_ffmpeg->time_base.den );
+    SDL_ffmpegFile *source = file->audioSource;
 
-    /* don't decode packets which are too old anyway */
-    if ( file->audioStream->sampleBufferTime != AV_NOPTS_VALUE && file->audioStream->sampleBufferTime < file->minimalTimestamp )
+    /* files which were queued after the current source stay queued after file */
+    if ( source && source != file )
     {
-        file->audioStream->_ffmpeg->codec->hurry_up = 1;
+        file->nextAudioFile = source->nextAudioFile;
+
+        source->nextAudioFile = 0;
     }
 
-    while ( size > 0 )
-    {
-        /* Decode the packet */
+    file->audioSource = file;
+}
 
-#if ( LIBAVCODEC_VERSION_MAJOR <= 52 && LIBAVCODEC_VERSION_MINOR <= 20 )
-        int len = avcodec_decode_audio2( file->audioStream->_ffmpeg->codec, ( int16_t* )file->audioStream->sampleBuffer, &audioSize, pack->data, pack->size );
-#else
-        int len = avcodec_decode_audio3( file->audioStream->_ffmpeg->codec, ( int16_t* )file->audioStream->sampleBuffer, &audioSize, pack );
-#endif
+uint32_t SDL_ffmpegRingWrite( SDL_ffmpegAudioRing *ring, const uint8_t *data, uint32_t bytes )
+{
+    uint32_t head = ring->head;
 
-        /* if an error occured, we skip the frame */
-        if ( len <= 0 || !audioSize )
-        {
-            SDL_ffmpegSetError( "error decoding audio frame" );
-            break;
-        }
+    /* the callback should be done with data before it is overwritten */
+    SDL_ffmpegMemoryBarrier();
 
-        /* change pointers */
-        data += len;
-        size -= len;
-    }
+    uint32_t space = ring->size - ( head - ring->tail );
 
-    if ( !file->audioStream->_ffmpeg->codec->hurry_up )
-    {
-        /* set new pts */
-        if ( !frame->size ) frame->pts = file->audioStream->sampleBufferTime;
+    if ( bytes > space ) bytes = space;
 
-        /* room in frame */
-        int fs = frame->capacity - frame->size;
+    if ( !bytes ) return 0;
 
-        /* check if there is room at all */
-        if ( fs )
-        {
-            /* check the amount of data which needs to be copied */
-            if ( fs < audioSize )
-            {
-                /* copy data from sampleBuffer into frame buffer until frame buffer is full */
-                memcpy( frame->buffer + frame->size, file->audioStream->sampleBuffer, fs );
+    /* copy in at most two spans, the second one wraps to the start */
+    uint32_t offset = head & ( ring->size - 1 );
+    uint32_t first = ring->size - offset < bytes ? ring->size - offset : bytes;
 
-                /* mark the amount of bytes still in the buffer */
-                file->audioStream->sampleBufferSize = audioSize - fs;
+    memcpy( ring->buffer + offset, data, first );
+    memcpy( ring->buffer, data + first, bytes - first );
 
-                /* set the offset so the remaining data can be found */
-                file->audioStream->sampleBufferOffset = fs;
+    /* data should be visible before the callback sees the new head */
+    SDL_ffmpegMemoryBarrier();
 
-                /* update framesize */
-                frame->size = frame->capacity;
-            }
-            else
-            {
-                /* copy data from sampleBuffer into frame buffer until sampleBuffer is empty */
-                memcpy( frame->buffer + frame->size, file->audioStream->sampleBuffer, audioSize );
+    ring->head = head + bytes;
 
-                /* mark the amount of bytes still in the buffer */
-                file->audioStream->sampleBufferSize = 0;
+    return bytes;
+}
 
-                /* reset buffer offset */
-                file->audioStream->sampleBufferOffset = 0;
+uint32_t SDL_ffmpegRingRead( SDL_ffmpegAudioRing *ring, uint8_t *data, uint32_t bytes )
+{
+    uint32_t tail = ring->tail;
+    uint32_t available = ring->head - tail;
 
-                /* update framesize */
-                frame->size += audioSize;
-            }
-        }
-        else
-        {
-            /* no room in frame, mark samplebuffer as full */
-            file->audioStream->sampleBufferSize = audioSize;
+    /* data should not be read before the head which announced it */
+    SDL_ffmpegMemoryBarrier();
 
-            /* reset buffer offset */
-            file->audioStream->sampleBufferOffset = 0;
-        }
-    }
+    if ( bytes > available ) bytes = available;
 
-    /* pack was used, return 1 */
-    return 1;
+    if ( !bytes ) return 0;
+
+    uint32_t offset = tail & ( ring->size - 1 );
+    uint32_t first = ring->size - offset < bytes ? ring->size - offset : bytes;
+
+    memcpy( data, ring->buffer + offset, first );
+    memcpy( data + first, ring->buffer, bytes - first );
+
+    /* data should be copied before the space is handed back */
+    SDL_ffmpegMemoryBarrier();
+
+    ring->tail = tail + bytes;
+
+    return bytes;
 }
 
-int SDL_ffmpegDecodeVideoFrame( SDL_ffmpegFile* file, AVPacket *pack, SDL_ffmpegVideoFrame *frame )
+void SDL_ffmpegRingSetTime( SDL_ffmpegAudioRing *ring, uint32_t position, int64_t pts, uint32_t bytesPerSecond, SDL_ffmpegFile *file )
 {
-    int got_frame = 0;
+    SDL_ffmpegAudioTime *time = &ring->times[ ring->timeCount % SDL_FFMPEG_AUDIO_TIMES ];
 
-    if ( pack )
-    {
-        /* usefull when dealing with B frames */
-        if ( pack->dts == AV_NOPTS_VALUE )
-        {
-            /* if we did not get a valid timestamp, we make one up based on the last
-               valid timestamp + the duration of a frame */
-            frame->pts = file->videoStream->lastTimeStamp + av_rescale( 1000 * pack->duration, file->videoStream->_ffmpeg->time_base.num, file->videoStream->_ffmpeg->time_base.den );
-        }
-        else
-        {
-            /* write timestamp into the buffer */
-            frame->pts = av_rescale(( pack->dts - file->videoStream->_ffmpeg->start_time ) * 1000, file->videoStream->_ffmpeg->time_base.num, file->videoStream->_ffmpeg->time_base.den );
-        }
+    /* an odd sequence tells readers the timing is being changed */
+    ring->timeSequence++;
 
-        /* check if we are decoding frames which we need not store */
-        if ( frame->pts != AV_NOPTS_VALUE && frame->pts < file->minimalTimestamp )
-        {
-            file->videoStream->_ffmpeg->codec->hurry_up = 1;
-        }
-        else
-        {
-            file->videoStream->_ffmpeg->codec->hurry_up = 0;
-        }
+    SDL_ffmpegMemoryBarrier();
 
-        /* Decode the packet */
-#if ( ( LIBAVCODEC_VERSION_MAJOR <= 52 ) && ( LIBAVCODEC_VERSION_MINOR <= 20 ) )
-        avcodec_decode_video( file->videoStream->_ffmpeg->codec, file->videoStream->decodeFrame, &got_frame, pack->data, pack->size );
-#else
-        avcodec_decode_video2( file->videoStream->_ffmpeg->codec, file->videoStream->decodeFrame, &got_frame, pack );
-#endif
-    }
-    else
-    {
-        /* check if there is still a frame left in the buffer */
+    time->position = position;
+    time->pts = pts;
+    time->bytesPerSecond = bytesPerSecond;
+    time->file = file;
 
-#if ( LIBAVCODEC_VERSION_MAJOR <= 52 && LIBAVCODEC_VERSION_MINOR <= 20 )
-        avcodec_decode_video( file->videoStream->_ffmpeg->codec, file->videoStream->decodeFrame, &got_frame, 0, 0 );
-#else
-        AVPacket temp;
-        av_init_packet( &temp );
-        temp.data = 0;
-        temp.size = 0;
-        temp.stream_index = file->videoStream->_ffmpeg->index;
-        avcodec_decode_video2( file->videoStream->_ffmpeg->codec, file->videoStream->decodeFrame, &got_frame, &temp );
-#endif
-    }
+    ring->timeCount++;
 
-    /* if we did not get a frame or we need to hurry, we return */
-    if ( got_frame && !file->videoStream->_ffmpeg->codec->hurry_up )
+    SDL_ffmpegMemoryBarrier();
+
+    ring->timeSequence++;
+}
+
+int SDL_ffmpegRingGetTime( SDL_ffmpegAudioRing *ring, SDL_ffmpegAudioTime *result )
+{
+    uint32_t sequence, count;
+
+    /* timing can be changed by the audio thread while it is read */
+    do
     {
-        /* convert YUV 420 to YUYV 422 data */
-        if ( frame->overlay && frame->overlay->format == SDL_YUY2_OVERLAY )
-        {
-            int pitch[] =
-            {
-                frame->overlay->pitches[ 0 ],
-                frame->overlay->pitches[ 1 ],
-                frame->overlay->pitches[ 2 ]
-            };
+        sequence = ring->timeSequence;
 
-            sws_scale( getContext( &file->videoStream->conversionContext,
-                                   file->videoStream->_ffmpeg->codec->width,
-                                   file->videoStream->_ffmpeg->codec->height,
-                                   file->videoStream->_ffmpeg->codec->pix_fmt,
-                                   frame->overlay->w, frame->overlay->h,
-                                   PIX_FMT_YUYV422 ),
-                       ( const uint8_t* const* )file->videoStream->decodeFrame->data,
-                       file->videoStream->decodeFrame->linesize,
-                       0,
-                       file->videoStream->_ffmpeg->codec->height,
-                       ( uint8_t* const* )frame->overlay->pixels,
-                       pitch );
-        }
+        SDL_ffmpegMemoryBarrier();
+
+        count = ring->timeCount;
+
+        uint32_t tail = ring->tail,
+                 oldest = count > SDL_FFMPEG_AUDIO_TIMES ? count - SDL_FFMPEG_AUDIO_TIMES : 0;
 
-        /* convert YUV to RGB data */
-        if ( frame->surface && frame->surface->format )
+        /* the newest timestamp which was reached by the audio callback, or
+           the oldest one which is still known */
+        for ( uint32_t n = count; n-- > oldest; )
         {
-            int pitch = frame->surface->pitch;
+            *result = ring->times[ n % SDL_FFMPEG_AUDIO_TIMES ];
 
-            switch ( frame->surface->format->BitsPerPixel )
-            {
-                case 32:
-                    sws_scale( getContext( &file->videoStream->conversionContext,
-                                           file->videoStream->_ffmpeg->codec->width,
-                                           file->videoStream->_ffmpeg->codec->height,
-                                           file->videoStream->_ffmpeg->codec->pix_fmt,
-                                           frame->surface->w, frame->surface->h,
-                                           PIX_FMT_RGB32 ),
-                               ( const uint8_t* const* )file->videoStream->decodeFrame->data,
-                               file->videoStream->decodeFrame->linesize,
-                               0,
-                               file->videoStream->_ffmpeg->codec->height,
-                               ( uint8_t* const* )&frame->surface->pixels,
-                               &pitch );
-                    break;
-                case 24:
-                    sws_scale( getContext( &file->videoStream->conversionContext,
-                                           file->videoStream->_ffmpeg->codec->width,
-                                           file->videoStream->_ffmpeg->codec->height,
-                                           file->videoStream->_ffmpeg->codec->pix_fmt,
-                                           frame->surface->w, frame->surface->h,
-                                           PIX_FMT_RGB24 ),
-                               ( const uint8_t* const* )file->videoStream->decodeFrame->data,
-                               file->videoStream->decodeFrame->linesize,
-                               0,
-                               file->videoStream->_ffmpeg->codec->height,
-                               ( uint8_t* const* )&frame->surface->pixels,
-                               &pitch );
-                    break;
-                default:
-                    break;
-            }
+            if ( ( int32_t )( tail - result->position ) >= 0 ) break;
         }
 
-        /* we write the lastTimestamp we got */
-        file->videoStream->lastTimeStamp = frame->pts;
-
-        /* flag this frame as ready */
-        frame->ready = 1;
+        SDL_ffmpegMemoryBarrier();
     }
+    while ( ( sequence & 1 ) || sequence != ring->timeSequence );
 
-    return frame->ready;
+    return count ? 0 : -1;
 }
 /**
 \endcond
@@ -0,0 +1,362 @@
+/*******************************************************************************
+*                                                                              *
+*   SDL_ffmpeg is a library for basic multimedia functionality.                *
+*   SDL_ffmpeg is based on ffmpeg.                                             *
+*                                                                              *
+*   Copyright (C) 2007  Arjan Houben                                           *
+*                                                                              *
+*   SDL_ffmpeg is free software: you can redistribute it and/or modify         *
+*   it under the terms of the GNU Lesser General Public License as published   *
+*	by the Free Software Foundation, either version 3 of the License, or any   *
+*   later version.                                                             *
+*                                                                              *
+*   This program is distributed in the hope that it will be useful,            *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the               *
+*   GNU Lesser General Public License for more details.                        *
+*                                                                              *
+*   You should have received a copy of the GNU Lesser General Public License   *
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+*                                                                              *
+*******************************************************************************/
+
+/*
+ *  Checks the colour conversion kernels of SDL_ffmpeg. The scalar, SSE2 and
+ *  AVX2 versions of every conversion between YUV420P and RGB24, RGB32 and
+ *  BGR32 should give identical output, and should stay within a few levels
+ *  of swscale. Pictures have random odd sizes, so every kernel converts a
+ *  remainder of pixels and an odd last line.
+ *
+ *  The kernels are internal to SDL_ffmpeg, so the library source is built
+ *  into this test.
+ */
+
+#include "SDL_ffmpeg.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** amount of random pictures converted for every pixel format */
+#define TEST_PICTURES 64
+
+/*
+ *  The limits below are set just above the largest differences measured
+ *  against swscale 9.5 over 200 runs with different seeds. Converting to RGB
+ *  differs most, swscale interpolates chroma where the kernels use the same
+ *  chroma for every 2x2 block; with flat chroma the difference is at most 1.
+ */
+
+/** largest difference with swscale in any sample converted to RGB, in levels */
+#define TEST_RGB_MAX_DIFFERENCE 20
+
+/** largest average difference with swscale over all samples of a picture converted to RGB, in levels */
+#define TEST_RGB_MEAN_DIFFERENCE 3.0
+
+/** largest difference with swscale in any sample converted to YUV, in levels */
+#define TEST_YUV_MAX_DIFFERENCE 5
+
+/** largest average difference with swscale over all samples of a picture converted to YUV, in levels */
+#define TEST_YUV_MEAN_DIFFERENCE 1.0
+
+typedef struct
+{
+    const char *name;
+    int ( *toRGB )( const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, int, enum PixelFormat );
+    int ( *toYUV )( const uint8_t*, const uint8_t*, uint8_t*, uint8_t*, uint8_t*, uint8_t*, int, enum PixelFormat );
+} TestPath;
+
+typedef struct
+{
+    int width, height;
+    uint8_t *data[ 4 ];
+    int stride[ 4 ];
+    int size[ 4 ];
+} TestPicture;
+
+int testAllocate( TestPicture *picture, int width, int height, enum PixelFormat format )
+{
+    memset( picture, 0, sizeof( TestPicture ) );
+
+    picture->width = width;
+    picture->height = height;
+
+    if ( format == PIX_FMT_YUV420P )
+    {
+        /* odd strides make sure no kernel relies on aligned lines */
+        picture->stride[ 0 ] = width + 3;
+        picture->stride[ 1 ] = picture->stride[ 2 ] = ( width + 1 ) / 2 + 5;
+
+        picture->size[ 0 ] = picture->stride[ 0 ] * height;
+        picture->size[ 1 ] = picture->size[ 2 ] = picture->stride[ 1 ] * (( height + 1 ) / 2 );
+    }
+    else
+    {
+        picture->stride[ 0 ] = width * ( format == PIX_FMT_RGB24 ? 3 : 4 ) + 7;
+
+        picture->size[ 0 ] = picture->stride[ 0 ] * height;
+    }
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( !picture->size[ i ] ) continue;
+
+        /* vector code of swscale may write a few pixels past the last line */
+        picture->data[ i ] = ( uint8_t* )calloc( picture->size[ i ] + 256, 1 );
+        if ( !picture->data[ i ] ) return -1;
+    }
+
+    return 0;
+}
+
+void testFree( TestPicture *picture )
+{
+    for ( int i = 0; i < 3; i++ ) free( picture->data[ i ] );
+}
+
+/* smooth content with some noise, like video, so chroma filtering differs little */
+void testFill( uint8_t *data, int stride, int width, int height, int samples, int low, int high )
+{
+    for ( int c = 0; c < samples; c++ )
+    {
+        int base = low + rand() % ( high - low + 1 ),
+            dx = rand() % 5 - 2,
+            dy = rand() % 5 - 2;
+
+        for ( int y = 0; y < height; y++ )
+        {
+            for ( int x = 0; x < width; x++ )
+            {
+                int v = base + ( dx * x ) / 4 + ( dy * y ) / 4 + rand() % 9 - 4;
+
+                data[ y * stride + x * samples + c ] = ( uint8_t )( v < low ? low : v > high ? high : v );
+            }
+        }
+    }
+}
+
+/* compares the samples of two pictures, padding at the end of lines is ignored */
+int testCompare( const TestPicture *a, const TestPicture *b, int plane, int samples, int *maximum, double *mean )
+{
+    int width = plane ? ( a->width + 1 ) / 2 : a->width,
+        height = plane ? ( a->height + 1 ) / 2 : a->height;
+
+    int64_t total = 0;
+    int largest = 0;
+
+    for ( int y = 0; y < height; y++ )
+    {
+        for ( int x = 0; x < width * samples; x++ )
+        {
+            /* the unused byte of 32 bit pixels is not compared */
+            if ( samples == 4 && x % 4 == 3 ) continue;
+
+            int d = abs( a->data[ plane ][ y * a->stride[ plane ] + x ] - b->data[ plane ][ y * b->stride[ plane ] + x ] );
+
+            total += d;
+
+            if ( d > largest ) largest = d;
+        }
+    }
+
+    if ( maximum && largest > *maximum ) *maximum = largest;
+
+    if ( mean )
+    {
+        double m = ( double )total / ( width * height * ( samples == 4 ? 3 : samples ) );
+
+        if ( m > *mean ) *mean = m;
+    }
+
+    return largest;
+}
+
+int testSwscale( const TestPicture *in, enum PixelFormat inFormat, TestPicture *out, enum PixelFormat outFormat )
+{
+    /* same settings SDL_ffmpeg uses for pictures the kernels do not handle */
+    struct SwsContext *context = sws_getContext( in->width, in->height, inFormat,
+                                                 out->width, out->height, outFormat,
+                                                 SWS_BILINEAR, 0, 0, 0 );
+    if ( !context ) return -1;
+
+    const uint8_t *src[ 4 ] = { in->data[ 0 ], in->data[ 1 ], in->data[ 2 ], 0 };
+
+    sws_scale( context, src, in->stride, 0, in->height, out->data, out->stride );
+
+    sws_freeContext( context );
+
+    return 0;
+}
+
+int main( int argc, char** argv )
+{
+    TestPath paths[ 3 ];
+    int pathCount = 0;
+
+    paths[ pathCount ].name = "scalar";
+    paths[ pathCount ].toRGB = 0;
+    paths[ pathCount ].toYUV = 0;
+    pathCount++;
+
+#ifdef SDL_FFMPEG_X86
+    if ( SDL_HasSSE2() )
+    {
+        paths[ pathCount ].name = "SSE2";
+        paths[ pathCount ].toRGB = SDL_ffmpegYUVToRGBSSE2;
+        paths[ pathCount ].toYUV = SDL_ffmpegRGBToYUVSSE2;
+        pathCount++;
+    }
+    else
+    {
+        printf( "SSE2 not supported by this CPU, skipped\n" );
+    }
+
+    if ( SDL_ffmpegHasAVX2() )
+    {
+        paths[ pathCount ].name = "AVX2";
+        paths[ pathCount ].toRGB = SDL_ffmpegYUVToRGBAVX2;
+        paths[ pathCount ].toYUV = SDL_ffmpegRGBToYUVAVX2;
+        pathCount++;
+    }
+    else
+    {
+        printf( "AVX2 not supported by this CPU, skipped\n" );
+    }
+#endif
+
+    SDL_ffmpegInit();
+
+    srand( argc > 1 ? atoi( argv[ 1 ] ) : 1 );
+
+    const enum PixelFormat formats[] = { PIX_FMT_RGB24, PIX_FMT_RGB32, PIX_FMT_BGR32 };
+    const char *names[] = { "RGB24", "RGB32", "BGR32" };
+
+    int failures = 0;
+
+    for ( int f = 0; f < 3; f++ )
+    {
+        int samples = formats[ f ] == PIX_FMT_RGB24 ? 3 : 4;
+
+        int mismatches = 0;
+
+        int rgbMaximum = 0, yuvMaximum = 0;
+        double rgbMean = 0, yuvMean = 0;
+
+        for ( int n = 0; n < TEST_PICTURES; n++ )
+        {
+            /* odd sizes, from below a single vector up to several of them */
+            int width = 2 * ( rand() % 160 ) + 1,
+                height = 2 * ( rand() % 24 ) + 1;
+
+            /* swscale needs a few pixels to set up its filters */
+            int reference = width >= 17 && height >= 3;
+
+            TestPicture yuv, rgb, swsRGB, swsYUV, pathRGB[ 3 ], pathYUV[ 3 ];
+
+            if ( testAllocate( &yuv, width, height, PIX_FMT_YUV420P ) ||
+                    testAllocate( &rgb, width, height, formats[ f ] ) ||
+                    testAllocate( &swsRGB, width, height, formats[ f ] ) ||
+                    testAllocate( &swsYUV, width, height, PIX_FMT_YUV420P ) )
+            {
+                printf( "could not allocate pictures\n" );
+                return 1;
+            }
+
+            testFill( yuv.data[ 0 ], yuv.stride[ 0 ], width, height, 1, 16, 235 );
+            testFill( yuv.data[ 1 ], yuv.stride[ 1 ], ( width + 1 ) / 2, ( height + 1 ) / 2, 1, 16, 240 );
+            testFill( yuv.data[ 2 ], yuv.stride[ 2 ], ( width + 1 ) / 2, ( height + 1 ) / 2, 1, 16, 240 );
+
+            testFill( rgb.data[ 0 ], rgb.stride[ 0 ], width, height, samples, 0, 255 );
+
+            for ( int p = 0; p < pathCount; p++ )
+            {
+                if ( testAllocate( &pathRGB[ p ], width, height, formats[ f ] ) ||
+                        testAllocate( &pathYUV[ p ], width, height, PIX_FMT_YUV420P ) )
+                {
+                    printf( "could not allocate pictures\n" );
+                    return 1;
+                }
+
+                SDL_ffmpegYUVToRGBKernel = paths[ p ].toRGB;
+                SDL_ffmpegRGBToYUVKernel = paths[ p ].toYUV;
+
+                SDL_ffmpegKernelConvert(( const uint8_t* const* )yuv.data, yuv.stride, PIX_FMT_YUV420P, pathRGB[ p ].data, pathRGB[ p ].stride, formats[ f ], width, height );
+
+                SDL_ffmpegKernelConvert(( const uint8_t* const* )rgb.data, rgb.stride, formats[ f ], pathYUV[ p ].data, pathYUV[ p ].stride, PIX_FMT_YUV420P, width, height );
+
+                /* every path should give the same result as the scalar path */
+                if ( p && ( testCompare( &pathRGB[ 0 ], &pathRGB[ p ], 0, samples, 0, 0 ) ||
+                            testCompare( &pathYUV[ 0 ], &pathYUV[ p ], 0, 1, 0, 0 ) ||
+                            testCompare( &pathYUV[ 0 ], &pathYUV[ p ], 1, 1, 0, 0 ) ||
+                            testCompare( &pathYUV[ 0 ], &pathYUV[ p ], 2, 1, 0, 0 ) ) )
+                {
+                    printf( "%s: %s differs from scalar at %dx%d\n", names[ f ], paths[ p ].name, width, height );
+                    mismatches++;
+                }
+            }
+
+            if ( reference )
+            {
+                if ( testSwscale( &yuv, PIX_FMT_YUV420P, &swsRGB, formats[ f ] ) ||
+                        testSwscale( &rgb, formats[ f ], &swsYUV, PIX_FMT_YUV420P ) )
+                {
+                    printf( "%s: swscale could not convert %dx%d\n", names[ f ], width, height );
+                    failures++;
+                }
+                else
+                {
+                    int maximum = 0;
+                    double mean = 0;
+
+                    testCompare( &swsRGB, &pathRGB[ 0 ], 0, samples, &maximum, &mean );
+
+                    if ( maximum > rgbMaximum ) rgbMaximum = maximum;
+                    if ( mean > rgbMean ) rgbMean = mean;
+
+                    if ( maximum > TEST_RGB_MAX_DIFFERENCE || mean > TEST_RGB_MEAN_DIFFERENCE )
+                    {
+                        printf( "%s: YUV420P to %s differs from swscale at %dx%d, max %d mean %.2f\n", names[ f ], names[ f ], width, height, maximum, mean );
+                        failures++;
+                    }
+
+                    maximum = 0;
+                    mean = 0;
+
+                    for ( int i = 0; i < 3; i++ ) testCompare( &swsYUV, &pathYUV[ 0 ], i, 1, &maximum, &mean );
+
+                    if ( maximum > yuvMaximum ) yuvMaximum = maximum;
+                    if ( mean > yuvMean ) yuvMean = mean;
+
+                    if ( maximum > TEST_YUV_MAX_DIFFERENCE || mean > TEST_YUV_MEAN_DIFFERENCE )
+                    {
+                        printf( "%s: %s to YUV420P differs from swscale at %dx%d, max %d mean %.2f\n", names[ f ], names[ f ], width, height, maximum, mean );
+                        failures++;
+                    }
+                }
+            }
+
+            for ( int p = 0; p < pathCount; p++ )
+            {
+                testFree( &pathRGB[ p ] );
+                testFree( &pathYUV[ p ] );
+            }
+
+            testFree( &yuv );
+            testFree( &rgb );
+            testFree( &swsRGB );
+            testFree( &swsYUV );
+        }
+
+        printf( "%s: %d of %d pictures differ between %d paths, difference with swscale to RGB max %d mean %.2f, to YUV max %d mean %.2f\n",
+                names[ f ], mismatches, TEST_PICTURES, pathCount, rgbMaximum, rgbMean, yuvMaximum, yuvMean );
+
+        failures += mismatches;
+    }
+
+    /* restore the kernels this CPU would use */
+    SDL_ffmpegSelectKernels();
+
+    if ( failures ) printf( "%d failures\n", failures );
+    else printf( "all conversions passed\n" );
+
+    return failures ? 1 : 0;
+}